@@ -4,12 +4,14 @@
 #include "new_error.h"
 #include "btfile.h"
 #include "btfilescan.h"
+#include "workload.h"
 #define CHECK(S)\
 	if(S!=OK) return S;
 //-------------------------------------------------------------------
 // BTreeFile::BTreeFile
 //
 // Input   : filename - filename of an index.
+//           readOnly - whether the index is only to be read.
 // Output  : returnStatus - status of execution of constructor.
 //           OK if successful, FAIL otherwise.
 // Purpose : Open the index file, if it exists.
@@ -22,19 +24,61 @@
 //           once you have read or created it. You will use the header
 //           page to find the root node.
 //-------------------------------------------------------------------
-BTreeFile::BTreeFile (Status& returnStatus, const char *filename) {
+BTreeFile::BTreeFile (Status& returnStatus, const char *filename, bool readOnly) {
 	// Save the name of the file so we delete appropriately
 	// when DestroyFile is called.
 	dbname = strcpy(new char[strlen(filename) + 1], filename);
-
+	trace = NULL;
+	this->readOnly = readOnly;
+	reorgKey[0] = '\0';
+	reorgPrev = INVALID_PAGE;
+	reorgRun = INVALID_PAGE;
+	reorgLeft = 0;
+	for (int i = 0; i < BT_CACHED_PAGES; i++)
+		cache[i].pid = INVALID_PAGE;
+	maxCached = MINIBASE_BM->GetNumOfBuffers() / 8;
+	if (maxCached > BT_CACHED_PAGES)
+		maxCached = BT_CACHED_PAGES;
+	numCached = 0;
+	cacheHand = 0;
+
+	// Other threads may be opening or creating indexes too.  The file
+	// entry is looked up and added under one hold of dbMutex, so the
+	// header page is allocated from the space map directly: NewPage
+	// takes dbMutex itself.
+	MutexGuard guard(dbMutex);
+	if (logMgr.Attach() != OK) {
+		std::cerr << "Unable to recover the database from its log." << std::endl;
+		headerID = INVALID_PAGE;
+		header = NULL;
+		returnStatus = FAIL;
+		return;
+	}
 	Status stat = MINIBASE_DB->GetFileEntry(filename, headerID);
 	Page *_headerPage;
 	returnStatus = OK;
 
+	if (stat == FAIL && readOnly) {
+		std::cerr << "Index " << filename << " does not exist." << std::endl;
+		headerID = INVALID_PAGE;
+		header = NULL;
+		returnStatus = FAIL;
+		return;
+	}
+	if (!readOnly && MINIBASE_BM->IsReadOnly()) {
+		std::cerr << "Index " << filename << " must be opened read-only." << std::endl;
+		headerID = INVALID_PAGE;
+		header = NULL;
+		returnStatus = FAIL;
+		return;
+	}
+
 	// File does not exist, so we should create a new index file.
 	if (stat == FAIL) {
 		//Allocate a new header page.
-		stat = MINIBASE_BM->NewPage(headerID, _headerPage, 1);
+		stat = spaceMap.Allocate(headerID, 1);
+		if (stat == OK)
+			stat = MINIBASE_BM->PinPage(headerID, _headerPage, true);
 
 		if (stat != OK) {
 			std::cerr << "Error allocating header page." << std::endl;
@@ -46,7 +90,10 @@ BTreeFile::BTreeFile (Status& returnStatus, const char *filename) {
 
 		header = (BTreeHeaderPage *)(_headerPage);
 		header->Init(headerID);
+		MINIBASE_BM->DirtyPage(headerID);
 		stat = MINIBASE_DB->AddFileEntry(filename, headerID);
+		if (stat == OK)
+			stat = logMgr.Commit();
 
 		if (stat != OK) {
 			std::cerr << "Error creating file" << std::endl;
@@ -63,9 +110,20 @@ BTreeFile::BTreeFile (Status& returnStatus, const char *filename) {
 			headerID = INVALID_PAGE;
 			header = NULL;
 			returnStatus = FAIL;
+			return;
 		}
 
 		header = (BTreeHeaderPage *) _headerPage;
+		if (!header->IsValid())
+			std::cerr << "Index " << filename << " has no valid header page." << std::endl;
+		else if (!header->IsReadable())
+			std::cerr << "Index " << filename << " was written in a format this build cannot read." << std::endl;
+		if (!header->IsValid() || !header->IsReadable()) {
+			MINIBASE_BM->UnpinPage(headerID, CLEAN);
+			headerID = INVALID_PAGE;
+			header = NULL;
+			returnStatus = FAIL;
+		}
 	}
 }
 
@@ -83,9 +141,12 @@ BTreeFile::BTreeFile (Status& returnStatus, const char *filename) {
 BTreeFile::~BTreeFile ()
 {
 	delete [] dbname;
+	DropCache();
 
 	if (headerID != INVALID_PAGE) 
 	{
+		if (EndReorganize() != OK)
+			cerr << "ERROR : Cannot free pages kept by Reorganize in BTreeFile::~BTreeFile" << endl;
 		Status st = MINIBASE_BM->UnpinPage (headerID, CLEAN);
 		if (st != OK)
 		{
@@ -112,7 +173,8 @@ Status freeRecursive(SortedPage* sp){
 	if (leftLinkID != INVALID_PAGE){
 		SortedPage* leftLinkPointer;
 		PIN(leftLinkID, leftLinkPointer);
-		freeRecursive(leftLinkPointer);
+		Status f = freeRecursive(leftLinkPointer);
+		CHECK(f);
 		RecordID currRid;
 		KeyType currKey;
 		PageID nextChild;
@@ -120,7 +182,8 @@ Status freeRecursive(SortedPage* sp){
 		while (s != DONE){
 			SortedPage* actualPage;
 			PIN(nextChild, actualPage);
-			freeRecursive(actualPage);
+			f = freeRecursive(actualPage);
+			CHECK(f);
 			s = pageI->GetNext(currRid, currKey, nextChild);
 		}
 	}
@@ -135,12 +198,38 @@ Status freeRecursive(SortedPage* sp){
 // Input   : None
 // Output  : None
 // Return  : OK if successful, FAIL otherwise.
+// Purpose : Free all pages and delete the entire index file, as one
+//           update of the log while it is on, so that no checkpoint
+//           hands the pages out again before the file entry is gone.
+//-------------------------------------------------------------------
+Status BTreeFile::DestroyFile ()
+{
+	if (readOnly)
+		return FAIL;
+	if (!logMgr.IsLogging())
+		return DestroyIndex();
+	logMgr.BeginUpdate();
+	Status s = DestroyIndex();
+	Status c = logMgr.EndUpdate();
+	return (s != OK) ? s : c;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DestroyIndex
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
 // Purpose : Free all pages and delete the entire index file. Once you have
 //           freed all the pages, you can use MINIBASE_DB->DeleteFileEntry (dbname)
 //           to delete the database file.
 //-------------------------------------------------------------------
-Status BTreeFile::DestroyFile ()
+Status BTreeFile::DestroyIndex ()
 {
+	DropCache();
+	Status s = EndReorganize();
+	CHECK(s);
 	if (header->GetRootPageID() != INVALID_PAGE){
 		//Get the root page 
 		SortedPage *page;
@@ -150,19 +239,20 @@ Status BTreeFile::DestroyFile ()
 			FREEPAGE(header->GetRootPageID());
 		}else{
 			//we have an index root, free all pages recursively
-			freeRecursive(page);
+			s = freeRecursive(page);
+			CHECK(s);
 		}
 	}
 	FREEPAGE(headerID);
 	headerID = INVALID_PAGE;
 	header = NULL;
-	Status s = MINIBASE_DB -> DeleteFileEntry(dbname);
-	return s;
+	MutexGuard guard(dbMutex);
+	return MINIBASE_DB -> DeleteFileEntry(dbname);
 }
 
 //Rebalances index according to slides and returns index to push up.
 //caller must set left link
-Status BTreeFile::RebalanceIndex(BTIndexPage* leftPage, BTIndexPage* rightPage, IndexEntry *& indexToPush){
+Status BTreeFile::RebalanceIndex(BTIndexPage* leftPage, BTIndexPage* rightPage, IndexEntry *indexToPush){
 	KeyType movedKey;
 	PageID pointerToChild;
 	RecordID firstRid, dontcare;
@@ -182,398 +272,1939 @@ Status BTreeFile::RebalanceIndex(BTIndexPage* leftPage, BTIndexPage* rightPage,
 		s =rightPage->DeleteRecord(firstRid);
 		CHECK(s);
 	}
-	Status s = rightPage ->GetFirst(firstRid, movedKey, pointerToChild);
-	CHECK(s);
-	rightPage->SetLeftLink(pointerToChild);
-	s = rightPage->Delete(movedKey, dontcare);
-	//indexToPush = new IndexEntry;
-	indexToPush->value = rightPage->PageNo();
-	/*for(int i=0; i<MAX_KEY_SIZE; i++){
-	indexToPush->key[i] = movedKey[i];
-	}*/
-	memcpy(indexToPush->key, movedKey, strlen(movedKey)+1);
-	return s;
+	Status s = rightPage ->GetFirst(firstRid, movedKey, pointerToChild);
+	CHECK(s);
+	rightPage->SetLeftLink(pointerToChild);
+	s = rightPage->Delete(movedKey, dontcare);
+	rightPage->SetNextPage(leftPage->GetNextPage());
+	leftPage->SetNextPage(rightPage->PageNo());
+	indexToPush->value = rightPage->PageNo();
+	/*for(int i=0; i<MAX_KEY_SIZE; i++){
+	indexToPush->key[i] = movedKey[i];
+	}*/
+	memcpy(indexToPush->key, movedKey, strlen(movedKey)+1);
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::RebalanceLeaf
+//
+// Input   : leftPage - pointer to left page
+//           rightPage - empty page to rebalance too
+// Output  : leftPage - rebalanced
+//			 rightPage - rebalanced
+// Return  : OK if successful, FAIL otherwise.
+//-------------------------------------------------------------------
+Status BTreeFile::RebalanceLeaf(BTLeafPage* leftPage, BTLeafPage* rightPage){
+	while (true) {
+		KeyType movedKey;
+		RecordID movedVal, firstRid, insertedRid;
+		Status s = leftPage->GetFirst(firstRid, movedKey, movedVal);
+		if (s == DONE) break;
+		s = rightPage->Insert(movedKey, movedVal, insertedRid);
+		CHECK(s);
+		s= leftPage->DeleteRecord(firstRid);
+		CHECK(s);
+	}
+	while(leftPage->AvailableSpace() > rightPage->AvailableSpace()){
+		KeyType movedKey;
+		RecordID movedVal, firstRid, insertedRid;
+		Status s = rightPage->GetFirst(firstRid, movedKey, movedVal);
+		CHECK(s);
+		s= leftPage->Insert(movedKey, movedVal, insertedRid);
+		CHECK(s);
+		s =rightPage->DeleteRecord(firstRid);
+		CHECK(s);
+	}
+	rightPage->SetNextPage(leftPage->GetNextPage());
+	leftPage->SetNextPage(rightPage->PageNo());
+	rightPage->SetPrevPage(leftPage->PageNo());
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::LookUpCached
+//
+// Input   : pid - a page.
+// Output  : swips - if not NULL, the entry's hints for the page's
+//                   children.
+// Return  : The page if the cache keeps it pinned, NULL otherwise.
+// Purpose : Find a page without the buffer manager.  The entry stays
+//           only while the caller holds the page's latch; a reader
+//           without one must check merges after using the page.
+//-------------------------------------------------------------------
+SortedPage *BTreeFile::LookUpCached(PageID pid, volatile int **swips)
+{
+	if (numCached == 0)
+		return NULL;
+	for (int i = 0; i < maxCached; i++) {
+		if (cache[i].pid == pid) {
+			if (swips != NULL)
+				*swips = cache[i].swips;
+			return cache[i].page;
+		}
+	}
+	return NULL;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::CachePage
+//
+// Input   : pid - page to keep pinned, latched exclusively.
+//           makeRoom - whether to give up another page if the cache
+//                      is full.
+// Output  : None
+// Return  : None
+// Purpose : Pin a page for the cache.  Holders of the page's latch
+//           may have pinned it themselves or not, so the cache's pin
+//           is taken, and an entry given up, only under an exclusive
+//           latch, when there are no other holders.  Walks without a
+//           latch may still be reading a page given up, so merges is
+//           advanced before it is unpinned.
+//-------------------------------------------------------------------
+void BTreeFile::CachePage(PageID pid, bool makeRoom)
+{
+	MutexGuard guard(cacheMutex);
+	int slot = -1;
+	for (int i = 0; i < maxCached; i++) {
+		if (cache[i].pid == pid)
+			return;
+		if (cache[i].pid == INVALID_PAGE && slot < 0)
+			slot = i;
+	}
+
+	// Pages other threads hold are passed over.
+	for (int n = 0; slot < 0 && makeRoom && n < maxCached; n++) {
+		int i = cacheHand;
+		cacheHand = (cacheHand + 1) % maxCached;
+		PageID victim = cache[i].pid;
+		if (!pageLatches.TryLockExclusive(victim))
+			continue;
+		AtomicCompareAndSwap(&cache[i].pid, victim, INVALID_PAGE);
+		numCached--;
+		merges.Advance();
+		if (MINIBASE_BM->UnpinPage(victim, CLEAN) != OK)
+			cerr << "Unable to unpin page " << victim << endl;
+		pageLatches.Unlock(victim, LATCH_EXCLUSIVE);
+		slot = i;
+	}
+	if (slot < 0)
+		return;
+
+	SortedPage *page;
+	if (MINIBASE_BM->PinPage(pid, (Page *&)page) != OK)
+		return;
+	cache[slot].page = page;
+	for (int i = 0; i < FRAME_SWIPS; i++)
+		cache[slot].swips[i] = INVALID_FRAME;
+	AtomicCompareAndSwap(&cache[slot].pid, INVALID_PAGE, pid);
+	numCached++;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::CacheUpperPage
+//
+// Input   : pid - an index page a walk without latches came through
+//                 near the root.
+//           mergesSeen - merges when the walk started.
+// Output  : None
+// Return  : None
+// Purpose : Add the page to the cache if it has room and the page
+//           isn't busy.  Unless merges moved, the page is still there
+//           once latched: freeing it advances merges first.
+//-------------------------------------------------------------------
+void BTreeFile::CacheUpperPage(PageID pid, unsigned mergesSeen)
+{
+	if (numCached >= maxCached || !pageLatches.TryLockExclusive(pid))
+		return;
+	if (merges.Read() == mergesSeen)
+		CachePage(pid, false);
+	pageLatches.Unlock(pid, LATCH_EXCLUSIVE);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::UncachePage
+//
+// Input   : pid - page latched exclusively.
+// Output  : None
+// Return  : None
+// Purpose : Remove the page from the cache, if it is there, before it
+//           is freed.  The cache's pin becomes the caller's, so the
+//           caller's release or FreePage drops it.  Merges must be
+//           advanced after this, for walks still reading the page.
+//-------------------------------------------------------------------
+void BTreeFile::UncachePage(PageID pid)
+{
+	MutexGuard guard(cacheMutex);
+	for (int i = 0; i < maxCached; i++) {
+		if (cache[i].pid == pid) {
+			AtomicCompareAndSwap(&cache[i].pid, pid, INVALID_PAGE);
+			numCached--;
+			return;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DropCache
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Unpin every page in the cache.  No other thread may be
+//           using the index.
+//-------------------------------------------------------------------
+void BTreeFile::DropCache()
+{
+	for (int i = 0; i < maxCached; i++) {
+		if (cache[i].pid != INVALID_PAGE) {
+			if (MINIBASE_BM->UnpinPage(cache[i].pid, CLEAN) != OK)
+				cerr << "Unable to unpin page " << cache[i].pid << endl;
+			cache[i].pid = INVALID_PAGE;
+		}
+	}
+	numCached = 0;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::PinLatched
+//
+// Input   : pid - a page the caller has latched.
+// Output  : page - the page, pinned for the caller unless the cache
+//                  keeps it.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Pin a latched page, for ReleasePage to unpin.
+//-------------------------------------------------------------------
+Status BTreeFile::PinLatched(PageID pid, SortedPage *&page)
+{
+	page = LookUpCached(pid);
+	if (page != NULL)
+		return OK;
+	if (MINIBASE_BM->PinPage(pid, (Page *&)page) != OK) {
+		cerr << "Unable to pin page " << pid << endl;
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::LatchPage
+//
+// Input   : pid - page to latch and pin.
+//           mode - latch mode.
+// Output  : page - the pinned page.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Latch and pin a page, or leave it alone if the pin fails.
+//           Latches are always taken before pins.
+//-------------------------------------------------------------------
+Status BTreeFile::LatchPage(PageID pid, LatchMode mode, SortedPage *&page)
+{
+	pageLatches.Lock(pid, mode);
+	if (PinLatched(pid, page) != OK) {
+		pageLatches.Unlock(pid, mode);
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::ReleasePage
+//
+// Input   : pid - a page latched and pinned by LatchPage.
+//           mode - latch mode it was taken in.
+//           dirty - whether the page was changed.
+//           hate - whether the caller is done with the page for good,
+//                  see BufMgr::UnpinPage.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Unpin and unlatch a page.  A page the cache keeps stays
+//           pinned, and is only marked dirty.
+//-------------------------------------------------------------------
+Status BTreeFile::ReleasePage(PageID pid, LatchMode mode, bool dirty, bool hate)
+{
+	Status s = OK;
+	if (LookUpCached(pid) == NULL)
+		s = MINIBASE_BM->UnpinPage(pid, dirty, hate);
+	else if (dirty)
+		s = MINIBASE_BM->DirtyPage(pid);
+	pageLatches.Unlock(pid, mode, dirty);
+	if (s != OK)
+		cerr << "Unable to unpin page " << pid << endl;
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::ReleasePath
+//
+// Input   : path - index pages latched by Descend.
+//           to - release the pages above this level.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Release the header and the pages in path[top, to) that are
+//           still held, dirty if they were changed.
+//-------------------------------------------------------------------
+Status BTreeFile::ReleasePath(TreePath &path, int to)
+{
+	Status s = OK;
+
+	if (path.headerLatched) {
+		pageLatches.Unlock(headerID, LATCH_EXCLUSIVE, path.rootChanged);
+		path.headerLatched = false;
+	}
+	for (int i = path.top; i < to; i++) {
+		if (path.level[i].page != NULL) {
+			if (ReleasePage(path.level[i].pid, LATCH_EXCLUSIVE, path.level[i].dirty) != OK)
+				s = FAIL;
+			path.level[i].page = NULL;
+		}
+	}
+	if (to > path.top)
+		path.top = to;
+	return s;
+}
+
+//	Whether a delete below page can leave it needing a merge: it is safe
+//	if it stays at least half full after losing its longest entry.  An
+//	index root is only removed when its last entry goes, and a leaf root
+//	never is.
+static bool IsSafe(SortedPage *page, const char *key, bool isRoot)
+{
+	int entryLen = (page->GetType() == LEAF_NODE) ?
+		GetKeyDataLength(key, LEAF_NODE) : BT_MAX_INDEX_ENTRY;
+
+	if (isRoot)
+		return page->GetType() == LEAF_NODE || page->GetNumOfRecords() > 1;
+	return page->UsedSpace() - SortedPage::RecordSpace(entryLen) >= BT_MIN_USED_SPACE;
+}
+
+//	Whether a non-root page has fallen below half full.
+static bool IsUnderflow(SortedPage *page)
+{
+	return page->UsedSpace() < BT_MIN_USED_SPACE;
+}
+
+//	A page being split hands its high key to the new right half before
+//	the entries are shared out, so that the halves come out even with
+//	it.  The separator becomes the left half's high key afterwards.
+static Status PassHighKey(SortedPage *left, SortedPage *right)
+{
+	if (!left->HasHighKey())
+		return OK;
+	KeyType highKey;
+	memcpy(highKey, left->HighKey(), strlen(left->HighKey()) + 1);
+	Status s = right->SetHighKey(highKey);
+	CHECK(s);
+	return left->SetHighKey(NULL);
+}
+
+//	Whether the halves of a split have room for the entry that didn't
+//	fit, of length entryLen, and left for its new high key sepKey.
+static bool SplitFits(SortedPage *left, SortedPage *right, const char *sepKey,
+					  bool toLeft, int entryLen)
+{
+	if (toLeft)
+		return left->AvailableSpace() - SortedPage::RecordSpace(entryLen) >= GetKeyLength(sepKey);
+	return left->AvailableSpace() >= GetKeyLength(sepKey) && right->AvailableSpace() >= entryLen;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::MoveRight
+//
+// Input   : key - the key being looked for.
+//           mode - latch mode pid is held in.
+//           pid, page - a page latched and pinned by LatchPage.
+// Output  : pid, page - the page on the same level that key belongs
+//                       to, latched and pinned instead.
+// Return  : OK if successful, FAIL otherwise; nothing is held then.
+// Purpose : Follow right links past splits whose separators haven't
+//           reached the parent yet.  Each sibling is latched before
+//           the page to its left is let go.
+//-------------------------------------------------------------------
+Status BTreeFile::MoveRight(const char *key, LatchMode mode, PageID &pid, SortedPage *&page)
+{
+	while (page->PastHighKey(key)) {
+		PageID nextID = page->GetNextPage();
+		SortedPage *next;
+		if (LatchPage(nextID, mode, next) != OK) {
+			ReleasePage(pid, mode, CLEAN);
+			return FAIL;
+		}
+		ReleasePage(pid, mode, CLEAN);
+		pid = nextID;
+		page = next;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SearchLeaf
+//
+// Input   : key - the key to look for.
+//           leafMode - how to latch the leaf.
+// Output  : leafID, leaf - the leaf for key, latched and pinned.
+//           depth - number of index levels above the leaf.
+//           walk - if not NULL, the index pages on the way.
+// Return  : OK if successful, DONE if the tree is empty, FAIL
+//           otherwise.
+// Purpose : Find the leaf for key.  The index pages are only read
+//           optimistically; if writers keep getting in the way, fall
+//           back to latching them.
+//-------------------------------------------------------------------
+Status BTreeFile::SearchLeaf(const char *key, LatchMode leafMode, PageID &leafID,
+							 BTLeafPage *&leaf, int &depth, WalkPath *walk)
+{
+	bool gaveUp;
+	Status s = OptimisticSearch(key, leafMode, leafID, leaf, depth, walk, gaveUp);
+	if (!gaveUp)
+		return s;
+	return CrabToLeaf(key, leafMode, leafID, leaf, depth, walk);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::OptimisticSearch
+//
+// Input   : key - the key to look for.
+//           leafMode - how to latch the leaf.
+// Output  : leafID, leaf - the leaf for key, latched and pinned.
+//           depth - number of index levels above the leaf.
+//           walk - if not NULL, the index pages on the way.
+//           gaveUp - true if writers got in the way too often.
+// Return  : OK if successful, DONE if the tree is empty, FAIL
+//           otherwise.
+// Purpose : Walk from the root to the leaf for key without latching
+//           or pinning the index pages, so that readers don't write
+//           to the pages every walk shares.  Each page is copied out
+//           and its version checked afterwards; a page that changed
+//           meanwhile is read again.  A split only moves entries
+//           right, so a page the walk comes to late still leads to
+//           key through its right links.  Merges and redistributions
+//           are what could lose the walk, by freeing a page or moving
+//           entries left, and they advance merges: while it stays
+//           put, no page the walk has seen went away.  Only the leaf
+//           is latched, and only if it is still at the version read.
+//           Each page keeps the frames its children were last found
+//           in, so a walk over pages in the buffer pool goes from
+//           frame to frame without the page table.
+//-------------------------------------------------------------------
+Status BTreeFile::OptimisticSearch(const char *key, LatchMode leafMode, PageID &leafID,
+								   BTLeafPage *&leaf, int &depth, WalkPath *walk, bool &gaveUp)
+{
+	Page copy;
+	SortedPage *page = (SortedPage *)&copy;
+	gaveUp = false;
+
+	for (int conflicts = 0; conflicts <= BT_OPTIMISTIC_ATTEMPTS; conflicts++) {
+		// The header's version guards the root page id.
+		unsigned mergesSeen = merges.Read();
+		unsigned headerVersion = pageLatches.ReadVersion(headerID);
+		PageID pid = header->GetRootPageID();
+		if (!pageLatches.Validate(headerID, headerVersion))
+			continue;
+		if (pid == INVALID_PAGE)
+			return DONE;
+
+		depth = 0;
+		int frameNo = INVALID_FRAME;	// where pid was last found
+		volatile int *swip = NULL;		// the parent's hint for pid
+		while (conflicts <= BT_OPTIMISTIC_ATTEMPTS) {
+			unsigned version = pageLatches.ReadVersion(pid);
+			volatile int *swips;
+			SortedPage *cached = LookUpCached(pid, &swips);
+			if (cached != NULL)
+				memcpy((char *)&copy, (char *)cached, sizeof(Page));
+			else {
+				int hint = frameNo;
+				if (MINIBASE_BM->CopyPage(pid, &copy, frameNo) != OK) {
+					cerr << "Unable to pin page " << pid << endl;
+					return FAIL;
+				}
+				if (swip != NULL && frameNo != hint)
+					*swip = frameNo;
+				swips = MINIBASE_BM->Swips(frameNo);
+			}
+			if (!pageLatches.Validate(pid, version)) {
+				conflicts++;
+				continue;
+			}
+			if (merges.Read() != mergesSeen)
+				break;
+
+			if (page->PastHighKey(key)) {
+				pid = page->GetNextPage();
+				frameNo = INVALID_FRAME;
+				swip = NULL;
+				continue;
+			}
+			if (page->GetType() == LEAF_NODE) {
+				if (!pageLatches.LockAtVersion(pid, leafMode, version)) {
+					conflicts++;
+					continue;
+				}
+				if (MINIBASE_BM->PinPage(pid, (Page *&)leaf) != OK) {
+					pageLatches.Unlock(pid, leafMode);
+					cerr << "Unable to pin page " << pid << endl;
+					return FAIL;
+				}
+				if (walk != NULL)
+					walk->merges = mergesSeen;
+				leafID = pid;
+				return OK;
+			}
+			if (depth == BT_MAX_HEIGHT) {
+				cerr << "B+ tree deeper than " << BT_MAX_HEIGHT << " levels" << endl;
+				return FAIL;
+			}
+			if (cached == NULL && depth < BT_CACHED_LEVELS)
+				CacheUpperPage(pid, mergesSeen);
+			if (walk != NULL)
+				walk->level[depth] = pid;
+			depth++;
+			int slot;
+			((BTIndexPage *)page)->GetPageID(key, pid, slot);
+			swip = &swips[(slot + 1) % FRAME_SWIPS];
+			frameNo = *swip;
+		}
+	}
+	gaveUp = true;
+	return FAIL;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::CrabToLeaf
+//
+// Input   : key - the key to look for.
+//           leafMode - how to latch the leaf.
+// Output  : leafID, leaf - the leaf for key, latched and pinned.
+//           depth - number of index levels above the leaf.
+//           walk - if not NULL, the index pages on the way.
+// Return  : OK if successful, DONE if the tree is empty, FAIL
+//           otherwise.
+// Purpose : Walk from the root to the leaf for key, latching shared
+//           hand over hand: a child is latched before its parent is
+//           let go, so no merge can get in between, and a split is
+//           followed through the right links.
+//-------------------------------------------------------------------
+Status BTreeFile::CrabToLeaf(const char *key, LatchMode leafMode, PageID &leafID,
+							 BTLeafPage *&leaf, int &depth, WalkPath *walk)
+{
+	if (walk != NULL)
+		walk->merges = merges.Read();
+
+	// The header latch guards the root page id; it is the parent of
+	// the root.
+	PageID parentID = headerID;
+	SortedPage *parent = NULL;
+	pageLatches.Lock(headerID, LATCH_SHARED);
+	PageID pid = header->GetRootPageID();
+	if (pid == INVALID_PAGE) {
+		pageLatches.Unlock(headerID, LATCH_SHARED);
+		return DONE;
+	}
+
+	SortedPage *page;
+	depth = 0;
+	while (true) {
+		if (LatchPage(pid, LATCH_SHARED, page) != OK)
+			break;
+		LatchMode mode = LATCH_SHARED;
+		if (page->GetType() == LEAF_NODE && leafMode == LATCH_EXCLUSIVE) {
+			// Trade the shared latch for an exclusive one.  The parent
+			// is still latched, so the leaf can't be merged away in
+			// between; if it is split, MoveRight catches up.
+			pageLatches.Unlock(pid, LATCH_SHARED);
+			pageLatches.Lock(pid, LATCH_EXCLUSIVE);
+			mode = LATCH_EXCLUSIVE;
+		}
+		if (parent != NULL)
+			ReleasePage(parentID, LATCH_SHARED, CLEAN);
+		else
+			pageLatches.Unlock(headerID, LATCH_SHARED);
+		if (MoveRight(key, mode, pid, page) != OK)
+			return FAIL;
+
+		if (page->GetType() == LEAF_NODE) {
+			leafID = pid;
+			leaf = (BTLeafPage *)page;
+			return OK;
+		}
+		parentID = pid;
+		parent = page;
+		if (depth == BT_MAX_HEIGHT) {
+			cerr << "B+ tree deeper than " << BT_MAX_HEIGHT << " levels" << endl;
+			break;
+		}
+		if (walk != NULL)
+			walk->level[depth] = pid;
+		((BTIndexPage *)page)->GetPageID(key, pid);
+		depth++;
+	}
+
+	if (parent != NULL)
+		ReleasePage(parentID, LATCH_SHARED, CLEAN);
+	else
+		pageLatches.Unlock(headerID, LATCH_SHARED);
+	return FAIL;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Descend
+//
+// Input   : key - the key being deleted.
+// Output  : path - the index pages from the root down, each with the
+//                  slot of the child taken (-1 for the left link).
+//           leafID, leaf - the leaf for key, latched and pinned.
+// Return  : OK if successful, DONE if the tree is empty, FAIL
+//           otherwise.
+// Purpose : Walk from the root to the leaf for key, latching every
+//           page exclusively and moving right past unposted splits.
+//           Whenever a page is safe, a merge below it stops there,
+//           so the header and the pages above it are let go straight
+//           away.  The caller releases the rest of the path and the
+//           leaf.
+//-------------------------------------------------------------------
+Status BTreeFile::Descend(const char *key, TreePath &path, PageID &leafID, BTLeafPage *&leaf)
+{
+	path.depth = 0;
+	path.top = 0;
+	pageLatches.Lock(headerID, LATCH_EXCLUSIVE);
+	path.headerLatched = true;
+	path.rootChanged = false;
+
+	PageID pid = header->GetRootPageID();
+	if (pid == INVALID_PAGE) {
+		ReleasePath(path, 0);
+		return DONE;
+	}
+
+	SortedPage *page;
+	if (LatchPage(pid, LATCH_EXCLUSIVE, page) != OK) {
+		ReleasePath(path, 0);
+		return FAIL;
+	}
+	while (true) {
+		if (MoveRight(key, LATCH_EXCLUSIVE, pid, page) != OK) {
+			ReleasePath(path, path.depth);
+			return FAIL;
+		}
+		if (page->GetType() == LEAF_NODE)
+			break;
+		if (IsSafe(page, key, path.depth == 0))
+			ReleasePath(path, path.depth);
+		if (path.depth == BT_MAX_HEIGHT) {
+			cerr << "B+ tree deeper than " << BT_MAX_HEIGHT << " levels" << endl;
+			ReleasePage(pid, LATCH_EXCLUSIVE, CLEAN);
+			ReleasePath(path, path.depth);
+			return FAIL;
+		}
+		PathEntry &entry = path.level[path.depth++];
+		entry.pid = pid;
+		entry.page = page;
+		entry.dirty = false;
+		((BTIndexPage *)page)->GetPageID(key, pid, entry.slot);
+		if (LatchPage(pid, LATCH_EXCLUSIVE, page) != OK) {
+			ReleasePath(path, path.depth);
+			return FAIL;
+		}
+	}
+	if (IsSafe(page, key, path.depth == 0))
+		ReleasePath(path, path.depth);
+	leafID = pid;
+	leaf = (BTLeafPage *)page;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::NewNode
+//
+// Input   : type - whether the page is to be a leaf or an index page.
+//           near - the page it is split from, or INVALID_PAGE.
+// Output  : pid, page - the new page, pinned.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Allocate a page for the tree.  Leaves and index pages come
+//           from extents of their own, each just after the page it is
+//           split from where there is room, so that the leaf chain
+//           mostly runs forward through the file.
+//-------------------------------------------------------------------
+Status BTreeFile::NewNode(NodeType type, PageID near, PageID &pid, SortedPage *&page)
+{
+	int owner = 2 * headerID + ((type == LEAF_NODE) ? 0 : 1);
+	if (MINIBASE_BM->NewPage(pid, (Page *&)page, 1, near, owner) != OK) {
+		cerr << "Unable to allocate new page " << pid << endl;
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DropNode
+//
+// Input   : pid - a page from NewNode, latched exclusively and pinned,
+//                 that nothing points at.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Let go of the new page of a split that failed, and free it.
+//-------------------------------------------------------------------
+Status BTreeFile::DropNode(PageID pid)
+{
+	Status s = ReleasePage(pid, LATCH_EXCLUSIVE, CLEAN);
+	CHECK(s);
+	FREEPAGE(pid);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SplitLeaf
+//
+// Input   : leaf - a full leaf, latched exclusively and pinned.
+//           key, rid - the entry that didn't fit.
+// Output  : newEntry - the separator and page id of the new right
+//                      sibling, to be inserted in the parent.
+// Return  : OK if successful, FAIL otherwise; leaf is unchanged then.
+// Purpose : Split leaf in two and insert (key, rid) into the half it
+//           belongs to.  The new page is linked in and fenced off
+//           before leaf is let go, so it can be found before its
+//           separator reaches the parent.  The entries are shared out
+//           between a copy of leaf and the new page, which nothing
+//           points at until the copy goes back into leaf; a split
+//           that fails just frees the page.
+//-------------------------------------------------------------------
+Status BTreeFile::SplitLeaf(BTLeafPage *leaf, const char *key, const RecordID rid, IndexEntry *newEntry)
+{
+	PageID rightID;
+	BTLeafPage *right;
+	if (NewNode(LEAF_NODE, leaf->PageNo(), rightID, (SortedPage *&)right) != OK)
+		return FAIL;
+	pageLatches.Lock(rightID, LATCH_EXCLUSIVE);
+	right->Init(rightID);
+	right->SetType(LEAF_NODE);
+
+	// RebalanceLeaf links the new page after leaf; the old next leaf
+	// must point back at it too, so it is latched before anything
+	// changes.
+	PageID nextID = leaf->GetNextPage();
+	SortedPage *next = NULL;
+	if (nextID != INVALID_PAGE && LatchPage(nextID, LATCH_EXCLUSIVE, next) != OK) {
+		DropNode(rightID);
+		return FAIL;
+	}
+
+	Page copy;
+	memcpy((char *)&copy, (char *)leaf, sizeof(Page));
+	Status s = DivideLeaf((BTLeafPage *)&copy, right, key, rid, newEntry);
+	if (s != OK) {
+		if (next != NULL)
+			ReleasePage(nextID, LATCH_EXCLUSIVE, CLEAN);
+		DropNode(rightID);
+		return s;
+	}
+	memcpy((char *)leaf, (char *)&copy, sizeof(Page));
+
+	// The three pages are logged together.
+	PageID group[3] = { leaf->PageNo(), rightID, nextID };
+	Status r = OK;
+	if (next != NULL)
+		next->SetPrevPage(rightID);
+	Status g = MINIBASE_BM->LogPages(group, (next != NULL) ? 3 : 2);
+	if (next != NULL)
+		r = ReleasePage(nextID, LATCH_EXCLUSIVE, DIRTY);
+	Status n = ReleasePage(rightID, LATCH_EXCLUSIVE, DIRTY);
+	return (g != OK) ? g : (r != OK) ? r : n;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DivideLeaf
+//
+// Input   : leaf - a full leaf, or a copy of one.
+//           right - an empty leaf.
+//           key, rid - the entry that didn't fit.
+// Output  : newEntry - the separator and page id of right.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Share out the entries of SplitLeaf and insert (key, rid).
+//-------------------------------------------------------------------
+Status BTreeFile::DivideLeaf(BTLeafPage *leaf, BTLeafPage *right, const char *key,
+							 const RecordID rid, IndexEntry *newEntry)
+{
+	Status s = PassHighKey(leaf, right);
+	CHECK(s);
+	s = RebalanceLeaf(leaf, right);
+	CHECK(s);
+
+	// With long keys the even split may leave no room for the new entry
+	// and the separator; then move entries over from the side short of
+	// room, one at a time.
+	int entryLen = GetKeyDataLength(key, LEAF_NODE);
+	int direction = 0;
+	RecordID firstRid, firstData, dontcare;
+	while (true) {
+		s = right->GetFirst(firstRid, newEntry->key, firstData);
+		CHECK(s);
+		bool toLeft = KeyCmp(key, newEntry->key) < 0;
+		if (SplitFits(leaf, right, newEntry->key, toLeft, entryLen))
+			break;
+
+		int want = (toLeft || leaf->AvailableSpace() < GetKeyLength(newEntry->key)) ? 1 : -1;
+		if (direction == -want)
+			return FAIL;
+		direction = want;
+		BTLeafPage *from = (direction > 0) ? leaf : right;
+		BTLeafPage *to = (direction > 0) ? right : leaf;
+		if (from->GetNumOfRecords() <= 1)
+			return FAIL;
+		KeyType movedKey;
+		RecordID movedRid, movedVal;
+		movedRid.pageNo = from->PageNo();
+		movedRid.slotNo = (direction > 0) ? from->GetNumOfRecords() - 1 : 0;
+		s = from->GetCurrent(movedRid, movedKey, movedVal);
+		CHECK(s);
+		s = to->Insert(movedKey, movedVal, dontcare);
+		CHECK(s);
+		s = from->DeleteRecord(movedRid);
+		CHECK(s);
+	}
+
+	newEntry->value = right->PageNo();
+	s = leaf->SetHighKey(newEntry->key);
+	CHECK(s);
+	if (KeyCmp(key, newEntry->key) < 0)
+		return leaf->Insert(key, rid, dontcare);
+	return right->Insert(key, rid, dontcare);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::SplitIndex
+//
+// Input   : index - a full index page, latched exclusively and pinned.
+//           newEntry - the entry that didn't fit.
+// Output  : newEntry - the separator pushed up and the page id of the
+//                      new right sibling, to be inserted in the parent.
+// Return  : OK if successful, FAIL otherwise; index is unchanged then.
+// Purpose : Split index in two and insert newEntry into the half it
+//           belongs to.  Like SplitLeaf, the new page is linked in and
+//           fenced off straight away, and the entries are shared out
+//           from a copy of index.
+//-------------------------------------------------------------------
+Status BTreeFile::SplitIndex(BTIndexPage *index, IndexEntry *newEntry)
+{
+	PageID rightID;
+	BTIndexPage *right;
+	if (NewNode(INDEX_NODE, index->PageNo(), rightID, (SortedPage *&)right) != OK)
+		return FAIL;
+	pageLatches.Lock(rightID, LATCH_EXCLUSIVE);
+	right->Init(rightID);
+	right->SetType(INDEX_NODE);
+
+	Page copy;
+	memcpy((char *)&copy, (char *)index, sizeof(Page));
+	IndexEntry pushed;
+	Status s = DivideIndex((BTIndexPage *)&copy, right, newEntry, &pushed);
+	if (s != OK) {
+		DropNode(rightID);
+		return s;
+	}
+	memcpy((char *)index, (char *)&copy, sizeof(Page));
+
+	PageID group[2] = { index->PageNo(), rightID };
+	Status g = MINIBASE_BM->LogPages(group, 2);
+	Status r = ReleasePage(rightID, LATCH_EXCLUSIVE, DIRTY);
+	CHECK(g);
+	CHECK(r);
+
+	newEntry->value = pushed.value;
+	memcpy(newEntry->key, pushed.key, strlen(pushed.key) + 1);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::DivideIndex
+//
+// Input   : index - a full index page, or a copy of one.
+//           right - an empty index page.
+//           newEntry - the entry that didn't fit.
+// Output  : pushed - the separator pushed up, and right's page id.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Share out the entries of SplitIndex and insert newEntry.
+//-------------------------------------------------------------------
+Status BTreeFile::DivideIndex(BTIndexPage *index, BTIndexPage *right, IndexEntry *newEntry,
+							  IndexEntry *pushed)
+{
+	Status s = PassHighKey(index, right);
+	CHECK(s);
+	s = RebalanceIndex(index, right, pushed);
+	CHECK(s);
+
+	// As in DivideLeaf, make room if need be, here by rotating entries
+	// through the separator.
+	int entryLen = GetKeyDataLength(newEntry->key, INDEX_NODE);
+	int direction = 0;
+	RecordID dontcare;
+	while (true) {
+		bool toLeft = KeyCmp(newEntry->key, pushed->key) < 0;
+		if (SplitFits(index, right, pushed->key, toLeft, entryLen))
+			break;
+
+		int want = (toLeft || index->AvailableSpace() < GetKeyLength(pushed->key)) ? 1 : -1;
+		if (direction == -want)
+			return FAIL;
+		direction = want;
+		KeyType movedKey;
+		if (direction > 0) {
+			int last = index->GetNumOfRecords() - 1;
+			if (last < 1)
+				return FAIL;
+			index->GetKey(last, movedKey);
+			s = right->Insert(pushed->key, right->GetLeftLink(), dontcare);
+			CHECK(s);
+			right->SetLeftLink(index->GetChild(last));
+			s = index->DeleteEntry(last);
+		} else {
+			if (right->GetNumOfRecords() <= 1)
+				return FAIL;
+			right->GetKey(0, movedKey);
+			s = index->Insert(pushed->key, right->GetLeftLink(), dontcare);
+			CHECK(s);
+			right->SetLeftLink(right->GetChild(0));
+			s = right->DeleteEntry(0);
+		}
+		CHECK(s);
+		memcpy(pushed->key, movedKey, strlen(movedKey) + 1);
+	}
+
+	s = index->SetHighKey(pushed->key);
+	CHECK(s);
+	if (KeyCmp(newEntry->key, pushed->key) < 0)
+		return index->Insert(newEntry->key, newEntry->value, dontcare);
+	return right->Insert(newEntry->key, newEntry->value, dontcare);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::GrowRoot
+//
+// Input   : newEntry - the entry pushed up by a split of the root.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise; the root is unchanged
+//           if the new root could not be filled in.
+// Purpose : Add a level: the new root points at the old root and at
+//           the page split off from it.  The caller holds the header
+//           latch exclusively.
+//-------------------------------------------------------------------
+Status BTreeFile::GrowRoot(IndexEntry *newEntry)
+{
+	PageID rootID;
+	BTIndexPage *root;
+	if (NewNode(INDEX_NODE, header->GetRootPageID(), rootID, (SortedPage *&)root) != OK)
+		return FAIL;
+	pageLatches.Lock(rootID, LATCH_EXCLUSIVE);
+	root->Init(rootID);
+	root->SetType(INDEX_NODE);
+	root->SetLeftLink(header->GetRootPageID());
+
+	RecordID dontcare;
+	Status s = root->Insert(newEntry->key, newEntry->value, dontcare);
+	if (s != OK) {
+		DropNode(rootID);
+		return s;
+	}
+	header->SetRootPageID(rootID);
+	PageID group[2] = { rootID, headerID };
+	s = MINIBASE_BM->LogPages(group, 2);
+	MINIBASE_BM->DirtyPage(headerID);
+
+	// Every walk starts here, so the root gets a place in the cache
+	// even if another page has to give it up.  NewNode's pin is
+	// dropped either way.
+	CachePage(rootID, true);
+	Status r = MINIBASE_BM->UnpinPage(rootID, DIRTY);
+	pageLatches.Unlock(rootID, LATCH_EXCLUSIVE, true);
+	return (s != OK) ? s : r;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::PostSeparator
+//
+// Input   : newEntry - separator and page id of a page split off.
+//           leftID - the page it was split from, no longer latched.
+//           height - levels between leftID and the leaves.
+//           walk, depth - a walk that came through leftID's level.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Insert newEntry into the parent level, one latch at a
+//           time.  The parent is the walk's page at that level, or
+//           one to the right of it if that has split since; if the
+//           parent splits too, its separator goes up in turn.  When
+//           merges since the walk could have moved or freed the
+//           parent, or leftID was at the top but is no longer the
+//           root, walk down again for a new path.
+//-------------------------------------------------------------------
+Status BTreeFile::PostSeparator(IndexEntry *newEntry, PageID leftID, int height,
+								WalkPath &walk, int depth)
+{
+	RecordID dontcare;
+	Status s;
+
+	while (true) {
+		int level = depth - 1 - height;
+		if (level < 0) {
+			// leftID was the root.  If it still is, the tree grows;
+			// otherwise another thread is growing it, so give that one
+			// a chance to finish.
+			pageLatches.Lock(headerID, LATCH_EXCLUSIVE);
+			if (header->GetRootPageID() == leftID) {
+				s = GrowRoot(newEntry);
+				pageLatches.Unlock(headerID, LATCH_EXCLUSIVE, true);
+				return s;
+			}
+			pageLatches.Unlock(headerID, LATCH_EXCLUSIVE);
+			YieldThread();
+		} else {
+			// The latch keeps the parent from being merged away from
+			// here on; the pin waits until it is known to be there.
+			PageID pid = walk.level[level];
+			pageLatches.Lock(pid, LATCH_EXCLUSIVE);
+			if (merges.Read() == walk.merges) {
+				SortedPage *page;
+				if (PinLatched(pid, page) != OK) {
+					pageLatches.Unlock(pid, LATCH_EXCLUSIVE);
+					return FAIL;
+				}
+				s = MoveRight(newEntry->key, LATCH_EXCLUSIVE, pid, page);
+				CHECK(s);
+
+				BTIndexPage *index = (BTIndexPage *)page;
+				if (index->AvailableSpace() >= GetKeyDataLength(newEntry->key, INDEX_NODE)) {
+					s = index->Insert(newEntry->key, newEntry->value, dontcare);
+					Status r = ReleasePage(pid, LATCH_EXCLUSIVE, DIRTY);
+					return (s != OK) ? s : r;
+				}
+				s = SplitIndex(index, newEntry);
+				Status r = ReleasePage(pid, LATCH_EXCLUSIVE, DIRTY);
+				CHECK(s);
+				CHECK(r);
+				leftID = pid;
+				height++;
+				continue;
+			}
+			pageLatches.Unlock(pid, LATCH_EXCLUSIVE);
+		}
+
+		// The separator belongs next to the other keys like it, so the
+		// walk for it goes through its parent level.
+		PageID leafID;
+		BTLeafPage *leaf;
+		s = SearchLeaf(newEntry->key, LATCH_SHARED, leafID, leaf, depth, &walk);
+		if (s != OK)
+			return FAIL;
+		s = ReleasePage(leafID, LATCH_SHARED, CLEAN);
+		CHECK(s);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Insert
+//
+// Input   : key - pointer to the value of the key to be inserted.
+//           rid - RecordID of the record to be inserted.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Insert an index entry with this rid and key, as one
+//           update of the log while it is on.
+//-------------------------------------------------------------------
+Status BTreeFile::Insert (const char *key, const RecordID rid)
+{
+	if (!logMgr.IsLogging())
+		return InsertKey(key, rid);
+	logMgr.BeginUpdate();
+	Status s = InsertKey(key, rid);
+	Status c = logMgr.EndUpdate();
+	return (s != OK) ? s : c;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::InsertKey
+//
+// Input   : key - pointer to the value of the key to be inserted.
+//           rid - RecordID of the record to be inserted.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Insert an index entry with this rid and key.
+// Note    : If the root didn't exist, create it.
+//-------------------------------------------------------------------
+Status BTreeFile::InsertKey (const char *key, const RecordID rid)
+{
+	if (readOnly)
+		return FAIL;
+	if (trace != NULL) {
+		TraceOp op;
+		op.type = TRACE_INSERT;
+		op.hasLow = true;
+		op.hasHigh = false;
+		strncpy(op.lowKey, key, MAX_KEY_SIZE);
+		op.rid = rid;
+		op.limit = 0;
+		trace->Write(op);
+	}
+	PageID leafID;
+	BTLeafPage *leaf;
+	int depth;
+	WalkPath walk;
+	RecordID dontcare;
+	Status s;
+	while ((s = SearchLeaf(key, LATCH_EXCLUSIVE, leafID, leaf, depth, &walk)) == DONE) {
+		// The first insert creates the root, unless another thread
+		// got there first.
+		pageLatches.Lock(headerID, LATCH_EXCLUSIVE);
+		if (header->GetRootPageID() == INVALID_PAGE) {
+			BTLeafPage *page;
+			PageID pid;
+			s = NewNode(LEAF_NODE, INVALID_PAGE, pid, (SortedPage *&)page);
+			if (s == OK) {
+				page->Init(pid);
+				page->SetType(LEAF_NODE);
+				header->SetRootPageID(pid);
+				s = page->Insert(key, rid, dontcare);
+				PageID group[2] = { pid, headerID };
+				Status g = MINIBASE_BM->LogPages(group, 2);
+				if (s == OK)
+					s = g;
+				MINIBASE_BM->DirtyPage(headerID);
+				MINIBASE_BM->UnpinPage(pid, DIRTY);
+			}
+			pageLatches.Unlock(headerID, LATCH_EXCLUSIVE, s == OK);
+			return s;
+		}
+		pageLatches.Unlock(headerID, LATCH_EXCLUSIVE);
+	}
+	if (s != OK)
+		return s;
+
+	if (leaf->AvailableSpace() >= GetKeyDataLength(key, LEAF_NODE)) {
+		s = leaf->Insert(key, rid, dontcare);
+		Status r = ReleasePage(leafID, LATCH_EXCLUSIVE, DIRTY);
+		return (s != OK) ? s : r;
+	}
+
+	// Split the leaf with nothing else latched, and let go of it before
+	// the separator goes up: until it gets there, the new page is
+	// reached through the leaf's right link.
+	IndexEntry newEntry;
+	s = SplitLeaf(leaf, key, rid, &newEntry);
+	Status r = ReleasePage(leafID, LATCH_EXCLUSIVE, DIRTY);
+	CHECK(s);
+	CHECK(r);
+	return PostSeparator(&newEntry, leafID, 0, walk, depth);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::RedistributeLeaves
+//
+// Input   : left, right - adjacent leaves, pinned.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Move entries from the fuller leaf to the other one while
+//           that narrows the difference between them.  The caller
+//           replaces the separator with the new first key of right,
+//           and makes it left's high key: left keeps room for it.
+//-------------------------------------------------------------------
+Status BTreeFile::RedistributeLeaves(BTLeafPage *left, BTLeafPage *right)
+{
+	KeyType movedKey;
+	RecordID movedRid, movedVal, dontcare;
+	Status s;
+
+	while (left->UsedSpace() < right->UsedSpace()) {
+		s = right->GetFirst(movedRid, movedKey, movedVal);
+		CHECK(s);
+		int len = GetKeyDataLength(movedKey, LEAF_NODE);
+		if (SortedPage::RecordSpace(len) >= right->UsedSpace() - left->UsedSpace()
+			|| left->AvailableSpace() - SortedPage::RecordSpace(len) < MAX_KEY_SIZE)
+			break;
+		s = left->Insert(movedKey, movedVal, dontcare);
+		CHECK(s);
+		s = right->DeleteRecord(movedRid);
+		CHECK(s);
+	}
+	while (right->UsedSpace() < left->UsedSpace()) {
+		movedRid.pageNo = left->PageNo();
+		movedRid.slotNo = left->GetNumOfRecords() - 1;
+		s = left->GetCurrent(movedRid, movedKey, movedVal);
+		CHECK(s);
+		int len = GetKeyDataLength(movedKey, LEAF_NODE);
+		if (SortedPage::RecordSpace(len) >= left->UsedSpace() - right->UsedSpace()
+			|| right->AvailableSpace() < len)
+			break;
+		s = right->Insert(movedKey, movedVal, dontcare);
+		CHECK(s);
+		s = left->DeleteRecord(movedRid);
+		CHECK(s);
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::RedistributeIndex
+//
+// Input   : left, right - adjacent index pages, pinned.
+//           sepKey - the parent's separator between them.
+// Output  : sepKey - the new separator.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Rotate entries through the separator from the fuller page
+//           to the other one while that narrows the difference.  As
+//           with RedistributeLeaves, left keeps room for the new
+//           separator as its high key.
+//-------------------------------------------------------------------
+Status BTreeFile::RedistributeIndex(BTIndexPage *left, BTIndexPage *right, char *sepKey)
+{
+	RecordID dontcare;
+	Status s;
+
+	while (left->UsedSpace() < right->UsedSpace() && right->GetNumOfRecords() > 0) {
+		int outLen = GetKeyDataLength(sepKey, INDEX_NODE);
+		KeyType firstKey;
+		right->GetKey(0, firstKey);
+		int inLen = GetKeyDataLength(firstKey, INDEX_NODE);
+		if (SortedPage::RecordSpace(inLen) >= right->UsedSpace() - left->UsedSpace()
+			|| left->AvailableSpace() - SortedPage::RecordSpace(outLen) < MAX_KEY_SIZE)
+			break;
+		s = left->Insert(sepKey, right->GetLeftLink(), dontcare);
+		CHECK(s);
+		right->SetLeftLink(right->GetChild(0));
+		memcpy(sepKey, firstKey, strlen(firstKey) + 1);
+		s = right->DeleteEntry(0);
+		CHECK(s);
+	}
+	while (right->UsedSpace() < left->UsedSpace() && left->GetNumOfRecords() > 0) {
+		int last = left->GetNumOfRecords() - 1;
+		int outLen = GetKeyDataLength(sepKey, INDEX_NODE);
+		KeyType lastKey;
+		left->GetKey(last, lastKey);
+		int inLen = GetKeyDataLength(lastKey, INDEX_NODE);
+		if (SortedPage::RecordSpace(inLen) >= left->UsedSpace() - right->UsedSpace()
+			|| right->AvailableSpace() < outLen)
+			break;
+		s = right->Insert(sepKey, right->GetLeftLink(), dontcare);
+		CHECK(s);
+		right->SetLeftLink(left->GetChild(last));
+		memcpy(sepKey, lastKey, strlen(lastKey) + 1);
+		s = left->DeleteEntry(last);
+		CHECK(s);
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::MergeLeaves
+//
+// Input   : parent - path entry of the parent, latched exclusively.
+//           sepSlot - the parent's entry for rightID.
+//           leftID, left - a leaf, latched exclusively.
+//           rightID, right - the next leaf, latched exclusively, whose
+//                            entries fit in left.
+//           childID - leftID or rightID if the caller changed it, for
+//                     ReleaseSiblings, else INVALID_PAGE.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Move right's entries into left, which takes over right's
+//           high key and right link too, drop right's entry from
+//           parent and free right.  The next leaf is latched, and the
+//           entries moved on copies of left and parent, before any
+//           page changes; a merge that fails leaves the pages as they
+//           were.  Both leaves are let go either way.
+//-------------------------------------------------------------------
+Status BTreeFile::MergeLeaves(PathEntry &parent, int sepSlot, PageID leftID, BTLeafPage *left,
+							  PageID rightID, BTLeafPage *right, PageID childID)
+{
+	PageID nextID = right->GetNextPage();
+	SortedPage *next = NULL;
+	if (nextID != INVALID_PAGE && LatchPage(nextID, LATCH_EXCLUSIVE, next) != OK) {
+		ReleaseSiblings(leftID, rightID, childID);
+		return FAIL;
+	}
+
+	KeyType highKey;
+	bool hasHighKey = right->HasHighKey();
+	if (hasHighKey)
+		memcpy(highKey, right->HighKey(), strlen(right->HighKey()) + 1);
+
+	Page leftCopy, parentCopy;
+	memcpy((char *)&leftCopy, (char *)left, sizeof(Page));
+	memcpy((char *)&parentCopy, (char *)parent.page, sizeof(Page));
+	BTLeafPage *newLeft = (BTLeafPage *)&leftCopy;
+	Status s = newLeft->SetHighKey(NULL);
+	KeyType movedKey;
+	RecordID movedRid, movedVal, dontcare;
+	Status m;
+	for (m = right->GetFirst(movedRid, movedKey, movedVal); s == OK && m == OK;
+		 m = right->GetNext(movedRid, movedKey, movedVal))
+		s = newLeft->Insert(movedKey, movedVal, dontcare);
+	if (s == OK)
+		s = newLeft->SetHighKey(hasHighKey ? highKey : NULL);
+	if (s == OK)
+		s = ((BTIndexPage *)&parentCopy)->DeleteEntry(sepSlot);
+	if (s != OK) {
+		if (next != NULL)
+			ReleasePage(nextID, LATCH_EXCLUSIVE, CLEAN);
+		ReleaseSiblings(leftID, rightID, childID);
+		return s;
+	}
+	newLeft->SetNextPage(nextID);
+
+	merges.Advance();
+	memcpy((char *)left, (char *)&leftCopy, sizeof(Page));
+	memcpy((char *)parent.page, (char *)&parentCopy, sizeof(Page));
+	parent.dirty = true;
+	if (next != NULL)
+		next->SetPrevPage(leftID);
+
+	// Logged together before any of them is released; right is freed.
+	PageID group[3] = { parent.pid, leftID, nextID };
+	s = MINIBASE_BM->LogPages(group, (next != NULL) ? 3 : 2);
+	if (next != NULL) {
+		Status r = ReleasePage(nextID, LATCH_EXCLUSIVE, DIRTY);
+		if (s == OK)
+			s = r;
+	}
+	Status r = ReleaseMerged(leftID, rightID);
+	return (s != OK) ? s : r;
 }
 
 
 //-------------------------------------------------------------------
-// BTreeFile::InsertIntoIndex
+// BTreeFile::FixUnderflow
 //
-// Input   : key - pointer to the value of the key to be inserted.
-//           rid - RecordID of the record to be inserted.
-//			 curPage - pointer to the current page to insert into
-// Output  : newEntry - the entry we have just inserted.
+// Input   : parent - path entry of the parent, latched exclusively,
+//                    with the slot of the underfull child.
+//           childID, child - the underfull child, latched exclusively.
+// Output  : None
 // Return  : OK if successful, FAIL otherwise.
-// Purpose : Insert a key,rid pair into an index 
+// Purpose : Merge child with a sibling if both fit on one page, else
+//           move entries over from the sibling.  The child is
+//           released or freed.  Only merging removes an entry from
+//           parent, which may leave parent underfull in turn.
+//           Entries are moved on copies of the pages, which go back
+//           only once every step has worked, so a failure leaves
+//           parent and both siblings as they were.
+// Note    : Latches are taken top down and left to right everywhere
+//           else, so the left sibling is only tried; if another thread
+//           holds it the child is left underfull.  So is a child that
+//           isn't next to its sibling in parent yet, because a split
+//           between them hasn't posted its separator.
 //-------------------------------------------------------------------
-Status BTreeFile::InsertIntoIndex(const char * key, const RecordID rid, BTIndexPage* curPage, IndexEntry *&newEntry){
-	RecordID currRid;
-	PageID prevPointerToChild;
-	KeyType currKey;
-	Status s = curPage->GetFirst(currRid, currKey, prevPointerToChild);
-	CHECK(s);
-	SortedPage * childPage;
-	if(KeyCmp(key, currKey) <0){
-		prevPointerToChild = curPage->GetLeftLink();
-		PIN(prevPointerToChild, childPage);
-	}else{
-		PageID nextPointerToChild;
-		while(curPage->GetNext(currRid, currKey, nextPointerToChild)!=DONE){
-			if(KeyCmp(key, currKey) <0) break;
-			prevPointerToChild = nextPointerToChild;
-		}
-		PIN(prevPointerToChild, childPage);
-	}
-	if(childPage->GetType() ==INDEX_NODE){
-		s = InsertIntoIndex(key, rid, ((BTIndexPage *)childPage), newEntry); 
-	}else if(childPage->GetType()==LEAF_NODE){
-		s = InsertIntoLeaf(key, rid, ((BTLeafPage *)childPage), newEntry);
-	}else {
-		cout << "page of invalid type in InsertIntoIndex" << endl;
+Status BTreeFile::FixUnderflow(PathEntry &parent, PageID childID, SortedPage *child)
+{
+	BTIndexPage *parentPage = (BTIndexPage *)parent.page;
+	PageID leftID, rightID;
+	SortedPage *left, *right;
+	int sepSlot;
+
+	// Descend may have moved right of the child parent points at.
+	if (parentPage->GetChild(parent.slot) != childID)
+		return ReleasePage(childID, LATCH_EXCLUSIVE, DIRTY);
+
+	// Pair the child with its left sibling, or with its right sibling
+	// if it is the leftmost child.  sepSlot is the parent's entry for
+	// the right page of the pair.
+	if (parent.slot >= 0) {
+		sepSlot = parent.slot;
+		leftID = parentPage->GetChild(sepSlot - 1);
+		if (!pageLatches.TryLockExclusive(leftID))
+			return ReleasePage(childID, LATCH_EXCLUSIVE, DIRTY);
+		if (PinLatched(leftID, left) != OK) {
+			pageLatches.Unlock(leftID, LATCH_EXCLUSIVE);
+			ReleasePage(childID, LATCH_EXCLUSIVE, DIRTY);
+			return FAIL;
+		}
+		rightID = childID;
+		right = child;
+	} else {
+		if (parentPage->GetNumOfRecords() == 0)
+			return ReleasePage(childID, LATCH_EXCLUSIVE, DIRTY);
+		sepSlot = 0;
+		leftID = childID;
+		left = child;
+		rightID = parentPage->GetChild(0);
+		if (LatchPage(rightID, LATCH_EXCLUSIVE, right) != OK) {
+			ReleasePage(childID, LATCH_EXCLUSIVE, DIRTY);
+			return FAIL;
+		}
 	}
-	CHECK(s);
-	UNPIN(childPage->PageNo(), true);
-	if(newEntry->value !=INVALID_PAGE){
-		if(curPage->AvailableSpace() >= GetKeyDataLength(newEntry->key, INDEX_NODE)){
-			RecordID dontcare;
-			s = curPage->Insert(newEntry->key, newEntry->value, dontcare);
-			newEntry->value=INVALID_PAGE;
-		}else{
-			BTIndexPage * newRightIndexPage;
-			PageID newRightIndexPID;
-			NEWPAGE(newRightIndexPID, newRightIndexPage);
-			newRightIndexPage->Init(newRightIndexPID);
-			newRightIndexPage->SetType(INDEX_NODE);
-			IndexEntry *temp = new IndexEntry;
-			temp->value = newEntry->value;
-			memcpy(temp->key, newEntry->key, strlen(newEntry->key)+1);
-			RebalanceIndex(curPage, newRightIndexPage, newEntry);
-			RecordID dontcare;
-			//insert new index into appropriate index
-			if(KeyCmp(temp->key,newEntry->key) <0){
-				s = curPage->Insert(temp->key, temp->value, dontcare); 
-			}else{
-				s = newRightIndexPage->Insert(temp->key, temp->value, dontcare);
+	if (left->GetNextPage() != rightID)
+		return ReleaseSiblings(leftID, rightID, childID);
+
+	KeyType sepKey;
+	parentPage->GetKey(sepSlot, sepKey);
+	int sepLen = GetKeyDataLength(sepKey, INDEX_NODE);
+	bool parentHasRoom =
+		parentPage->AvailableSpace() + SortedPage::RecordSpace(sepLen) >= BT_MAX_INDEX_ENTRY;
+
+	// Both merging and redistributing move entries left, where a walk
+	// without latches wouldn't look for them.
+	KeyType highKey;
+	bool hasHighKey = right->HasHighKey();
+	if (hasHighKey)
+		memcpy(highKey, right->HighKey(), strlen(right->HighKey()) + 1);
+	int leftSpace = left->AvailableSpace() + left->HighKeySpace();
+	int rightSpace = right->UsedSpace() + right->HighKeySpace();
+
+	if (child->GetType() == LEAF_NODE && rightSpace <= leftSpace)
+		return MergeLeaves(parent, sepSlot, leftID, (BTLeafPage *)left,
+						   rightID, (BTLeafPage *)right, childID);
+
+	Page leftCopy, rightCopy, parentCopy;
+	memcpy((char *)&leftCopy, (char *)left, sizeof(Page));
+	memcpy((char *)&rightCopy, (char *)right, sizeof(Page));
+	memcpy((char *)&parentCopy, (char *)parentPage, sizeof(Page));
+	BTIndexPage *newParent = (BTIndexPage *)&parentCopy;
+	bool changed = false;
+
+	RecordID dontcare;
+	Status s = OK;
+	if (child->GetType() == LEAF_NODE) {
+		BTLeafPage *newLeft = (BTLeafPage *)&leftCopy;
+		BTLeafPage *newRight = (BTLeafPage *)&rightCopy;
+
+		// Redistributing may lengthen the separator; skip it when the
+		// parent couldn't take the longest one.
+		if (parentHasRoom) {
+			changed = true;
+			s = newLeft->SetHighKey(NULL);
+			if (s == OK)
+				s = RedistributeLeaves(newLeft, newRight);
+			RecordID firstRid, firstVal;
+			if (s == OK)
+				s = newRight->GetFirst(firstRid, sepKey, firstVal);
+			if (s == OK)
+				s = newLeft->SetHighKey(sepKey);
+			if (s == OK)
+				s = newParent->DeleteEntry(sepSlot);
+			if (s == OK)
+				s = newParent->Insert(sepKey, rightID, dontcare);
+		}
+	} else {
+		BTIndexPage *newLeft = (BTIndexPage *)&leftCopy;
+		BTIndexPage *newRight = (BTIndexPage *)&rightCopy;
+
+		if (rightSpace + SortedPage::RecordSpace(sepLen) <= leftSpace) {
+			s = newLeft->SetHighKey(NULL);
+			// The separator comes down to point at right's left link.
+			if (s == OK)
+				s = newLeft->Insert(sepKey, newRight->GetLeftLink(), dontcare);
+			for (int i = 0; s == OK && i < newRight->GetNumOfRecords(); i++) {
+				KeyType movedKey;
+				newRight->GetKey(i, movedKey);
+				s = newLeft->Insert(movedKey, newRight->GetChild(i), dontcare);
+			}
+			if (s == OK)
+				s = newLeft->SetHighKey(hasHighKey ? highKey : NULL);
+			if (s == OK)
+				s = newParent->DeleteEntry(sepSlot);
+			if (s != OK) {
+				ReleaseSiblings(leftID, rightID, childID);
+				return s;
 			}
-			UNPIN(newRightIndexPID, true);
-			delete temp;
+			newLeft->SetNextPage(newRight->GetNextPage());
+
+			UncachePage(rightID);
+			merges.Advance();
+			memcpy((char *)left, (char *)&leftCopy, sizeof(Page));
+			memcpy((char *)parentPage, (char *)&parentCopy, sizeof(Page));
+			parent.dirty = true;
+			PageID group[2] = { parent.pid, leftID };
+			s = MINIBASE_BM->LogPages(group, 2);
+			Status r = ReleaseMerged(leftID, rightID);
+			return (s != OK) ? s : r;
+		}
+
+		if (parentHasRoom) {
+			changed = true;
+			s = newLeft->SetHighKey(NULL);
+			if (s == OK)
+				s = RedistributeIndex(newLeft, newRight, sepKey);
+			if (s == OK)
+				s = newLeft->SetHighKey(sepKey);
+			if (s == OK)
+				s = newParent->DeleteEntry(sepSlot);
+			if (s == OK)
+				s = newParent->Insert(sepKey, rightID, dontcare);
 		}
 	}
-	return s;
+	if (s != OK) {
+		ReleaseSiblings(leftID, rightID, childID);
+		return s;
+	}
+	if (changed) {
+		merges.Advance();
+		memcpy((char *)left, (char *)&leftCopy, sizeof(Page));
+		memcpy((char *)right, (char *)&rightCopy, sizeof(Page));
+		memcpy((char *)parentPage, (char *)&parentCopy, sizeof(Page));
+		parent.dirty = true;
+	}
+
+	PageID group[3] = { parent.pid, leftID, rightID };
+	s = MINIBASE_BM->LogPages(group, 3);
+	Status r = ReleasePage(leftID, LATCH_EXCLUSIVE, DIRTY);
+	Status r2 = ReleasePage(rightID, LATCH_EXCLUSIVE, DIRTY);
+	return (s != OK) ? s : (r != OK) ? r : r2;
 }
+
+
 //-------------------------------------------------------------------
-// BTreeFile::InsertIntoLeaf
+// BTreeFile::ReleaseSiblings
 //
-// Input   : key - pointer to the value of the key to be inserted.
-//           rid - RecordID of the record to be inserted.
-//			 curPage - pointer to the current page to insert into
-// Output  : newEntry - the entry we have just inserted.
+// Input   : leftID, rightID - pages paired by FixUnderflow or
+//                             Reorganize, latched exclusively.
+//           childID - the one the caller changed, or INVALID_PAGE.
+// Output  : None
 // Return  : OK if successful, FAIL otherwise.
-// Purpose : Insert a key,rid pair into an leaf 
-//-------------------------------------------------------------------
-Status BTreeFile::InsertIntoLeaf(const char * key, const RecordID rid, BTLeafPage* curPage, IndexEntry *&newEntry){
-	if(curPage->AvailableSpace() >= GetKeyDataLength(key, LEAF_NODE)){
-		RecordID dontcare;
-		Status r = curPage ->Insert(key, rid, dontcare);
-		CHECK(r);
-		newEntry->value=INVALID_PAGE;
-		return r;
-	}
-	//not enough space, time to split.
-	PageID newRightLeafPID;
-	BTLeafPage * newRightLeafPage;
-	NEWPAGE(newRightLeafPID, newRightLeafPage);
-	newRightLeafPage->Init(newRightLeafPID);
-	newRightLeafPage->SetType(LEAF_NODE);
-	Status s = RebalanceLeaf(curPage, newRightLeafPage);
-	CHECK(s);
-	newEntry->value = newRightLeafPID;
-	RecordID dontcare;
-	KeyType smallestKey;
-	RecordID dontcare2;
-	s = newRightLeafPage->GetFirst(dontcare, smallestKey, dontcare2);
-	CHECK(s);
-	/*for(int i=0; i<MAX_KEY_SIZE; i++){
-	newEntry->key[i] = smallestKey[i];
-	}*/
-	memcpy(newEntry->key, smallestKey, strlen(smallestKey)+1);
-	if(KeyCmp(key, newEntry->key) <0){
-		s = curPage->Insert(key, rid, dontcare);
-	}else{
-		s = newRightLeafPage->Insert(key, rid, dontcare);
-	}
-	UNPIN(newRightLeafPID, true);
-	return s;
+// Purpose : Let go of both pages after a merge or redistribution
+//           that didn't happen, the child dirty.
+//-------------------------------------------------------------------
+Status BTreeFile::ReleaseSiblings(PageID leftID, PageID rightID, PageID childID)
+{
+	Status s = ReleasePage(leftID, LATCH_EXCLUSIVE, leftID == childID);
+	Status r = ReleasePage(rightID, LATCH_EXCLUSIVE, rightID == childID);
+	return (s != OK) ? s : r;
 }
 
+
 //-------------------------------------------------------------------
-// BTreeFile::InsertRootIsLeaf
+// BTreeFile::ReleaseMerged
 //
-// Input   : key - pointer to the value of the key to be inserted.
-//           rid - RecordID of the record to be inserted.
+// Input   : leftID - page that absorbed rightID, latched exclusively.
+//           rightID - the emptied page, latched exclusively.
 // Output  : None
 // Return  : OK if successful, FAIL otherwise.
-// Purpose : Insert an index entry with this rid and key.  
-//-------------------------------------------------------------------
-Status BTreeFile::InsertRootIsLeaf (const char * key, const RecordID rid, BTLeafPage *& root){
-	if (root->AvailableSpace() >= GetKeyDataLength(key, LEAF_NODE)){
-		//this means we have enough space in the leaf
-		RecordID newEntry;
-		Status r = ((BTLeafPage *)root)->Insert(key, rid, newEntry);
-		return r;
-	}
-	//we don't have enough space in the leaf. so its time to start indexing
-	// we store our old root page since we'll need it later
-	//only for naming ease.
-	BTLeafPage * leftLeaf = root;
-	PageID leftLeafPID = header->GetRootPageID();
-	//first we make a new leaf page
-	PageID newRightLeafPID;
-	BTLeafPage *newRightLeafPage;
-	NEWPAGE(newRightLeafPID, newRightLeafPage);
-	newRightLeafPage->Init(newRightLeafPID);
-	newRightLeafPage->SetType(LEAF_NODE);
-	//now time to start splitting
-	//we move all records from old page to new page
-	RebalanceLeaf(leftLeaf, newRightLeafPage);
-	//now we have somewhat balanced leaf pages. we just need to add an index to the root.
-	//first we get the smallest value in the right leaf
-	KeyType smallestKey;
-	RecordID movedVal, firstRid;
-	Status s = newRightLeafPage->GetFirst(firstRid, smallestKey, movedVal);
-	CHECK(s);
-	//now we make a new root that is an index node not a leaf node
-	PageID newRootPID;
-	BTIndexPage *newRootPage;
-	NEWPAGE(newRootPID, newRootPage);
-	newRootPage->Init(newRootPID);
-	newRootPage->SetType(INDEX_NODE);
-	header->SetRootPageID(newRootPID);
-	//now we set it up as an index
-	newRootPage->SetLeftLink(leftLeafPID);
-	RecordID dontcare;
-	s = newRootPage->Insert(smallestKey, newRightLeafPID, dontcare); 
-	CHECK(s);
-	PageID firstChildPID;
-	KeyType firstKey;
-	s = newRootPage->GetFirst(dontcare, firstKey, firstChildPID);
-	CHECK(s);
-	if(KeyCmp(key,firstKey) <0) {
-		//insert into firstChildpid
-		s = leftLeaf->Insert(key, rid, dontcare);
-		CHECK(s);
-	}else{
-		s = newRightLeafPage->Insert(key,rid,dontcare);
-		CHECK(s);
-	}
-	//now unpin all these pages.
-	UNPIN(newRightLeafPID, true);
-	UNPIN(newRootPID, true);
-	return OK;
+// Purpose : Release the surviving page and free the other one.  The
+//           caller has advanced merges, so a scan that stopped on the
+//           freed page searches again instead of reading it.
+//-------------------------------------------------------------------
+Status BTreeFile::ReleaseMerged(PageID leftID, PageID rightID)
+{
+	Status s = ReleasePage(leftID, LATCH_EXCLUSIVE, DIRTY);
+	Status r = MINIBASE_BM->FreePage(rightID);
+	pageLatches.Unlock(rightID, LATCH_EXCLUSIVE, true);
+	if (r != OK)
+		cerr << "Unable to free page " << rightID << endl;
+	return (s != OK) ? s : r;
+}
+
 
+//-------------------------------------------------------------------
+// BTreeFile::Delete
+//
+// Input   : key - pointer to the value of the key to be deleted.
+//           rid - RecordID of the record to be deleted.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise. 
+// Purpose : Delete an entry with this rid and key, as one update of
+//           the log while it is on.
+//-------------------------------------------------------------------
+Status BTreeFile::Delete (const char *key, const RecordID rid)
+{
+	if (!logMgr.IsLogging())
+		return DeleteKey(key, rid);
+	logMgr.BeginUpdate();
+	Status s = DeleteKey(key, rid);
+	Status c = logMgr.EndUpdate();
+	return (s != OK) ? s : c;
 }
 
 
 //-------------------------------------------------------------------
-// BTreeFile::RebalanceLeaf
+// BTreeFile::DeleteKey
 //
-// Input   : leftPage - pointer to left page
-//           rightPage - empty page to rebalance too
-// Output  : leftPage - rebalanced
-//			 rightPage - rebalanced
-// Return  : OK if successful, FAIL otherwise.
+// Input   : key - pointer to the value of the key to be deleted.
+//           rid - RecordID of the record to be deleted.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise. 
+// Purpose : Delete an entry with this rid and key.  
+// Note    : If the root becomes empty, delete it.
 //-------------------------------------------------------------------
-Status BTreeFile::RebalanceLeaf(BTLeafPage* leftPage, BTLeafPage* rightPage){
+
+Status BTreeFile::DeleteKey (const char *key, const RecordID rid)
+{
+	if (readOnly)
+		return FAIL;
+	if (trace != NULL) {
+		TraceOp op;
+		op.type = TRACE_DELETE;
+		op.hasLow = true;
+		op.hasHigh = false;
+		strncpy(op.lowKey, key, MAX_KEY_SIZE);
+		op.rid = rid;
+		op.limit = 0;
+		trace->Write(op);
+	}
+	// Most deletes leave their leaf at least half full, so first try
+	// with nothing but the leaf latched exclusively.
+	PageID leafID;
+	BTLeafPage *leaf;
+	int depth;
+	Status s = SearchLeaf(key, LATCH_EXCLUSIVE, leafID, leaf, depth);
+	if (s != OK)
+		return FAIL;
+	if (depth == 0 || IsSafe(leaf, key, false)) {
+		s = leaf->Delete(key, rid);
+		Status r = ReleasePage(leafID, LATCH_EXCLUSIVE, s == OK);
+		return (s != OK) ? s : r;
+	}
+	s = ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+	CHECK(s);
+
+	// The leaf may underflow.  Go down again, this time holding on to
+	// every page a merge could reach.
+	TreePath path;
+	s = Descend(key, path, leafID, leaf);
+	if (s != OK)
+		return FAIL;
+
+	s = leaf->Delete(key, rid);
+	if (s != OK || path.depth == 0 || !IsUnderflow(leaf)) {
+		Status r = ReleasePage(leafID, LATCH_EXCLUSIVE, s == OK);
+		Status r2 = ReleasePath(path, path.depth);
+		return (s != OK) ? s : (r != OK) ? r : r2;
+	}
+
+	// The leaf is less than half full.  Fix it through its parent, and
+	// keep going up while merges leave the parent underfull too.  An
+	// underfull page was unsafe on the way down, so its parent is still
+	// latched.
+	PageID childID = leafID;
+	SortedPage *child = leaf;
+	int level = path.depth - 1;
 	while (true) {
-		KeyType movedKey;
-		RecordID movedVal, firstRid, insertedRid;
-		Status s = leftPage->GetFirst(firstRid, movedKey, movedVal);
-		if (s == DONE) break;
-		s = rightPage->Insert(movedKey, movedVal, insertedRid);
-		CHECK(s);
-		s= leftPage->DeleteRecord(firstRid);
-		CHECK(s);
+		s = FixUnderflow(path.level[level], childID, child);
+		if (s != OK || level == path.top || !IsUnderflow(path.level[level].page))
+			break;
+		childID = path.level[level].pid;
+		child = path.level[level].page;
+		path.level[level].page = NULL;
+		level--;
 	}
-	while(leftPage->AvailableSpace() > rightPage->AvailableSpace()){
-		KeyType movedKey;
-		RecordID movedVal, firstRid, insertedRid;
-		Status s = rightPage->GetFirst(firstRid, movedKey, movedVal);
-		CHECK(s);
-		s= leftPage->Insert(movedKey, movedVal, insertedRid);
-		CHECK(s);
-		s =rightPage->DeleteRecord(firstRid);
-		CHECK(s);
+
+	// A root index left without entries has a single child, which
+	// becomes the new root.  Descend may have moved right of the root
+	// at the top level, and a root with a right sibling isn't alone.
+	if (s == OK && level == 0 && path.headerLatched
+		&& path.level[0].page->GetNumOfRecords() == 0
+		&& !path.level[0].page->HasHighKey()
+		&& header->GetRootPageID() == path.level[0].pid) {
+		PageID rootID = path.level[0].pid;
+		UncachePage(rootID);
+		merges.Advance();
+		header->SetRootPageID(((BTIndexPage *)path.level[0].page)->GetLeftLink());
+		MINIBASE_BM->DirtyPage(headerID);
+		path.rootChanged = true;
+		path.level[0].page = NULL;
+		s = MINIBASE_BM->FreePage(rootID);
+		pageLatches.Unlock(rootID, LATCH_EXCLUSIVE, true);
+	}
+	Status r = ReleasePath(path, path.depth);
+	return (s != OK) ? s : r;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::Reorganize
+//
+// Input   : steps - leaves to look at in this call.
+// Output  : None
+// Return  : OK if the pass over the leaves isn't over yet, DONE if it
+//           came to the last leaf, FAIL otherwise.
+// Purpose : Defragment the leaves a few at a time, while other threads
+//           go on using the index.  Each step takes the leaf after the
+//           last one done, merges it with its right sibling if either
+//           is underfull and both fit in one page, and otherwise puts
+//           it in the page after the leaf done before it, so that a
+//           scan reads the leaves in the order they lie in the file.
+//           Leaves already in order stay where they are.
+//           The next call goes on where this one stopped; after DONE,
+//           the next starts a new pass.
+//-------------------------------------------------------------------
+Status BTreeFile::Reorganize(int steps)
+{
+	if (readOnly || headerID == INVALID_PAGE)
+		return FAIL;
+	MutexGuard guard(reorgMutex);
+	bool logging = logMgr.IsLogging();
+	for (int i = 0; i < steps; i++) {
+		if (logging)
+			logMgr.BeginUpdate();
+		Status s = ReorganizeLeaf();
+		if (logging && logMgr.EndUpdate() != OK)
+			s = FAIL;
+		if (s != OK) {
+			Status r = EndReorganize();
+			return (s != DONE) ? s : (r != OK) ? r : DONE;
+		}
 	}
-	rightPage->SetNextPage(leftPage->GetNextPage());
-	leftPage->SetNextPage(rightPage->PageNo());
-	rightPage->SetPrevPage(leftPage->PageNo());
 	return OK;
 }
 
 
 //-------------------------------------------------------------------
-// BTreeFile::Insert
+// BTreeFile::ReorganizeLeaf
 //
-// Input   : key - pointer to the value of the key to be inserted.
-//           rid - RecordID of the record to be inserted.
+// Input   : None
 // Output  : None
-// Return  : OK if successful, FAIL otherwise.
-// Purpose : Insert an index entry with this rid and key.  
-// Note    : If the root didn't exist, create it.
+// Return  : OK if there are leaves left, DONE after the last one,
+//           FAIL otherwise.
+// Purpose : One step of Reorganize, on the leaf reorgKey belongs to.
+//           The parent is latched before the leaf, as by a delete.
+//           Moving a leaf is like merging it into a new page: merges
+//           is advanced first, the parent and both neighbours are made
+//           to point at the copy, and then the leaf is freed.  The left
+//           neighbour is only tried.  Whatever gets in the way - a
+//           merge since the walk, a split not posted yet, a neighbour
+//           latched by another thread - leaves the step to be tried
+//           again.
 //-------------------------------------------------------------------
-Status BTreeFile::Insert (const char *key, const RecordID rid)
+Status BTreeFile::ReorganizeLeaf()
 {
-	// there are several cases to consider here. 
-	//first case is that this is the first insert
-	if(header->GetRootPageID() == INVALID_PAGE){
-		BTLeafPage *page;
-		PageID pid;
-		NEWPAGE(pid, page);
-		page->Init(pid);
-		page->SetType(LEAF_NODE);
-		header->SetRootPageID(pid);
-		RecordID drid;
-		page->Insert(key, rid, drid);
-		UNPIN(pid, true);
+	PageID leafID;
+	BTLeafPage *leaf;
+	int depth;
+	WalkPath walk;
+	Status s = SearchLeaf(reorgKey, LATCH_SHARED, leafID, leaf, depth, &walk);
+	if (s != OK)
+		return s;
+	s = ReleasePage(leafID, LATCH_SHARED, CLEAN);
+	CHECK(s);
+	// A root leaf is alone in its file already.
+	if (depth == 0)
+		return DONE;
+
+	PathEntry parent;
+	parent.pid = walk.level[depth - 1];
+	parent.dirty = false;
+	pageLatches.Lock(parent.pid, LATCH_EXCLUSIVE);
+	if (merges.Read() != walk.merges) {
+		pageLatches.Unlock(parent.pid, LATCH_EXCLUSIVE);
 		return OK;
 	}
-	//otherwise we get the root. we don't know its type yet.
-	SortedPage * oldRoot;
-	PIN(header->GetRootPageID(), (Page *&) oldRoot);
-	if(oldRoot->GetType() == LEAF_NODE){
-		Status s = InsertRootIsLeaf(key, rid, (BTLeafPage *&)oldRoot);
-		UNPIN(oldRoot->PageNo(), true);
-		return s;
-	}else if (oldRoot->GetType()==INDEX_NODE){
-		//root is index. so we must traverse index.
-		//figure out where to insert
-		Status s = InsertRootIsIndex(key, rid, (BTIndexPage*)oldRoot);
-		UNPIN(oldRoot->PageNo(), true);
-		return s;
+	if (PinLatched(parent.pid, parent.page) != OK) {
+		pageLatches.Unlock(parent.pid, LATCH_EXCLUSIVE);
+		return FAIL;
 	}
-	cout << "root is not index or leaf?" << endl;
-	return FAIL;
-}
-//note it is always responsibility of calling function to pin and unpin
-Status BTreeFile::InsertRootIsIndex(const char * key, const RecordID rid, BTIndexPage * root){
-	RecordID currRid;
-	PageID prevPointerToChild;
-	KeyType currKey;
-	Status s = root->GetFirst(currRid, currKey, prevPointerToChild);
+	s = MoveRight(reorgKey, LATCH_EXCLUSIVE, parent.pid, parent.page);
 	CHECK(s);
-	SortedPage * childPage;
-	if(KeyCmp(key, currKey) <0){
-		prevPointerToChild= root->GetLeftLink();
-		PIN(prevPointerToChild, childPage);
-	}else{
-		PageID nextPointerToChild;
-		while(root->GetNext(currRid, currKey, nextPointerToChild)!=DONE){
-			if(KeyCmp(key, currKey) <0) break;
-			prevPointerToChild = nextPointerToChild;
-		}
-		PIN(prevPointerToChild, childPage);
-
-	}
-	IndexEntry *newEntry = new IndexEntry;
-	newEntry->value=INVALID_PAGE;
-	if(childPage->GetType() ==INDEX_NODE){
-		s = InsertIntoIndex(key, rid, ((BTIndexPage *)childPage), newEntry); 
-	}else if(childPage->GetType()==LEAF_NODE){
-		s = InsertIntoLeaf(key, rid, ((BTLeafPage *)childPage), newEntry);
-	}else {
-		cout << "page of invalid type in InsertIntoIndex" << endl;
-	}
-	UNPIN(prevPointerToChild, true);
-	CHECK(s);
-	if(newEntry->value != INVALID_PAGE){
-		RecordID dontcare;
-		if(root->AvailableSpace() >= GetKeyDataLength(newEntry->key, INDEX_NODE)){
-			s = root->Insert(newEntry->key, newEntry->value, dontcare);
-			delete newEntry;
+	BTIndexPage *parentPage = (BTIndexPage *)parent.page;
+	parentPage->GetPageID(reorgKey, leafID, parent.slot);
+	if (LatchPage(leafID, LATCH_EXCLUSIVE, (SortedPage *&)leaf) != OK) {
+		ReleasePage(parent.pid, LATCH_EXCLUSIVE, CLEAN);
+		return FAIL;
+	}
+	if (leaf->PastHighKey(reorgKey)) {
+		s = ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+		Status r = ReleasePage(parent.pid, LATCH_EXCLUSIVE, CLEAN);
+		return (s != OK) ? s : r;
+	}
+
+	// Compact: the leaf stays where it is, to be looked at again.
+	PageID nextID = leaf->GetNextPage();
+	if (nextID != INVALID_PAGE && parent.slot + 1 < parentPage->GetNumOfRecords()
+		&& parentPage->GetChild(parent.slot + 1) == nextID) {
+		BTLeafPage *next;
+		if (LatchPage(nextID, LATCH_EXCLUSIVE, (SortedPage *&)next) != OK) {
+			ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+			ReleasePage(parent.pid, LATCH_EXCLUSIVE, CLEAN);
+			return FAIL;
+		}
+		if ((IsUnderflow(leaf) || IsUnderflow(next))
+			&& next->UsedSpace() + next->HighKeySpace()
+			   <= leaf->AvailableSpace() + leaf->HighKeySpace()) {
+			s = MergeLeaves(parent, parent.slot + 1, leafID, leaf, nextID, next, INVALID_PAGE);
+			Status r = ReleasePage(parent.pid, LATCH_EXCLUSIVE, parent.dirty);
+			return (s != OK) ? s : r;
+		}
+		s = ReleasePage(nextID, LATCH_EXCLUSIVE, CLEAN);
+		CHECK(s);
+	}
+
+	KeyType nextKey;
+	bool last = !leaf->HasHighKey();
+	if (!last)
+		memcpy(nextKey, leaf->HighKey(), strlen(leaf->HighKey()) + 1);
+
+	// Relocate, unless the leaf follows the last one done already.  The
+	// first leaf stays if the next one follows it.
+	PageID placeID = leafID;
+	bool inOrder = (reorgPrev == INVALID_PAGE) ? leaf->GetNextPage() == leafID + 1
+											   : leafID == reorgPrev + 1;
+	if (!inOrder) {
+		s = MoveLeaf(parent, leafID, leaf, placeID);
+		if (s != OK) {
+			ReleasePage(parent.pid, LATCH_EXCLUSIVE, parent.dirty);
 			return s;
 		}
-		//time to create new root
-		PageID newRootPID;
-		BTIndexPage *newRootPage;
-		NEWPAGE(newRootPID, newRootPage);
-		newRootPage->Init(newRootPID);
-		newRootPage->SetType(INDEX_NODE);
-		header->SetRootPageID(newRootPID);
-		newRootPage->SetPrevPage(root->PageNo());
-		PageID newRightIndexPID;
-		BTIndexPage *newRightIndexPage;
-		NEWPAGE(newRightIndexPID, newRightIndexPage);
-		newRightIndexPage->Init(newRightIndexPID);
-		newRightIndexPage->SetType(INDEX_NODE);
-		IndexEntry *newKey = new IndexEntry;
-		newKey->value=INVALID_PAGE;
-		RebalanceIndex(root, newRightIndexPage, newKey);
-		s = newRootPage->Insert(newKey->key, newKey->value, dontcare);
-		UNPIN(newRightIndexPID, true);
-		UNPIN(newRootPID, true);
-		delete newKey;
-	}
-	delete newEntry;
-	return s;
+		// Not moved: the step is tried again.
+		if (placeID == INVALID_PAGE)
+			return ReleasePage(parent.pid, LATCH_EXCLUSIVE, CLEAN);
+	} else {
+		s = ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+		if (s != OK) {
+			ReleasePage(parent.pid, LATCH_EXCLUSIVE, CLEAN);
+			return s;
+		}
+	}
+	s = ReleasePage(parent.pid, LATCH_EXCLUSIVE, parent.dirty);
+	CHECK(s);
+	reorgPrev = placeID;
+	if (last)
+		return DONE;
+	memcpy(reorgKey, nextKey, strlen(nextKey) + 1);
+	return OK;
 }
 
 
-
 //-------------------------------------------------------------------
-// BTreeFile::Delete
+// BTreeFile::MoveLeaf
 //
-// Input   : key - pointer to the value of the key to be deleted.
-//           rid - RecordID of the record to be deleted.
-// Output  : None
-// Return  : OK if successful, FAIL otherwise. 
-// Purpose : Delete an entry with this rid and key.  
-// Note    : If the root becomes empty, delete it.
+// Input   : parent - path entry of the parent, latched exclusively,
+//                    with the slot of leafID.
+//           leafID, leaf - the leaf, latched exclusively.
+// Output  : placeID - the page the leaf was copied to, or INVALID_PAGE
+//                     if another thread holds its left neighbour.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Copy the leaf to the next page of the run Reorganize keeps,
+//           taking BT_REORG_RUN new pages next to each other from the
+//           leaves' extents when it runs out, and free the leaf.  The
+//           leaf is released either way.
 //-------------------------------------------------------------------
-
-Status BTreeFile::Delete (const char *key, const RecordID rid)
+Status BTreeFile::MoveLeaf(PathEntry &parent, PageID leafID, BTLeafPage *leaf, PageID &placeID)
 {
-	if(header->GetRootPageID() == INVALID_PAGE) return FAIL;
-	SortedPage * root;
-	PIN(header->GetRootPageID(), (Page *&)root);
-	if(root->GetType() == LEAF_NODE){
-		Status  r = ((BTLeafPage *)root)->Delete(key, rid);
-		UNPIN(header->GetRootPageID(), true);
-		return r;
-	}else{
-		Status s= DeleteIsIndex(key, rid, (BTIndexPage *)root);
-		UNPIN(header->GetRootPageID(),true);
-		return s;
+	placeID = INVALID_PAGE;
+	if (reorgLeft == 0) {
+		Page *first;
+		if (MINIBASE_BM->NewPage(reorgRun, first, BT_REORG_RUN, INVALID_PAGE, 2 * headerID) != OK) {
+			cerr << "Unable to allocate " << BT_REORG_RUN << " new pages" << endl;
+			ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+			return FAIL;
+		}
+		reorgLeft = BT_REORG_RUN;
+		MINIBASE_BM->UnpinPage(reorgRun, CLEAN);
+	}
+
+	// Nobody else knows of the new page, so its latch can be taken at
+	// any point; taking it first makes backing out simple.
+	SortedPage *place;
+	pageLatches.Lock(reorgRun, LATCH_EXCLUSIVE);
+	if (MINIBASE_BM->PinPage(reorgRun, (Page *&)place, true) != OK) {
+		cerr << "Unable to pin page " << reorgRun << endl;
+		pageLatches.Unlock(reorgRun, LATCH_EXCLUSIVE);
+		ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+		return FAIL;
+	}
+	PageID prevID = leaf->GetPrevPage();
+	SortedPage *prev = NULL;
+	if (prevID != INVALID_PAGE && !pageLatches.TryLockExclusive(prevID)) {
+		ReleasePage(reorgRun, LATCH_EXCLUSIVE, CLEAN);
+		return ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+	}
+	Status s = OK;
+	if (prevID != INVALID_PAGE && PinLatched(prevID, prev) != OK) {
+		pageLatches.Unlock(prevID, LATCH_EXCLUSIVE);
+		s = FAIL;
+	}
+	PageID nextID = leaf->GetNextPage();
+	SortedPage *next = NULL;
+	if (s == OK && nextID != INVALID_PAGE && LatchPage(nextID, LATCH_EXCLUSIVE, next) != OK) {
+		if (prev != NULL)
+			ReleasePage(prevID, LATCH_EXCLUSIVE, CLEAN);
+		s = FAIL;
+	}
+	if (s != OK) {
+		ReleasePage(reorgRun, LATCH_EXCLUSIVE, CLEAN);
+		ReleasePage(leafID, LATCH_EXCLUSIVE, CLEAN);
+		return FAIL;
 	}
-}
 
-Status BTreeFile::DeleteIsIndex(const char * key, const RecordID rid, BTIndexPage * index){
-	RecordID currRid;
-	PageID prevPointerToChild;
-	KeyType currKey;
-	Status s = index->GetFirst(currRid, currKey, prevPointerToChild);
+	merges.Advance();
+	memcpy((char *)place, (char *)leaf, sizeof(Page));
+	place->SetPageNo(reorgRun);
+	((BTIndexPage *)parent.page)->SetChild(parent.slot, reorgRun);
+	parent.dirty = true;
+	if (prev != NULL)
+		prev->SetNextPage(reorgRun);
+	if (next != NULL)
+		next->SetPrevPage(reorgRun);
+	PageID group[4] = { reorgRun, parent.pid };
+	int grouped = 2;
+	if (prev != NULL)
+		group[grouped++] = prevID;
+	if (next != NULL)
+		group[grouped++] = nextID;
+	s = MINIBASE_BM->LogPages(group, grouped);
+	if (prev != NULL) {
+		Status r = ReleasePage(prevID, LATCH_EXCLUSIVE, DIRTY);
+		if (s == OK)
+			s = r;
+	}
+	if (next != NULL) {
+		Status r = ReleasePage(nextID, LATCH_EXCLUSIVE, DIRTY);
+		if (s == OK)
+			s = r;
+	}
 	CHECK(s);
-	SortedPage * childPage;
-	if(KeyCmp(key, currKey) <0){
-		prevPointerToChild= index->GetLeftLink();
-		PIN(prevPointerToChild, childPage);
-	}else{
-		PageID nextPointerToChild;
-		while(index->GetNext(currRid, currKey, nextPointerToChild)!=DONE){
-			if(KeyCmp(key, currKey) <0) break;
-			prevPointerToChild = nextPointerToChild;
+	placeID = reorgRun++;
+	reorgLeft--;
+	return ReleaseMerged(placeID, leafID);
+}
+
+
+//-------------------------------------------------------------------
+// BTreeFile::EndReorganize
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Free the pages Reorganize kept and didn't use, and start
+//           the next pass from the first leaf.  Each is pinned first,
+//           which waits for a read ahead that may have taken it in.
+//-------------------------------------------------------------------
+Status BTreeFile::EndReorganize()
+{
+	Status s = OK;
+	for (; reorgLeft > 0; reorgLeft--, reorgRun++) {
+		Page *page;
+		if (MINIBASE_BM->PinPage(reorgRun, page, true) != OK
+			|| MINIBASE_BM->FreePage(reorgRun) != OK) {
+			cerr << "Unable to free page " << reorgRun << endl;
+			s = FAIL;
 		}
-		PIN(prevPointerToChild, childPage);
 	}
-	Status r;
-	if(childPage->GetType()==LEAF_NODE){
-		r= ((BTLeafPage*)childPage)->Delete(key, rid);
-	}else{
-		r = DeleteIsIndex(key, rid, (BTIndexPage*)childPage);
-	}
-	UNPIN(childPage->PageNo(), true);
-	return r;
+	reorgKey[0] = '\0';
+	reorgPrev = INVALID_PAGE;
+	return s;
 }
 
+
 //-------------------------------------------------------------------
 // BTreeFile::OpenScan
 //
@@ -596,46 +2227,20 @@ Status BTreeFile::DeleteIsIndex(const char * key, const RecordID rid, BTIndexPag
 
 IndexFileScan *BTreeFile::OpenScan (const char *lowKey, const char *highKey)
 {	
-	char* searchTerm = (lowKey == NULL) ? "" : lowKey; //assume "" is lowest string
-	PageID firstGuy;
-	BTLeafPage* lowPage;
-	if (header->GetRootPageID() == INVALID_PAGE || Search(searchTerm, firstGuy) != OK){
-		firstGuy = INVALID_PAGE;
-		lowPage = NULL;
-	}
-	else {
-		MINIBASE_BM->PinPage(firstGuy, (Page*&)lowPage);
-	}
-	//If There is a page where this exists, find the recordid it exists at
-	RecordID dataRid;
-	RecordID rid;
-	char firstKey[MAX_KEY_SIZE];
-	rid.pageNo = INVALID_PAGE;
-	bool overTop = false;
-	if (lowPage != NULL) {
-		if(lowPage->_Search(rid, searchTerm, dataRid, firstKey) !=OK){
-			PageID nextPage = lowPage->GetNextPage();
-			MINIBASE_BM->UnpinPage(firstGuy, false);
-			while(nextPage != INVALID_PAGE){
-				MINIBASE_BM->PinPage(nextPage, (Page *&)lowPage);
-				if(lowPage->_Search(rid, searchTerm, dataRid, firstKey)==OK && KeyCmp(firstKey, highKey) <= 0){
-					break;
-				}
-				nextPage = lowPage->GetNextPage();
-				MINIBASE_BM->UnpinPage(lowPage->PageNo(), false);
-			}
-			if(nextPage == INVALID_PAGE) {
-				overTop = true;
-				lowPage = NULL;
-			}
-		}
+	// The scan finds its first leaf on the first GetNext, and every
+	// time it comes back to a leaf that changed in between.
+	BTreeFileScan* tbr = new BTreeFileScan(this, lowKey, highKey);
+	if (trace != NULL) {
+		//the scan is written when it is closed, once we know how far it read
+		tbr->trace = trace;
+		tbr->traceOp = new TraceOp;
+		tbr->traceOp->type = TRACE_SCAN;
+		tbr->traceOp->hasLow = (lowKey != NULL);
+		tbr->traceOp->hasHigh = (highKey != NULL);
+		if (lowKey != NULL) strncpy(tbr->traceOp->lowKey, lowKey, MAX_KEY_SIZE);
+		if (highKey != NULL) strncpy(tbr->traceOp->highKey, highKey, MAX_KEY_SIZE);
+		tbr->traceOp->limit = 0;
 	}
-	if(!overTop && (highKey != NULL && KeyCmp(firstKey,highKey)>0)) {
-			MINIBASE_BM->UnpinPage(firstGuy, false);
-			firstGuy = INVALID_PAGE;
-			lowPage = NULL;
-	}
-	IndexFileScan* tbr = new BTreeFileScan(lowPage, rid, dataRid, firstKey, highKey, (highKey != NULL));
 
 	return tbr;
 }
@@ -685,6 +2290,8 @@ Status BTreeFile::DumpStatistics() {
 	return FAIL;
 }
 
+// Leaves are unpinned hated, so that a dump doesn't push the index
+// pages other operations use out of the buffer pool.
 Status BTreeFile::_DumpStatistics(PageID pageID) { 
 	__DumpStatistics(pageID);
 
@@ -718,7 +2325,7 @@ Status BTreeFile::_DumpStatistics(PageID pageID) {
 		break;
 
 	case LEAF_NODE:
-		UNPIN(pageID, CLEAN);
+		UNPIN_HATED(pageID, CLEAN);
 		break;
 	default:		
 		assert (0);
@@ -793,7 +2400,7 @@ Status BTreeFile::__DumpStatistics (PageID pageID) {
 		if ( minDataFillFactor > curFillFactor)
 			minDataFillFactor = curFillFactor;
 		totalFillData += curFillFactor;
-		UNPIN(pageID, CLEAN);
+		UNPIN_HATED(pageID, CLEAN);
 		break;
 	default:		
 		assert (0);
@@ -802,66 +2409,6 @@ Status BTreeFile::__DumpStatistics (PageID pageID) {
 	return OK;	
 }
 
-// function  BTreeFile::_SearchIndex
-// PURPOSE	: given a IndexNode and key, find the PageID with the key in it
-// INPUT	: key, a pointer to key;
-//			: currIndexID, 
-//			: curIndex, pointer to current BTIndexPage
-// OUTPUT	: found PageID
-Status BTreeFile::_SearchIndex (const char *key,  PageID currIndexID, BTIndexPage *currIndex, PageID& foundID)
-{
-	PageID nextPageID;
-
-	Status s = currIndex->GetPageID (key, nextPageID);
-	if (s != OK)
-		return FAIL;
-
-	// Now unpin the page, recurse and then pin it again
-
-	UNPIN (currIndexID, CLEAN);
-	s = _Search (key, nextPageID, foundID);
-	if (s != OK)
-		return FAIL;
-	return OK;
-}
-
-// Function: 
-// Input	: key, rid
-// Output	: found Pid, where Key >= key
-// Purpose	: find the leftmost leaf page contain the key, or bigger than the key
-Status BTreeFile::_Search( const char *key,  PageID currID, PageID& foundID)
-{
-
-	SortedPage *page;
-	Status s;
-
-	PIN (currID, page);
-	NodeType type = page->GetType ();
-
-	// TWO CASES:
-	// - pageType == INDEX:
-	//   search the index
-	// - pageType == LEAF_NODE:
-	//   set the output page ID
-
-	switch (type) 
-	{
-	case INDEX_NODE:
-		s =	_SearchIndex(key,  currID, (BTIndexPage*)page, foundID);
-		break;
-
-	case LEAF_NODE:
-		foundID =  page->PageNo();
-		UNPIN(currID,CLEAN);
-		break;
-	default:		
-		assert (0);
-	}
-
-
-	return OK;
-}
-
 // BTreeeFile:: Search
 // PURPOSE	: find the PageNo of a give key
 // INPUT	: key, pointer to a key
@@ -869,23 +2416,22 @@ Status BTreeFile::_Search( const char *key,  PageID currID, PageID& foundID)
 
 Status BTreeFile:: Search(const char *key,  PageID& foundPid)
 {
-	if (header->GetRootPageID() == INVALID_PAGE)
+	BTLeafPage *leaf;
+	int depth;
+
+	Status s = SearchLeaf(key, LATCH_SHARED, foundPid, leaf, depth);
+	if (s == DONE)
 	{
 		foundPid = INVALID_PAGE;
 		return DONE;
-
 	}
-
-	Status s;
-
-	s = _Search(key,  header->GetRootPageID(), foundPid);
 	if (s != OK)
 	{
 		cerr << "Search FAIL in BTreeFile::Search\n";
 		return FAIL;
 	}
 
-	return OK;
+	return ReleasePage(foundPid, LATCH_SHARED, CLEAN);
 }
 
 Status BTreeFile::_PrintTree ( PageID pageID)
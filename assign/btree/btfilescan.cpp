@@ -4,8 +4,43 @@
 #include "new_error.h"
 #include "btfile.h"
 #include "btfilescan.h"
+#include "workload.h"
 #include <cstring>
 
+//	Most programs have only a few scans open at a time, so a short free
+//	list is enough to make OpenScan allocation free in steady state.
+const int SCAN_POOL_SIZE = 64;
+
+static void *scanFreeList = NULL;	// linked through the first word of each free scan
+static int scanNumFree = 0;
+static Mutex scanPoolMutex;
+
+void *BTreeFileScan::operator new(size_t size)
+{
+	MutexGuard guard(scanPoolMutex);
+	if (scanFreeList != NULL && size == sizeof(BTreeFileScan)) {
+		void *p = scanFreeList;
+		scanFreeList = *(void **)p;
+		scanNumFree--;
+		return p;
+	}
+	return ::operator new(size);
+}
+
+void BTreeFileScan::operator delete(void *p)
+{
+	if (p == NULL)
+		return;
+	MutexGuard guard(scanPoolMutex);
+	if (scanNumFree < SCAN_POOL_SIZE) {
+		*(void **)p = scanFreeList;
+		scanFreeList = p;
+		scanNumFree++;
+		return;
+	}
+	::operator delete(p);
+}
+
 //-------------------------------------------------------------------
 // BTreeFileScan::~BTreeFileScan
 //
@@ -16,8 +51,10 @@
 
 BTreeFileScan::~BTreeFileScan ()
 {
-	//TODO: add your code here
-	if(leaf != NULL) MINIBASE_BM -> UnpinPage(leaf->PageNo(), false);
+	if(traceOp != NULL) {
+		trace->Write(*traceOp);
+		delete traceOp;
+	}
 }
 
 
@@ -29,46 +66,127 @@ BTreeFileScan::~BTreeFileScan ()
 //           keyPtr - and a pointer to it's key value.
 // Purpose : Return the next record from the B+-tree index.
 // Return  : OK if successful, DONE if no more records to read.
+// Note    : Entries inserted or deleted while the scan is open may or
+//           may not be returned.  Duplicates of the last key returned
+//           are told apart by record id when the scan has to search
+//           again.
 //-------------------------------------------------------------------
 Status BTreeFileScan::GetNext (RecordID & rid, char* keyPtr)
 {	
-	if (leaf == NULL || current_entry.pageNo == INVALID_PAGE || curKey == NULL) return DONE; //there was never anything to scan
-	rid = current_data;
-	memcpy(keyPtr, curKey, strlen(curKey) + 1);
-	//Get the next recordid on this page
-	if((*leaf).GetNext(current_entry, curKey, current_data) == OK) {
-		//We've reached a key that is above our range, unpin the current page and return DONE
-		if (upperBounded && strcmp(curKey, hi) > 0) {
-			UNPIN(leaf->PageNo(), false);
-			leaf = NULL; //make sure we return done next time
-			return OK;
+	if (done) return DONE;
+
+	BTLeafPage *leaf;
+	bool resuming = false;
+
+	// Carry on from the last entry if its leaf hasn't changed since,
+	// or from the leaf, moving right past any splits, if nothing has
+	// been merged.
+	if (leafID != INVALID_PAGE) {
+		pageLatches.Lock(leafID, LATCH_SHARED);
+		bool changed = (pageLatches.Version(leafID) != version);
+		if (changed && btf->merges.Read() != merges) {
+			pageLatches.Unlock(leafID, LATCH_SHARED);
+			leafID = INVALID_PAGE;
+		} else if (btf->PinLatched(leafID, (SortedPage *&)leaf) != OK) {
+			pageLatches.Unlock(leafID, LATCH_SHARED);
+			return FAIL;
+		} else if (changed) {
+			if (btf->MoveRight(lastKey, LATCH_SHARED, leafID, (SortedPage *&)leaf) != OK) {
+				leafID = INVALID_PAGE;
+				return FAIL;
+			}
+			slot = 0;
+			resuming = true;
 		}
-		return OK;
 	}
-	while (true){
-		//Need to look in next page
-		PageID newLeafPid = (*leaf).GetNextPage();
-		UNPIN(leaf->PageNo(), false);
-		if(newLeafPid == INVALID_PAGE) {
-			leaf = NULL; //make sure we return done next time
-			return OK;
+	if (leafID == INVALID_PAGE) {
+		int depth;
+		Status s = btf->SearchLeaf(lastKey, LATCH_SHARED, leafID, leaf, depth);
+		if (s == DONE) {
+			done = true;
+			return DONE;
 		}
-		//next page is valid
-		PIN(newLeafPid, (Page*&)leaf);
-		if ((*leaf).GetFirst(current_entry, curKey, current_data) == OK) {
-			//We've reached a key that is above our range, unpin the current page and return DONE
-			if (upperBounded && strcmp(curKey, hi) > 0) {
-				UNPIN(leaf->PageNo(), false);
-				leaf = NULL; //make sure we return done next time
-				return OK;
+		if (s != OK)
+			return FAIL;
+		slot = 0;
+		resuming = true;
+	}
+
+	KeyType key;
+	RecordID dataRid;
+	int skipped = 0;
+	while (true) {
+		if (slot >= leaf->GetNumOfRecords()) {
+			//Need to look in next page, latched before this one is let go
+			PageID nextID = leaf->GetNextPage();
+			if (nextID == INVALID_PAGE)
+				break;
+			SortedPage *next;
+			if (btf->LatchPage(nextID, LATCH_SHARED, next) != OK) {
+				btf->ReleasePage(leafID, LATCH_SHARED, CLEAN);
+				leafID = INVALID_PAGE;
+				return FAIL;
 			}
-		
-			return OK;
+			// A leaf passed over completely won't be needed again by
+			// this scan; the one it ends on may be, by a lookup.
+			btf->ReleasePage(leafID, LATCH_SHARED, CLEAN, true);
+			leafID = nextID;
+			leaf = (BTLeafPage *)next;
+
+			// Have the leaf after this one read while this one is
+			// scanned, unless the range ends here.  Where the chain
+			// runs on in file order, the leaves after it are likely
+			// next in the file too, and are read with it in one go.
+			PageID aheadID = leaf->GetNextPage();
+			if (aheadID != INVALID_PAGE
+				&& !(upperBounded && leaf->HasHighKey() && KeyCmp(hi, leaf->HighKey()) < 0))
+				MINIBASE_BM->Prefetch(aheadID, (aheadID == leafID + 1) ? BUF_READAHEAD : 1);
+			slot = 0;
+			continue;
 		}
+
+		RecordID cur;
+		cur.pageNo = leafID;
+		cur.slotNo = slot;
+		leaf->GetCurrent(cur, key, dataRid);
+
+		// After a new search, skip what was already returned: keys below
+		// the last one, and duplicates of it up to the last record id.
+		if (resuming) {
+			int c = KeyCmp(key, lastKey);
+			if (c < 0 || (c == 0 && started && skipped < lastKeyCount)) {
+				if (c == 0)
+					skipped = (dataRid == lastRid) ? lastKeyCount : skipped + 1;
+				slot++;
+				continue;
+			}
+			resuming = false;
+		}
+
+		//We've reached a key that is above our range
+		if (upperBounded && KeyCmp(key, hi) > 0)
+			break;
+
+		if (started && KeyCmp(key, lastKey) == 0)
+			lastKeyCount++;
+		else
+			lastKeyCount = 1;
+		memcpy(lastKey, key, strlen(key) + 1);
+		lastRid = dataRid;
+		started = true;
+		slot++;
+		version = pageLatches.Version(leafID);
+		merges = btf->merges.Read();
+		btf->ReleasePage(leafID, LATCH_SHARED, CLEAN);
+
+		if (traceOp != NULL) traceOp->limit++;
+		rid = dataRid;
+		memcpy(keyPtr, key, strlen(key) + 1);
+		return OK;
 	}
-	//empty page
 
-	UNPIN(leaf->PageNo(), false);
-	leaf = NULL; //make sure we return done next time
-    return OK;
+	btf->ReleasePage(leafID, LATCH_SHARED, CLEAN);
+	leafID = INVALID_PAGE;
+	done = true;
+	return DONE;
 }
@@ -82,32 +82,126 @@ Status BTIndexPage::Delete (const char *key, RecordID& rid)
 
 Status BTIndexPage::GetPageID (const char *key, PageID& pid)
 {
-	KeyDataEntry *currKey;
-	int len;
-	
-	// A sequential search is implemented here.  You can modify it
-	// to a binary search if you like.
-	
-	for (int i = numOfSlots - 1; i >= 0; i--)
+	int slot;
+	return GetPageID(key, pid, slot);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetPageID
+//
+// Input   : key  - pointer to the key value to be searched.
+// Output  : pid - page id of the child to follow.
+//           slot - slot of the entry pointing to that child, -1 if
+//                  it is the left link.
+// Purpose : Binary search for the last entry whose key is <= key.
+//           The slot lets a caller find the child's siblings and
+//           separators again without another search.
+// Return  : Always OK.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::GetPageID (const char *key, PageID& pid, int& slot)
+{
+	int lo = 0, hi = GetNumOfRecords();
+
+	// Invariant: entries below lo are <= key, entries at hi and above
+	// are > key.
+	while (lo < hi)
 	{
-		currKey = (KeyDataEntry *)(data + slots[i].offset);
-		
-		if (KeyCmp(key, currKey->key) >= 0)
-		{
-			len = slots[i].length;
-			GetKeyData(NULL, (DataType *)&pid, currKey, len, INDEX_NODE);
-			return OK;
-		}
+		int mid = (lo + hi) / 2;
+		if (KeyCmp(key, data + slots[mid].offset) >= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	
-	// If we reach this point, then the page we should follow in our 
-	// B+tree search must be the leftmost child of this page.
-	
-	pid = GetLeftLink();
+
+	slot = lo - 1;
+	pid = GetChild(slot);
 	return OK;
 }
 
 
+//-------------------------------------------------------------------
+// BTIndexPage::GetChild
+//
+// Input   : slot - slot of an entry, or -1 for the left link.
+// Output  : None
+// Return  : The page id stored in that entry.
+//-------------------------------------------------------------------
+
+PageID BTIndexPage::GetChild (int slot)
+{
+	PageID pid;
+
+	if (slot < 0)
+		return GetLeftLink();
+
+	GetKeyData(NULL, (DataType *)&pid,
+		(KeyDataEntry *)(data + slots[slot].offset),
+		slots[slot].length, INDEX_NODE);
+	return pid;
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::SetChild
+//
+// Input   : slot - slot of an entry, or -1 for the left link.
+//           pageNo - the page id to store in it.
+// Output  : None
+// Return  : None
+// Purpose : Point an entry at another page, keeping its key.
+//-------------------------------------------------------------------
+
+void BTIndexPage::SetChild (int slot, PageID pageNo)
+{
+	if (slot < 0) {
+		SetLeftLink(pageNo);
+		return;
+	}
+	char *entry = data + slots[slot].offset;
+	memcpy(entry + slots[slot].length - sizeof(PageID), &pageNo, sizeof(PageID));
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::GetKey
+//
+// Input   : slot - slot of an entry.
+// Output  : key - the key of that entry.
+// Return  : None
+//-------------------------------------------------------------------
+
+void BTIndexPage::GetKey (int slot, char *key)
+{
+	PageID pid;
+
+	GetKeyData(key, (DataType *)&pid,
+		(KeyDataEntry *)(data + slots[slot].offset),
+		slots[slot].length, INDEX_NODE);
+}
+
+
+//-------------------------------------------------------------------
+// BTIndexPage::DeleteEntry
+//
+// Input   : slot - slot of the entry to delete.
+// Output  : None
+// Purpose : Delete an entry by position; entries after it move down
+//           one slot.
+// Return  : OK if successful, FAIL otherwise.
+//-------------------------------------------------------------------
+
+Status BTIndexPage::DeleteEntry (int slot)
+{
+	RecordID rid;
+
+	rid.pageNo = PageNo();
+	rid.slotNo = slot;
+	return SortedPage::DeleteRecord(rid);
+}
+
+
 //-------------------------------------------------------------------
 // BTIndexPage::GetSibling
 //
@@ -131,14 +225,14 @@ Status BTIndexPage::GetSibling (const char *key,
 {
 	int i;
 	
-	for (i = numOfSlots - 1; i >= 0; i--)
+	for (i = GetNumOfRecords() - 1; i >= 0; i--)
 	{
 		GetKeyData(
 			NULL, 
 			(DataType *)&pageNo,
 			(KeyDataEntry *)(data + slots[i].offset),
 			slots[i].length,
-			(NodeType)type);
+			GetType());
 		
 		if (KeyCmp(key, (char *)(data+slots[i].offset)) >= 0)
 		{
@@ -150,7 +244,7 @@ Status BTIndexPage::GetSibling (const char *key,
 					(DataType *)&pageNo,
 					(KeyDataEntry *)(data + slots[i-1].offset),
 					slots[i-1].length,
-					(NodeType)type);
+					GetType());
 				return OK;
 			}
 			else
@@ -167,7 +261,7 @@ Status BTIndexPage::GetSibling (const char *key,
 		(DataType *)&pageNo,
 		(KeyDataEntry *)(data + slots[0].offset),
 		slots[0].length,
-		(NodeType)type);
+		GetType());
 	return OK;
 }
 
@@ -186,7 +280,7 @@ Status BTIndexPage::GetSibling (const char *key,
 
 Status BTIndexPage::GetFirst (RecordID& rid, char *key, PageID& pageNo)
 {
-	if (numOfSlots == 0) 
+	if (GetNumOfRecords() == 0) 
 	{
 		pageNo = INVALID_PAGE;
 		return DONE;
@@ -198,7 +292,7 @@ Status BTIndexPage::GetFirst (RecordID& rid, char *key, PageID& pageNo)
 	GetKeyData(key, 
 		(DataType *)&pageNo, 
 		(KeyDataEntry *)(data+slots[0].offset),
-		slots[0].length, (NodeType)type);
+		slots[0].length, GetType());
 	
 	return OK;
 }
@@ -220,7 +314,7 @@ Status BTIndexPage::GetNext (RecordID& rid, char *key, PageID & pageNo)
 {
 	rid.slotNo++;
 	
-	if (rid.slotNo >= numOfSlots)
+	if (rid.slotNo >= GetNumOfRecords())
 	{
 		pageNo = INVALID_PAGE;
 		return DONE;
@@ -230,7 +324,7 @@ Status BTIndexPage::GetNext (RecordID& rid, char *key, PageID & pageNo)
 		(DataType *)&pageNo,
 		(KeyDataEntry *)(data+slots[rid.slotNo].offset),
 		slots[rid.slotNo].length,
-		(NodeType)type);
+		GetType());
 	
 	return OK;
 }
@@ -251,7 +345,7 @@ Status BTIndexPage::GetNext (RecordID& rid, char *key, PageID & pageNo)
 
 Status BTIndexPage::FindKey(char *key, char *entry)
 {
-	for (int i = numOfSlots - 1; i >= 0; i--)
+	for (int i = GetNumOfRecords() - 1; i >= 0; i--)
 	{
 		if (KeyCmp(key, (char *)(data+slots[i].offset)) >= 0)
 		{
@@ -295,7 +389,7 @@ void BTIndexPage::SetLeftLink (PageID pid)
 
 Status BTIndexPage::AdjustKey (const char *newKey, const char *oldKey)
 {
-    for (int i = numOfSlots -1; i >= 0; i--) {
+    for (int i = GetNumOfRecords() -1; i >= 0; i--) {
         if (KeyCmp(oldKey, (char*)(data+slots[i].offset)) >= 0) {
 			memcpy(data+slots[i].offset, newKey, GetKeyLength(newKey)); 
 			return OK;
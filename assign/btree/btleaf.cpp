@@ -19,7 +19,7 @@ Status BTLeafPage::Insert(const char *key,
 	DataType d;
 	
 	d.rid = dataRid;
-	MakeEntry(&entry, key, (NodeType)type, d, &entryLen);
+	MakeEntry(&entry, key, GetType(), d, &entryLen);
 	//the data is packed into entry so that it can be inserted using SortedPage
 	//MakeEntry is defined in key.cpp
 
@@ -50,7 +50,7 @@ Status BTLeafPage::GetFirst (RecordID& rid, char* key, RecordID & dataRid)
 	rid.pageNo = pid;
 	rid.slotNo = 0;
 	
-	if (numOfSlots == 0)
+	if (GetNumOfRecords() == 0)
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
@@ -62,7 +62,7 @@ Status BTLeafPage::GetFirst (RecordID& rid, char* key, RecordID & dataRid)
 		(DataType *)&dataRid, 
 		(KeyDataEntry *)(data + slots[0].offset),
 		slots[0].length,
-		(NodeType)type);
+		GetType());
 	
 	return OK;
 }
@@ -85,7 +85,7 @@ Status BTLeafPage::GetNext (RecordID& rid, char* key, RecordID & dataRid)
 {
 	rid.slotNo ++;
 	
-	if (rid.slotNo == numOfSlots)
+	if (rid.slotNo == GetNumOfRecords())
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
@@ -96,7 +96,7 @@ Status BTLeafPage::GetNext (RecordID& rid, char* key, RecordID & dataRid)
 		(DataType *)&dataRid, 
 		(KeyDataEntry *)(data + slots[rid.slotNo].offset),
 		slots[rid.slotNo].length,
-		(NodeType)type);
+		GetType());
 	
 	return OK;
 }
@@ -115,7 +115,7 @@ Status BTLeafPage::GetNext (RecordID& rid, char* key, RecordID & dataRid)
 
 Status BTLeafPage::GetCurrent (RecordID rid, char* key, RecordID & dataRid)
 {
-	if (rid.slotNo == numOfSlots)
+	if (rid.slotNo == GetNumOfRecords())
 	{
 		dataRid.pageNo = INVALID_PAGE;
 		dataRid.slotNo = INVALID_SLOT;
@@ -126,7 +126,7 @@ Status BTLeafPage::GetCurrent (RecordID rid, char* key, RecordID & dataRid)
 		(DataType *)&dataRid, 
 		(KeyDataEntry *)(data + slots[rid.slotNo].offset),
 		slots[rid.slotNo].length,
-		(NodeType)type);
+		GetType());
 	
 	return OK;
 }
@@ -178,7 +178,7 @@ Status BTLeafPage::Delete (const char* key, const RecordID& dataRid)
 {
 	int i;
 	
-	for (i = numOfSlots - 1; i >= 0; i--)
+	for (i = GetNumOfRecords() - 1; i >= 0; i--)
 	{
 		KeyType tmpKey;
 		RecordID tmpRid;
@@ -187,7 +187,7 @@ Status BTLeafPage::Delete (const char* key, const RecordID& dataRid)
 			(DataType *)&tmpRid,
 			(KeyDataEntry *)(data + slots[i].offset),
 			slots[i].length,
-			(NodeType)type);
+			GetType());
 		if (tmpRid == dataRid && KeyCmp(key, tmpKey) == 0)
 		{
 			RecordID delRid;
@@ -7,7 +7,6 @@
 #include <vector>
 #include <algorithm>
 #include <iostream>
-#include <fstream>
 
 using namespace std;
 
@@ -15,6 +14,7 @@ using namespace std;
 #include "bufmgr.h"
 #include "db.h"
 #include "btfile.h"
+#include "logmgr.h"
 #include "btreeDriver.h"
 #include "btreetest.h"
 
@@ -24,84 +24,6 @@ void toKey(const int n, char* str) {
 	sprintf(str, "%04d", n);
 }
 
-void BTreeDriver::testPerformance(){
-
-	//testing insert
-	/*ofstream myfile1, myfile2;
-	myfile1.open("Performance/insert_performance_left.txt");
-	myfile2.open("Performance/insert_performance_right.txt");
-	for (int i = 10; i <= 9000; i+=10){
-		Status status = OK;
-		BTreeFile *btf = NULL;
-
-		btf = new BTreeFile(status, "InsertPerformance");
-
-		if (status != OK) {
-			std::cerr << "ERROR: Couldn't create a BTreeFile" << std::endl;
-			minibase_errors.show_errors();
-
-			std::cerr << "Hit [enter] to continue..." << std::endl;
-			std::cin.get();
-			exit(1);
-		}
-
-		clock_t initTime = clock();
-		InsertRange(btf, 1, i);
-		clock_t endTime = clock();
-		double timeInMillis = (endTime - initTime) * (1000.0/CLOCKS_PER_SEC);
-		cout << i << " : " << timeInMillis << "\n";
-		myfile1 << i << "\n";
-		myfile2 << timeInMillis << "\n";
-
-		btf->DestroyFile();
-		delete btf;
-	}
-	myfile1.close();
-	myfile2.close();*/
-
-	//testing scan
-	ofstream myfile1, myfile2;
-	myfile1.open("Performance/scan_performance_left.txt");
-	myfile2.open("Performance/scan_performance_right.txt");
-
-	for (int i = 1000; i <= 7540; i+=10){
-	Status status = OK;
-	BTreeFile *btf = NULL;
-
-	btf = new BTreeFile(status, "ScanPerformance");
-		InsertRange(btf, 1, i);
-
-		char  lowKey[MAX_INT_LENGTH]; char hiKey[MAX_INT_LENGTH];
-					clock_t initTime = clock();
-		for (int j = 1; j <= 550; j++){
-			toKey(j, lowKey);
-			toKey(j, hiKey);
-			IndexFileScan *scan = btf->OpenScan(lowKey, hiKey);
-
-			if (scan == NULL) {
-				std::cerr << "Error opening scan." << std::endl;
-			}
-	
-			RecordID curRid;
-			char  curKey [MAX_INT_LENGTH];
-			//while (scan->GetNext(curRid, curKey) != DONE) {
-			//}
-			delete scan;
-		}
-			clock_t endTime = clock();
-		double timeInMillis = (endTime - initTime) * (1000.0/CLOCKS_PER_SEC);
-		cout << i << " : " << timeInMillis << "\n";
-		myfile1 << i << "\n";
-		myfile2 << timeInMillis << "\n";
-			btf->DestroyFile();
-				delete btf;
-	}
-
-	myfile1.close();
-	myfile2.close();
-}
-
-
 bool BTreeDriver::customTestCases(){
 	Status status;
 	BTreeFile* btf = new BTreeFile(status, "CTC"); 
@@ -169,11 +91,11 @@ Status BTreeDriver::runTests() {
 	char *inputTxt = new char[inTxtLen];
 
 	cout << "Input a space separated test sequence (ie. a list of numbers " << endl <<
-		" in the range 0-7: 0 3 2 1) or hit ENTER to run all tests: ";
+		" in the range 0-8: 0 3 2 1) or hit ENTER to run all tests: ";
 
 	cin.getline (inputTxt, inTxtLen);
 	if (strlen(inputTxt) == 0) {
-		inputTxt = "01234567";
+		inputTxt = "012345678";
 	}
 	
 	minibase_globals = new SystemDefs(status, "BTREEDRIVER", "btlog", 1000, 500, 200, "Clock");
@@ -214,9 +136,7 @@ Status BTreeDriver::runTests() {
 			result = Test7();
 			break;
 		case '8':
-			testPerformance();
-			result = true;
-			status = OK;
+			result = Test8();
 			break;
 		case '9':
 			customTestCases();
@@ -859,6 +779,149 @@ bool BTreeDriver::Test7() {
 	return res;
 }
 
+//	Test recovery after a crash, of merges and of a destroyed index,
+//	with pages written past the OS cache
+bool BTreeDriver::Test8() {
+	Status status;
+	BTreeFile *keep, *drop;
+	bool res = true;
+	LogMode oldMode = logMgr.GetMode();
+
+	if (MINIBASE_BM->SetDirect(true) != OK) {
+		std::cerr << "SetDirect(true) failed" << std::endl;
+		res = false;
+	}
+	logMgr.SetMode(LOG_LAZY);
+
+	keep = new BTreeFile(status, "TestRecoveryKeep");
+	if (status == OK) {
+		drop = new BTreeFile(status, "TestRecoveryDrop");
+	}
+
+	if (status != OK) {
+		std::cerr << "ERROR: Couldn't create a BTreeFile" << std::endl;
+		minibase_errors.show_errors();
+
+		std::cerr << "Hit [enter] to continue..." << std::endl;
+		std::cin.get();
+		exit(1);
+	}
+
+	if (!InsertRange(keep, 1, 2000, 0, 5)) {
+		std::cerr << "InsertRange(1, 2000) failed" << std::endl;
+		res = false;
+	}
+
+	if (!InsertRange(drop, 1, 2000, 0, 5)) {
+		std::cerr << "InsertRange(1, 2000) failed" << std::endl;
+		res = false;
+	}
+
+	if (logMgr.Checkpoint() != OK) {
+		std::cerr << "Checkpoint failed" << std::endl;
+		res = false;
+	}
+
+	//	Merge most of the leaves away and free the pages of the other
+	//	index, then crash before another checkpoint.
+	for (int i = 1; i <= 2000; i++) {
+		if (i % 10 != 0 && !DeleteKey(keep, i, 5, false)) {
+			res = false;
+			break;
+		}
+	}
+
+	if (drop->DestroyFile() != OK) {
+		std::cerr << "Error destroying BTreeFile" << std::endl;
+		res = false;
+	}
+
+	delete keep;
+	delete drop;
+
+	if (MINIBASE_BM->DiscardAllPages() != OK) {
+		std::cerr << "DiscardAllPages failed" << std::endl;
+		res = false;
+	}
+
+	//	Whatever part of the deletes survived, the keys never deleted
+	//	must all be there, in order.
+	keep = new BTreeFile(status, "TestRecoveryKeep");
+	if (status != OK) {
+		std::cerr << "ERROR: Couldn't reopen a BTreeFile" << std::endl;
+		minibase_errors.show_errors();
+		exit(1);
+	}
+
+	IndexFileScan *scan = keep->OpenScan(NULL, NULL);
+	RecordID rid;
+	char prevKey[MAX_KEY_SIZE] = "";
+	char curKey[MAX_KEY_SIZE];
+	int numKept = 0;
+
+	while (scan->GetNext(rid, curKey) != DONE) {
+		int key = atoi(curKey);
+		if (strcmp(prevKey, curKey) >= 0 || key < 1 || key > 2000) {
+			std::cerr << "Error: Unexpected key " << curKey
+					  << " after " << prevKey << std::endl;
+			res = false;
+			break;
+		}
+		if (key % 10 == 0) {
+			numKept++;
+		}
+		strcpy(prevKey, curKey);
+	}
+
+	delete scan;
+
+	if (numKept != 200) {
+		std::cerr << "Error: Found " << numKept
+				  << " of the 200 keys never deleted" << std::endl;
+		res = false;
+	}
+
+	//	The destroyed index is either whole or gone.
+	drop = new BTreeFile(status, "TestRecoveryDrop");
+	if (status != OK) {
+		std::cerr << "ERROR: Couldn't reopen a BTreeFile" << std::endl;
+		minibase_errors.show_errors();
+		exit(1);
+	}
+
+	scan = drop->OpenScan(NULL, NULL);
+	int numDropped = 0;
+	while (scan->GetNext(rid, curKey) != DONE) {
+		numDropped++;
+	}
+	delete scan;
+
+	if (numDropped != 0 && numDropped != 2000) {
+		std::cerr << "Error: Destroyed index holds " << numDropped
+				  << " keys" << std::endl;
+		res = false;
+	}
+
+	if (keep->DestroyFile() != OK || drop->DestroyFile() != OK) {
+		std::cerr << "Error destroying BTreeFile" << std::endl;
+		res = false;
+	}
+
+	delete keep;
+	delete drop;
+
+	logMgr.SetMode(oldMode);
+	if (MINIBASE_BM->SetDirect(false) != OK) {
+		std::cerr << "SetDirect(false) failed" << std::endl;
+		res = false;
+	}
+
+	if (res) {
+		std::cout << "Test 8 Passed!" << std::endl;
+	}
+	return res;
+}
+
 //	Test Helper functions
 
 //-------------------------------------------------------------------
@@ -0,0 +1,725 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+#include "bufmgr.h"
+#include "db.h"
+#include "btfile.h"
+#include "btreebench.h"
+#include "workload.h"
+
+#define BENCH_DBNAME  "BTREEBENCH"
+#define BENCH_LOGNAME "benchlog"
+#define BENCH_INDEX   "BenchIndex"
+
+static const char *workloadNames[BENCH_NUM_WORKLOADS] = {
+	"seqinsert",
+	"randinsert",
+	"zipfinsert",
+	"lookup",
+	"shortscan",
+	"longscan",
+	"mixed",
+	"churn",
+	"ycsba",
+	"ycsbb",
+	"ycsbc",
+	"ycsbd",
+	"ycsbe",
+	"ycsbf",
+	"replay"
+};
+
+//-------------------------------------------------------------------
+// High resolution timer, in microseconds.
+//-------------------------------------------------------------------
+
+double BTreeBench::NowMicros()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	if (freq.QuadPart == 0)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (double)now.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// BenchConfig
+//-------------------------------------------------------------------
+
+BenchConfig::BenchConfig()
+	: numOps(10000), readPercent(90), shortScanLen(20), longScanLen(2000),
+	  zipfTheta(0.99), seed(1234567), dbPages(MINIBASE_DB_SIZE),
+	  format(BENCH_CSV), outFile(NULL), traceFile(NULL), recordFile(NULL),
+	  policy("Clock"), ioThreads(PAGEIO_THREADS), cleaner(true),
+	  readOnly(false), direct(false), reorganize(false), log(LOG_OFF)
+{
+	for (int i = 0; i < BENCH_REPLAY; i++)
+		workloads.push_back(i);
+	keyCounts.push_back(5000);
+	bufPoolSizes.push_back(50);
+	bufPoolSizes.push_back(200);
+	threadCounts.push_back(1);
+}
+
+static bool ParseIntList(const char *value, std::vector<int> &list)
+{
+	list.clear();
+	while (*value) {
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (end == value || v <= 0)
+			return false;
+		list.push_back((int)v);
+		value = (*end == ',') ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+static bool ParseWorkloadList(const char *value, std::vector<int> &list)
+{
+	list.clear();
+	if (strcmp(value, "all") == 0) {
+		for (int i = 0; i < BENCH_REPLAY; i++)
+			list.push_back(i);
+		return true;
+	}
+	while (*value) {
+		size_t len = strcspn(value, ",");
+		int w;
+		for (w = 0; w < BENCH_NUM_WORKLOADS; w++) {
+			if (strlen(workloadNames[w]) == len && strncmp(workloadNames[w], value, len) == 0)
+				break;
+		}
+		if (w == BENCH_NUM_WORKLOADS)
+			return false;
+		list.push_back(w);
+		value += len;
+		if (*value == ',')
+			value++;
+	}
+	return !list.empty();
+}
+
+//-------------------------------------------------------------------
+// BenchConfig::Parse
+//
+// Input   : argc, argv - arguments of the form name=value.
+// Output  : None
+// Return  : OK if every argument was understood, FAIL otherwise.
+// Purpose : Override the default configuration.
+//-------------------------------------------------------------------
+Status BenchConfig::Parse(int argc, char *argv[])
+{
+	for (int i = 0; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *eq = strchr(arg, '=');
+		if (eq == NULL) {
+			cerr << "Bad benchmark argument: " << arg << endl;
+			return FAIL;
+		}
+		std::string name(arg, eq - arg);
+		const char *value = eq + 1;
+		bool ok = true;
+
+		if (name == "workloads")
+			ok = ParseWorkloadList(value, workloads);
+		else if (name == "keys")
+			ok = ParseIntList(value, keyCounts);
+		else if (name == "bufpool")
+			ok = ParseIntList(value, bufPoolSizes);
+		else if (name == "threads")
+			ok = ParseIntList(value, threadCounts);
+		else if (name == "ops")
+			ok = (numOps = atoi(value)) > 0;
+		else if (name == "read")
+			ok = (readPercent = atoi(value)) >= 0 && readPercent <= 100;
+		else if (name == "shortscan")
+			ok = (shortScanLen = atoi(value)) > 0;
+		else if (name == "longscan")
+			ok = (longScanLen = atoi(value)) > 0;
+		else if (name == "theta")
+			ok = (zipfTheta = atof(value)) > 0 && zipfTheta < 1;
+		else if (name == "seed")
+			seed = strtoul(value, NULL, 10);
+		else if (name == "dbpages")
+			ok = (dbPages = (unsigned)atoi(value)) > 0;
+		else if (name == "format") {
+			if (strcmp(value, "csv") == 0)
+				format = BENCH_CSV;
+			else if (strcmp(value, "json") == 0)
+				format = BENCH_JSON;
+			else
+				ok = false;
+		}
+		else if (name == "out")
+			outFile = value;
+		else if (name == "trace")
+			traceFile = value;
+		else if (name == "record")
+			recordFile = value;
+		else if (name == "policy")
+			policy = value;
+		else if (name == "iothreads")
+			ok = (ioThreads = atoi(value)) >= 0 && ioThreads <= PAGEIO_THREADS;
+		else if (name == "cleaner") {
+			if (strcmp(value, "on") == 0)
+				cleaner = true;
+			else if (strcmp(value, "off") == 0)
+				cleaner = false;
+			else
+				ok = false;
+		}
+		else if (name == "readonly") {
+			if (strcmp(value, "on") == 0)
+				readOnly = true;
+			else if (strcmp(value, "off") == 0)
+				readOnly = false;
+			else
+				ok = false;
+		}
+		else if (name == "direct") {
+			if (strcmp(value, "on") == 0)
+				direct = true;
+			else if (strcmp(value, "off") == 0)
+				direct = false;
+			else
+				ok = false;
+		}
+		else if (name == "reorganize") {
+			if (strcmp(value, "on") == 0)
+				reorganize = true;
+			else if (strcmp(value, "off") == 0)
+				reorganize = false;
+			else
+				ok = false;
+		}
+		else if (name == "log") {
+			if (strcmp(value, "off") == 0)
+				log = LOG_OFF;
+			else if (strcmp(value, "lazy") == 0)
+				log = LOG_LAZY;
+			else if (strcmp(value, "sync") == 0)
+				log = LOG_SYNC;
+			else
+				ok = false;
+		}
+		else
+			ok = false;
+
+		if (!ok) {
+			cerr << "Bad benchmark argument: " << arg << endl;
+			return FAIL;
+		}
+	}
+	if (traceFile == NULL && std::find(workloads.begin(), workloads.end(), (int)BENCH_REPLAY) != workloads.end()) {
+		cerr << "The replay workload needs trace=file" << endl;
+		return FAIL;
+	}
+	// Traces are a single sequence of ops.
+	bool concurrent = *std::max_element(threadCounts.begin(), threadCounts.end()) > 1;
+	if (concurrent && (recordFile != NULL
+		|| std::find(workloads.begin(), workloads.end(), (int)BENCH_REPLAY) != workloads.end())) {
+		cerr << "Replay and record=file need threads=1" << endl;
+		return FAIL;
+	}
+	return OK;
+}
+
+void BenchConfig::PrintUsage(ostream &os)
+{
+	os << "bench [name=value ...]" << endl;
+	os << "  workloads=all|w1,w2,...  one of:";
+	for (int i = 0; i < BENCH_NUM_WORKLOADS; i++)
+		os << " " << workloadNames[i];
+	os << endl;
+	os << "  keys=n1,n2,...           tree sizes (default 5000)" << endl;
+	os << "  bufpool=b1,b2,...        buffer pool sizes in frames (default 50,200)" << endl;
+	os << "  threads=t1,t2,...        threads sharing the measured ops (default 1)" << endl;
+	os << "  ops=n                    measured ops for read/mixed workloads (default 10000)" << endl;
+	os << "  read=p                   lookup percentage in mixed (default 90)" << endl;
+	os << "  shortscan=n longscan=n   scan lengths (default 20, 2000)" << endl;
+	os << "  theta=t                  Zipfian skew (default 0.99)" << endl;
+	os << "  seed=s dbpages=n         RNG seed, database size" << endl;
+	os << "  format=csv|json out=file output format and destination" << endl;
+	os << "  trace=file               trace for the replay workload (not in 'all')" << endl;
+	os << "  record=file              record the measured ops to file (the last run wins)" << endl;
+	os << "  policy=p                 buffer replacement: Clock, LRU2, 2Q or ARC (default Clock)" << endl;
+	os << "  iothreads=n              threads for asynchronous page I/O, 0-" << PAGEIO_THREADS
+	   << " (default " << PAGEIO_THREADS << ")" << endl;
+	os << "  cleaner=on|off           write dirty pages in the background (default on)" << endl;
+	os << "  readonly=on|off          run lookups and scans on the file mapped read-only (default off)" << endl;
+	os << "  direct=on|off            read and write pages past the OS cache (default off)" << endl;
+	os << "  reorganize=on|off        defragment the loaded tree before measuring (default off)" << endl;
+	os << "  log=off|lazy|sync        log updates, committing each to disk with sync (default off)" << endl;
+}
+
+
+//-------------------------------------------------------------------
+// BTreeBench
+//-------------------------------------------------------------------
+
+const char *BTreeBench::WorkloadName(int workload)
+{
+	if (workload < 0 || workload >= BENCH_NUM_WORKLOADS)
+		return "unknown";
+	return workloadNames[workload];
+}
+
+//-------------------------------------------------------------------
+// BTreeBench::RunBenchmarks
+//
+// Input   : None
+// Output  : One CSV row or JSON object per run.
+// Return  : OK if every run succeeded, FAIL otherwise.
+// Purpose : Run every combination of workload, key count, buffer
+//           pool size and thread count in the configuration.
+//-------------------------------------------------------------------
+Status BTreeBench::RunBenchmarks()
+{
+	ofstream file;
+	if (config.outFile != NULL) {
+		file.open(config.outFile);
+		if (!file) {
+			cerr << "Cannot open benchmark output " << config.outFile << endl;
+			return FAIL;
+		}
+	}
+	ostream &os = (config.outFile != NULL) ? (ostream &)file : cout;
+
+	Status status = OK;
+	bool first = true;
+	WriteHeader(os, config.format);
+	for (size_t w = 0; w < config.workloads.size(); w++) {
+		for (size_t k = 0; k < config.keyCounts.size(); k++) {
+			for (size_t b = 0; b < config.bufPoolSizes.size(); b++) {
+				for (size_t t = 0; t < config.threadCounts.size(); t++) {
+					BenchResult result;
+					if (RunOne((BenchWorkload)config.workloads[w], config.keyCounts[k],
+							   config.bufPoolSizes[b], config.threadCounts[t], result) != OK) {
+						cerr << "Benchmark " << WorkloadName(config.workloads[w])
+							 << " keys=" << config.keyCounts[k]
+							 << " bufpool=" << config.bufPoolSizes[b]
+							 << " threads=" << config.threadCounts[t] << " failed" << endl;
+						minibase_errors.show_errors();
+						minibase_errors.clear_errors();
+						status = FAIL;
+						continue;
+					}
+					WriteResult(os, config.format, result, first);
+					first = false;
+					os.flush();
+				}
+			}
+		}
+	}
+	WriteFooter(os, config.format);
+	return status;
+}
+
+//	Creates a database with the given buffer pool, runs one workload on a
+//	fresh index, and tears everything down again so runs do not share state.
+Status BTreeBench::RunOne(BenchWorkload workload, int numKeys, int bufPoolSize,
+						  int numThreads, BenchResult &result)
+{
+	Status status;
+
+	remove(BENCH_DBNAME);
+	remove(BENCH_LOGNAME);
+	pageIO.SetThreads(config.ioThreads);
+	pageCleaner.SetEnabled(config.cleaner);
+	pageIO.SetDirect(config.direct);
+	logMgr.SetMode(config.log);
+	minibase_globals = new SystemDefs(status, BENCH_DBNAME, BENCH_LOGNAME,
+									  config.dbPages, 500, bufPoolSize, config.policy);
+	if (status == OK && MINIBASE_BM->SetReplacementPolicy(config.policy) != OK) {
+		cerr << "Unknown replacement policy " << config.policy << endl;
+		status = FAIL;
+	}
+	if (status != OK) {
+		delete minibase_globals;
+		minibase_globals = NULL;
+		return FAIL;
+	}
+
+	BTreeFile *btf = new BTreeFile(status, BENCH_INDEX);
+	if (status == OK) {
+		std::vector<double> latencies;
+		double wallMicros;
+		status = RunWorkload(btf, workload, numKeys, numThreads, latencies, wallMicros);
+
+		if (status == OK) {
+			result.workload = workload;
+			result.numKeys = numKeys;
+			result.bufPoolSize = bufPoolSize;
+			result.threads = numThreads;
+			MINIBASE_BM->GetStat(result.pins, result.misses);
+			result.hitRate = (result.pins == 0) ? 0 :
+				1.0 - (double)result.misses / (double)result.pins;
+			Summarize(latencies, (numThreads > 1) ? wallMicros : -1, result);
+		}
+		if (MINIBASE_BM->IsReadOnly()) {
+			delete btf;
+			MINIBASE_BM->SetReadOnly(false);
+			btf = new BTreeFile(status, BENCH_INDEX);
+		}
+		if (btf->DestroyFile() != OK)
+			status = FAIL;
+	}
+	delete btf;
+
+	delete minibase_globals;
+	minibase_globals = NULL;
+	remove(BENCH_DBNAME);
+	remove(BENCH_LOGNAME);
+	return status;
+}
+
+//	Loads the tree if the workload needs one, resets the buffer statistics
+//	and then runs the measured phase on numThreads threads.  With reorganize=on
+//	the loaded tree gets one pass of Reorganize first.  With readonly=on
+//	a workload that only reads reopens the index on the mapped file.
+Status BTreeBench::RunWorkload(BTreeFile *&btf, BenchWorkload workload, int numKeys,
+							   int numThreads, std::vector<double> &latencies,
+							   double &wallMicros)
+{
+	WorkloadRandom rnd(config.seed);
+	std::vector<long> keys(numKeys);
+	TraceOp op;
+
+	for (long i = 0; i < numKeys; i++)
+		keys[i] = i;
+	for (long i = numKeys - 1; i > 0; i--)
+		std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+
+	bool isInsert = (workload == BENCH_SEQ_INSERT || workload == BENCH_RANDOM_INSERT
+					 || workload == BENCH_ZIPF_INSERT);
+	if (!isInsert) {
+		for (long i = 0; i < numKeys; i++) {
+			WorkloadGenerator::MakeInsert(keys[i], op);
+			if (btf->Insert(op.lowKey, op.rid) != OK)
+				return FAIL;
+		}
+		if (config.reorganize) {
+			Status s;
+			while ((s = btf->Reorganize(numKeys)) == OK)
+				;
+			if (s != DONE)
+				return FAIL;
+		}
+	}
+
+	bool readsOnly = (workload == BENCH_POINT_LOOKUP || workload == BENCH_SHORT_SCAN
+					  || workload == BENCH_LONG_SCAN || workload == BENCH_YCSB_C);
+	if (config.readOnly && readsOnly) {
+		Status s;
+		delete btf;
+		if (MINIBASE_BM->SetReadOnly(true) != OK)
+			cerr << "Cannot map " << BENCH_DBNAME << endl;
+		btf = new BTreeFile(s, BENCH_INDEX, MINIBASE_BM->IsReadOnly());
+		if (s != OK)
+			return FAIL;
+	}
+
+	TraceReader reader;
+	if (workload == BENCH_REPLAY && reader.Open(config.traceFile) != OK) {
+		cerr << "Cannot open trace " << config.traceFile << endl;
+		return FAIL;
+	}
+	TraceWriter writer;
+	if (config.recordFile != NULL) {
+		if (writer.Open(config.recordFile) != OK) {
+			cerr << "Cannot open trace " << config.recordFile << endl;
+			return FAIL;
+		}
+		btf->SetTraceWriter(&writer);
+	}
+
+	// Thread 0 carries on with the sequence that shuffled the keys, so a
+	// run on one thread does not depend on the thread counts configured.
+	std::vector<BenchThread *> threads;
+	for (int t = 0; t < numThreads; t++) {
+		threads.push_back(new BenchThread(config, btf, workload, numKeys, keys, t, numThreads,
+										  (t == 0) ? rnd : WorkloadRandom(config.seed + t)));
+		threads[t]->reader = &reader;
+	}
+
+	MINIBASE_BM->ResetStat();
+	double start = NowMicros();
+	Status s = RunThreads(threads);
+	wallMicros = NowMicros() - start;
+
+	for (int t = 0; t < numThreads; t++) {
+		latencies.insert(latencies.end(), threads[t]->latencies.begin(),
+						 threads[t]->latencies.end());
+		delete threads[t];
+	}
+
+	btf->SetTraceWriter(NULL);
+	if (writer.Close() != OK)
+		s = FAIL;
+	return s;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI BenchThreadMain(LPVOID arg)
+{
+	BenchThread *thread = (BenchThread *)arg;
+	thread->status = thread->Run();
+	return 0;
+}
+#else
+static void *BenchThreadMain(void *arg)
+{
+	BenchThread *thread = (BenchThread *)arg;
+	thread->status = thread->Run();
+	return NULL;
+}
+#endif
+
+//	Runs every thread to completion.  A single thread runs on the caller.
+Status BTreeBench::RunThreads(std::vector<BenchThread *> &threads)
+{
+	if (threads.size() == 1)
+		return threads[0]->Run();
+
+	size_t started;
+	Status s = OK;
+#ifdef _WIN32
+	std::vector<HANDLE> handles(threads.size());
+	for (started = 0; started < threads.size(); started++) {
+		handles[started] = CreateThread(NULL, 0, BenchThreadMain, threads[started], 0, NULL);
+		if (handles[started] == NULL)
+			break;
+	}
+	for (size_t t = 0; t < started; t++) {
+		WaitForSingleObject(handles[t], INFINITE);
+		CloseHandle(handles[t]);
+	}
+#else
+	std::vector<pthread_t> handles(threads.size());
+	for (started = 0; started < threads.size(); started++) {
+		if (pthread_create(&handles[started], NULL, BenchThreadMain, threads[started]) != 0)
+			break;
+	}
+	for (size_t t = 0; t < started; t++)
+		pthread_join(handles[t], NULL);
+#endif
+	if (started < threads.size()) {
+		cerr << "Cannot start benchmark thread " << started << endl;
+		s = FAIL;
+	}
+	for (size_t t = 0; t < started; t++) {
+		if (threads[t]->status != OK)
+			s = FAIL;
+	}
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BenchThread::Run
+//
+// Input   : None
+// Output  : latencies - one entry per measured operation.
+// Return  : OK if every operation succeeded, FAIL otherwise.
+// Purpose : Generate and time this thread's share of the measured
+//           phase.
+//-------------------------------------------------------------------
+Status BenchThread::Run()
+{
+	TraceOp ops[WORKLOAD_MAX_OPS];
+	int numOpsNow, found;
+	Status s = OK;
+
+	WorkloadGenerator *ycsb = NULL;
+	if (workload >= BENCH_YCSB_A && workload <= BENCH_YCSB_F) {
+		YcsbMix mix;
+		YcsbMix::Get((char)('a' + (workload - BENCH_YCSB_A)), mix);
+		ycsb = new WorkloadGenerator(mix, numKeys, config.seed + part, config.zipfTheta);
+		ycsb->Partition(part, numParts);
+	}
+	KeyChooser *zipf = NULL;
+	if (workload == BENCH_ZIPF_INSERT)
+		zipf = new KeyChooser(DIST_ZIPFIAN, numKeys, config.zipfTheta);
+
+	// Inserts go through the keys this thread owns; everything else is
+	// a share of numOps.
+	bool isInsert = (workload == BENCH_SEQ_INSERT || workload == BENCH_RANDOM_INSERT
+					 || workload == BENCH_ZIPF_INSERT);
+	long total = isInsert ? numKeys : config.numOps;
+	long numOps = (total - part + numParts - 1) / numParts;
+	long ownKeys = (numKeys - part + numParts - 1) / numParts;
+	long nextKey = numKeys + part;
+	latencies.reserve(numOps);
+
+	for (long op = 0; (workload == BENCH_REPLAY || op < numOps) && s == OK; op++) {
+		// Generate the op first so that only the index work is timed.
+		long mine = part + op * numParts;
+		numOpsNow = 1;
+		switch (workload) {
+		case BENCH_SEQ_INSERT:
+			WorkloadGenerator::MakeInsert(mine, ops[0]);
+			break;
+		case BENCH_RANDOM_INSERT:
+			WorkloadGenerator::MakeInsert(keys[mine], ops[0]);
+			break;
+		case BENCH_ZIPF_INSERT:
+			WorkloadGenerator::MakeInsert(zipf->Next(rnd, numKeys), ops[0]);
+			break;
+		case BENCH_POINT_LOOKUP:
+			WorkloadGenerator::MakeScan(keys[rnd.Uniform(numKeys)], 1, true, ops[0]);
+			break;
+		case BENCH_SHORT_SCAN:
+			WorkloadGenerator::MakeScan(keys[rnd.Uniform(numKeys)], config.shortScanLen, false, ops[0]);
+			break;
+		case BENCH_LONG_SCAN:
+			WorkloadGenerator::MakeScan(keys[rnd.Uniform(numKeys)], config.longScanLen, false, ops[0]);
+			break;
+		case BENCH_MIXED:
+			if (rnd.Uniform(100) < config.readPercent)
+				WorkloadGenerator::MakeScan(keys[rnd.Uniform(numKeys)], 1, true, ops[0]);
+			else {
+				WorkloadGenerator::MakeInsert(nextKey, ops[0]);
+				nextKey += numParts;
+			}
+			break;
+		case BENCH_DELETE_CHURN:
+			{
+				// Delete a live key and replace it with a new one, so the
+				// tree size stays constant.  Each thread churns its own
+				// slots of keys.
+				long i = part + rnd.Uniform(ownKeys) * numParts;
+				WorkloadGenerator::MakeDelete(keys[i], ops[0]);
+				keys[i] = nextKey;
+				nextKey += numParts;
+				WorkloadGenerator::MakeInsert(keys[i], ops[1]);
+				numOpsNow = 2;
+			}
+			break;
+		case BENCH_REPLAY:
+			s = reader->Read(ops[0]);
+			break;
+		default:
+			numOpsNow = ycsb->Next(ops);
+		}
+		if (s == DONE) {
+			s = OK;
+			break;
+		}
+
+		double start = BTreeBench::NowMicros();
+		for (int i = 0; i < numOpsNow && s == OK; i++) {
+			s = WorkloadGenerator::Execute(btf, ops[i], found);
+			// Replayed deletes may legitimately miss, and so may the
+			// record another thread is updating at the same time;
+			// anywhere else a missing key means the tree lost it.
+			if ((workload == BENCH_REPLAY || numParts > 1) && ops[i].type == TRACE_DELETE)
+				s = OK;
+			else if (s == OK && ops[i].type == TRACE_SCAN && ops[i].hasHigh && found != 1
+					 && numParts == 1)
+				s = FAIL;
+		}
+		latencies.push_back(BTreeBench::NowMicros() - start);
+	}
+
+	delete ycsb;
+	delete zipf;
+	return s;
+}
+
+static double Percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+//	wallMicros is the elapsed time of a concurrent run, or negative for a
+//	single thread.
+void BTreeBench::Summarize(std::vector<double> &latencies, double wallMicros,
+						   BenchResult &result)
+{
+	double total = 0;
+	for (size_t i = 0; i < latencies.size(); i++)
+		total += latencies[i];
+	std::sort(latencies.begin(), latencies.end());
+
+	// Throughput is measured over the timed operations only, so the
+	// load phase of the read workloads does not dilute it.  Threads
+	// overlap, so their latencies cannot simply be added up.
+	if (wallMicros >= 0)
+		total = wallMicros;
+	result.numOps = (long)latencies.size();
+	result.seconds = total / 1e6;
+	result.opsPerSec = (total > 0) ? result.numOps / (total / 1e6) : 0;
+	result.latP50 = Percentile(latencies, 0.50);
+	result.latP90 = Percentile(latencies, 0.90);
+	result.latP99 = Percentile(latencies, 0.99);
+	result.latP999 = Percentile(latencies, 0.999);
+	result.latMax = latencies.empty() ? 0 : latencies.back();
+}
+
+void BTreeBench::WriteHeader(ostream &os, BenchFormat format)
+{
+	if (format == BENCH_JSON) {
+		os << "[" << endl;
+		return;
+	}
+	os << "workload,keys,bufpool,threads,ops,seconds,ops_per_sec,"
+	   << "lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,"
+	   << "pins,misses,hit_rate" << endl;
+}
+
+void BTreeBench::WriteResult(ostream &os, BenchFormat format,
+							 const BenchResult &r, bool first)
+{
+	char line[512];
+	if (format == BENCH_JSON) {
+		sprintf(line,
+				"%s  {\"workload\": \"%s\", \"keys\": %d, \"bufpool\": %d, \"threads\": %d, \"ops\": %ld, "
+				"\"seconds\": %.6f, \"ops_per_sec\": %.1f, "
+				"\"lat_p50_us\": %.2f, \"lat_p90_us\": %.2f, \"lat_p99_us\": %.2f, "
+				"\"lat_p999_us\": %.2f, \"lat_max_us\": %.2f, "
+				"\"pins\": %ld, \"misses\": %ld, \"hit_rate\": %.4f}",
+				first ? "" : ",\n", WorkloadName(r.workload), r.numKeys, r.bufPoolSize,
+				r.threads, r.numOps, r.seconds, r.opsPerSec, r.latP50, r.latP90, r.latP99,
+				r.latP999, r.latMax, r.pins, r.misses, r.hitRate);
+		os << line;
+		return;
+	}
+	sprintf(line, "%s,%d,%d,%d,%ld,%.6f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%ld,%ld,%.4f",
+			WorkloadName(r.workload), r.numKeys, r.bufPoolSize, r.threads, r.numOps, r.seconds,
+			r.opsPerSec, r.latP50, r.latP90, r.latP99, r.latP999, r.latMax,
+			r.pins, r.misses, r.hitRate);
+	os << line << endl;
+}
+
+void BTreeBench::WriteFooter(ostream &os, BenchFormat format)
+{
+	if (format == BENCH_JSON)
+		os << endl << "]" << endl;
+}
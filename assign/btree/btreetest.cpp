@@ -10,6 +10,7 @@ using namespace std;
 #include "btfile.h"
 
 #include "btreetest.h"
+#include "workload.h"
 
 #define MAX_COMMAND_SIZE 1000
 
@@ -40,6 +41,7 @@ Status BTreeTest::RunTests(istream &in) {
 		cout << "Error: Unable to create index file"<< endl;
 	}
 
+	TraceWriter trace;
 	char command[MAX_COMMAND_SIZE];
 	in >> command;
 	while(in) {
@@ -64,6 +66,30 @@ Status BTreeTest::RunTests(istream &in) {
 		else if(!strcmp(command, "stats")) {
 			btf->DumpStatistics();
 		}
+		else if(!strcmp(command, "record")) {
+			char filename[MAX_COMMAND_SIZE];
+			in >> filename;
+			if (trace.Open(filename) != OK) {
+				cout << "Error: cannot open trace " << filename << endl;
+			} else {
+				btf->SetTraceWriter(&trace);
+				cout << "Recording to " << filename << endl;
+			}
+		}
+		else if(!strcmp(command, "stoprecord")) {
+			btf->SetTraceWriter(NULL);
+			cout << "  " << trace.NumOps() << " ops recorded." << endl;
+			trace.Close();
+		}
+		else if(!strcmp(command, "replay")) {
+			char filename[MAX_COMMAND_SIZE];
+			long numOps;
+			in >> filename;
+			Status s = ReplayTrace(btf, filename, numOps);
+			cout << "  " << numOps << " ops replayed." << endl;
+			if (s != OK)
+				minibase_errors.show_errors();
+		}
 		else if(!strcmp(command, "quit")) {
 			break;
 		}
@@ -73,6 +99,8 @@ Status BTreeTest::RunTests(istream &in) {
 		in >> command;
 	}
 
+	btf->SetTraceWriter(NULL);
+	trace.Close();
 	destroyIndex(btf, btfname);
 
 	delete minibase_globals;
@@ -0,0 +1,209 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "latch.h"
+
+//	How often ReadVersion checks a page being written before it lets
+//	other threads run.
+const int VERSION_SPINS = 100;
+
+PageLatchTable pageLatches;
+
+#ifdef _WIN32
+
+//	An SRWLOCK is a single pointer, initialized to zero.
+#define SRW(p) ((PSRWLOCK)&(p))
+
+Latch::Latch() : srwLock(NULL) {}
+Latch::~Latch() {}
+void Latch::LockShared() { AcquireSRWLockShared(SRW(srwLock)); }
+void Latch::UnlockShared() { ReleaseSRWLockShared(SRW(srwLock)); }
+void Latch::LockExclusive() { AcquireSRWLockExclusive(SRW(srwLock)); }
+bool Latch::TryLockExclusive() { return TryAcquireSRWLockExclusive(SRW(srwLock)) != 0; }
+void Latch::UnlockExclusive() { ReleaseSRWLockExclusive(SRW(srwLock)); }
+
+Mutex::Mutex() : srwLock(NULL) {}
+Mutex::~Mutex() {}
+void Mutex::Lock() { AcquireSRWLockExclusive(SRW(srwLock)); }
+void Mutex::Unlock() { ReleaseSRWLockExclusive(SRW(srwLock)); }
+
+void MemoryFence() { MemoryBarrier(); }
+static void AtomicIncrement(volatile unsigned *p) { InterlockedIncrement((volatile LONG *)p); }
+int AtomicAdd(volatile int *p, int delta) { return InterlockedExchangeAdd((volatile LONG *)p, delta) + delta; }
+bool AtomicCompareAndSwap(volatile int *p, int oldValue, int newValue)
+{
+	return InterlockedCompareExchange((volatile LONG *)p, newValue, oldValue) == oldValue;
+}
+void SleepMicros(int micros) { Sleep((micros + 999) / 1000); }
+void YieldThread() { SwitchToThread(); }
+
+#else
+
+Latch::Latch() { pthread_rwlock_init(&rwLock, NULL); }
+Latch::~Latch() { pthread_rwlock_destroy(&rwLock); }
+void Latch::LockShared() { pthread_rwlock_rdlock(&rwLock); }
+void Latch::UnlockShared() { pthread_rwlock_unlock(&rwLock); }
+void Latch::LockExclusive() { pthread_rwlock_wrlock(&rwLock); }
+bool Latch::TryLockExclusive() { return pthread_rwlock_trywrlock(&rwLock) == 0; }
+void Latch::UnlockExclusive() { pthread_rwlock_unlock(&rwLock); }
+
+Mutex::Mutex() { pthread_mutex_init(&mutex, NULL); }
+Mutex::~Mutex() { pthread_mutex_destroy(&mutex); }
+void Mutex::Lock() { pthread_mutex_lock(&mutex); }
+void Mutex::Unlock() { pthread_mutex_unlock(&mutex); }
+
+void MemoryFence() { __sync_synchronize(); }
+static void AtomicIncrement(volatile unsigned *p) { __sync_fetch_and_add(p, 1); }
+int AtomicAdd(volatile int *p, int delta) { return __sync_add_and_fetch(p, delta); }
+bool AtomicCompareAndSwap(volatile int *p, int oldValue, int newValue)
+{
+	return __sync_bool_compare_and_swap(p, oldValue, newValue);
+}
+void SleepMicros(int micros) { usleep(micros); }
+void YieldThread() { sched_yield(); }
+
+#endif
+
+
+//-------------------------------------------------------------------
+// PageLatchTable
+//-------------------------------------------------------------------
+
+PageLatchTable::PageLatchTable()
+{
+	top = new Chunk * volatile[LATCH_TOP_SIZE];
+	for (int i = 0; i < LATCH_TOP_SIZE; i++)
+		top[i] = NULL;
+}
+
+PageLatchTable::~PageLatchTable()
+{
+	for (int i = 0; i < LATCH_TOP_SIZE; i++) {
+		if (top[i] == NULL)
+			continue;
+		for (int j = 0; j < LATCH_DIR_SIZE; j++)
+			delete [] top[i][j];
+		delete [] top[i];
+	}
+	delete [] top;
+}
+
+//	Allocates the chunk holding page n, and its directory if need be.
+//	Each is fully constructed before it is published, so Get can read
+//	the directories without a lock.
+PageLatchTable::PageLatch *PageLatchTable::AddChunk(unsigned n)
+{
+	int t = (int)(n >> (LATCH_CHUNK_BITS + LATCH_DIR_BITS));
+	int d = (int)((n >> LATCH_CHUNK_BITS) & (LATCH_DIR_SIZE - 1));
+	MutexGuard guard(growMutex);
+
+	if (top[t] == NULL) {
+		Chunk *dir = new Chunk[LATCH_DIR_SIZE];
+		for (int i = 0; i < LATCH_DIR_SIZE; i++)
+			dir[i] = NULL;
+		MemoryFence();
+		top[t] = dir;
+	}
+	if (top[t][d] == NULL) {
+		PageLatch *chunk = new PageLatch[LATCH_CHUNK_SIZE];
+		MemoryFence();
+		top[t][d] = chunk;
+	}
+	return top[t][d];
+}
+
+//	The fences order the version change against the writes to the
+//	page, for readers that only look at the version.
+void PageLatchTable::Lock(PageID pid, LatchMode mode)
+{
+	PageLatch &l = Get(pid);
+	l.latch.Lock(mode);
+	if (mode == LATCH_EXCLUSIVE) {
+		l.version++;
+		MemoryFence();
+	}
+}
+
+bool PageLatchTable::TryLockExclusive(PageID pid)
+{
+	PageLatch &l = Get(pid);
+	if (!l.latch.TryLockExclusive())
+		return false;
+	l.version++;
+	MemoryFence();
+	return true;
+}
+
+void PageLatchTable::Unlock(PageID pid, LatchMode mode, bool changed)
+{
+	PageLatch &l = Get(pid);
+	if (mode == LATCH_EXCLUSIVE) {
+		MemoryFence();
+		if (changed)
+			l.version++;
+		else
+			l.version--;
+	}
+	l.latch.Unlock(mode);
+}
+
+unsigned PageLatchTable::ReadVersion(PageID pid)
+{
+	PageLatch &l = Get(pid);
+	for (int spins = 0; ; spins++) {
+		unsigned version = l.version;
+		if ((version & 1) == 0) {
+			MemoryFence();
+			return version;
+		}
+		if (spins >= VERSION_SPINS)
+			YieldThread();
+	}
+}
+
+bool PageLatchTable::Validate(PageID pid, unsigned version)
+{
+	MemoryFence();
+	return Get(pid).version == version;
+}
+
+bool PageLatchTable::LockAtVersion(PageID pid, LatchMode mode, unsigned version)
+{
+	PageLatch &l = Get(pid);
+	l.latch.Lock(mode);
+	if (l.version != version) {
+		l.latch.Unlock(mode);
+		return false;
+	}
+	if (mode == LATCH_EXCLUSIVE) {
+		l.version++;
+		MemoryFence();
+	}
+	return true;
+}
+
+
+//-------------------------------------------------------------------
+// EventCounter
+//-------------------------------------------------------------------
+
+//	The fences keep the read after whatever the reader looked at before,
+//	and before whatever it looks at next.
+unsigned EventCounter::Read()
+{
+	MemoryFence();
+	unsigned value = count;
+	MemoryFence();
+	return value;
+}
+
+void EventCounter::Advance()
+{
+	AtomicIncrement(&count);
+	MemoryFence();
+}
@@ -5,6 +5,8 @@ using namespace std;
 
 #include "btreetest.h"
 #include "btreeDriver.h"
+#include "btreebench.h"
+#include "microbench.h"
 
 int MINIBASE_RESTART_FLAG = 0;
 
@@ -15,6 +17,9 @@ void printHelp() {
 	cout << "delete <low> <high>"<<endl;
 	cout << "print"<<endl;
 	cout << "stats"<<endl;
+	cout << "record <file> (record ops to a binary trace)"<<endl;
+	cout << "stoprecord"<<endl;
+	cout << "replay <file>"<<endl;
 	cout << "quit (not required)"<<endl;
 	cout << "Note that (<low>==-1)=>min and (<high>==-1)=>max"<<endl;
 
@@ -50,10 +55,47 @@ int btreeTestAutomatic() {
 	return 0;
 }
 
+int btreeBenchmark(int argc, char *argv[]) {
+	BenchConfig config;
+	if (config.Parse(argc, argv) != OK) {
+		BenchConfig::PrintUsage(cerr);
+		return 1;
+	}
+
+	BTreeBench bench(config);
+	if (bench.RunBenchmarks() != OK) {
+		cout << "Error encountered during btree benchmark: " << endl;
+		minibase_errors.show_errors();
+		return 1;
+	}
+	return 0;
+}
+
+int btreeMicroBenchmark(int argc, char *argv[]) {
+	MicroBenchConfig config;
+	if (config.Parse(argc, argv) != OK) {
+		MicroBenchConfig::PrintUsage(cerr);
+		return 1;
+	}
+
+	MicroBench bench(config);
+	return (bench.RunBenchmarks() == OK) ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
+	//	Benchmarks can be run unattended: BTree bench|micro [name=value ...]
+	if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+		return btreeBenchmark(argc - 2, argv + 2);
+	}
+	if (argc > 1 && strcmp(argv[1], "micro") == 0) {
+		return btreeMicroBenchmark(argc - 2, argv + 2);
+	}
+
 	std::cout << "Please choose the test mode: " << std::endl;
 	std::cout << "Hit [Enter] for automatic test" << std::endl;
 	std::cout << "Type 'man' for manual test" << std::endl;
+	std::cout << "Type 'bench' for the default benchmark suite" << std::endl;
+	std::cout << "Type 'micro' for the key and page microbenchmarks" << std::endl;
 
 	char testMode[20];
 	std::cin.getline(testMode, 20);
@@ -64,9 +106,15 @@ int main(int argc, char *argv[]) {
 	} else if (strcmp(testMode, "MAN") == 0 || strcmp(testMode, "man") == 0) {
 		//	Manual test
 		ret = btreeTestManual();
+	} else if (strcmp(testMode, "bench") == 0) {
+		//	Benchmark with the default configuration
+		ret = btreeBenchmark(0, NULL);
+	} else if (strcmp(testMode, "micro") == 0) {
+		//	Microbenchmarks with the default configuration
+		ret = btreeMicroBenchmark(0, NULL);
 	} else {
 		std::cout << "Unrecognized test mode: " << testMode << std::endl;
-		std::cout << "Please type [Enter] or 'man'" << std::endl;
+		std::cout << "Please type [Enter], 'man', 'bench' or 'micro'" << std::endl;
 	
 	}
 	
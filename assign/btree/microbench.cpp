@@ -0,0 +1,572 @@
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+#include "btindex.h"
+#include "btleaf.h"
+#include "microbench.h"
+#include "workload.h"
+
+#define MICRO_NUM_PROBES 1024		// power of two, probes are indexed by i & mask
+#define MICRO_PROBE_MASK (MICRO_NUM_PROBES - 1)
+
+static const char *primitiveNames[MICRO_NUM_PRIMITIVES] = {
+	"keycmp",
+	"makeentry",
+	"insertrecord",
+	"compactslotdir",
+	"getpageid",
+	"leafsearch"
+};
+
+//-------------------------------------------------------------------
+// Hardware counters.  Cycles, instructions, cache misses and branch
+// misses are read as one perf_event_open group on Linux; elsewhere,
+// or when the kernel refuses, only wall clock time is reported.
+//-------------------------------------------------------------------
+
+class PerfCounters {
+
+public:
+
+	enum { NUM_COUNTERS = 4 };
+
+	PerfCounters();
+	~PerfCounters();
+
+	bool Open();
+	void Start();
+	void Stop(long long values[NUM_COUNTERS]);
+
+private:
+
+	int fds[NUM_COUNTERS];
+};
+
+PerfCounters::PerfCounters()
+{
+	for (int i = 0; i < NUM_COUNTERS; i++)
+		fds[i] = -1;
+}
+
+PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		if (fds[i] >= 0)
+			close(fds[i]);
+	}
+#endif
+}
+
+bool PerfCounters::Open()
+{
+#ifdef __linux__
+	static const unsigned long long events[NUM_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+
+	for (int i = 0; i < NUM_COUNTERS; i++) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.config = events[i];
+		attr.disabled = (i == 0);
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP;
+		fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1,
+							  (i == 0) ? -1 : fds[0], 0);
+		if (fds[i] < 0) {
+			for (int j = 0; j < i; j++) {
+				close(fds[j]);
+				fds[j] = -1;
+			}
+			return false;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PerfCounters::Start()
+{
+#ifdef __linux__
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+}
+
+void PerfCounters::Stop(long long values[NUM_COUNTERS])
+{
+	memset(values, 0, NUM_COUNTERS * sizeof(long long));
+#ifdef __linux__
+	unsigned long long buf[1 + NUM_COUNTERS];
+	ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(fds[0], buf, sizeof(buf)) == (ssize_t)sizeof(buf)) {
+		for (int i = 0; i < NUM_COUNTERS; i++)
+			values[i] = (long long)buf[1 + i];
+	}
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// Benchmark state.  Keys are zero padded decimal numbers of exactly
+// keyLen bytes, so keys of the same length share a long common
+// prefix, which is the expensive case for strncmp.  Pages hold the
+// even numbers 0, 2, 4, ... and probes are drawn from [0, 2n], so
+// about half the searches land between two keys.
+//-------------------------------------------------------------------
+
+struct MicroContext {
+	int keyLen;
+	int entries;
+	KeyType probes[MICRO_NUM_PROBES];
+	KeyType pairs[MICRO_NUM_PROBES];	// probes[i] with the last digit changed
+	KeyDataEntry probeEntries[MICRO_NUM_PROBES];
+	int probeEntryLens[MICRO_NUM_PROBES];
+	Page leafTemplate;
+	Page indexTemplate;
+	Page work;
+	long sink;		// results of the ops are summed here
+};
+
+typedef void (*MicroLoop)(MicroContext &ctx, long iterations);
+
+static volatile long microSink;		// keeps the compiler from discarding the loops
+
+static void MakeKey(long n, int keyLen, char *key)
+{
+	sprintf(key, "%0*ld", keyLen, n);
+}
+
+//	Fills a leaf or index page with keys 0, 2, 4, ... until fillPercent of
+//	the data area is used, keeping room for one more entry so that the
+//	insert benchmark never overflows.  Returns the number of entries.
+static int FillPage(SortedPage *page, NodeType type, int keyLen, int fillPercent)
+{
+	char key[MAX_KEY_SIZE];
+	RecordID rid, outRid;
+	int n;
+
+	page->Init(1);
+	page->SetType(type);
+	if (type == INDEX_NODE)
+		((BTIndexPage *)page)->SetLeftLink(0);
+
+	int target = HEAPPAGE_DATA_SIZE * fillPercent / 100;
+	for (n = 0; ; n++) {
+		MakeKey(2 * n, keyLen, key);
+		int need = GetKeyDataLength(key, type) + 2 * sizeof(short);
+		int used = HEAPPAGE_DATA_SIZE - page->AvailableSpace();
+		if (n > 0 && used + need > target)
+			break;
+		if (page->AvailableSpace() < 2 * need)
+			break;
+		rid.pageNo = n + 1;
+		rid.slotNo = n;
+		Status s = (type == INDEX_NODE)
+			? ((BTIndexPage *)page)->Insert(key, (PageID)(n + 1), outRid)
+			: ((BTLeafPage *)page)->Insert(key, rid, outRid);
+		if (s != OK)
+			break;
+	}
+	return n;
+}
+
+static void LoopKeyCmp(MicroContext &ctx, long iterations)
+{
+	for (long i = 0; i < iterations; i++) {
+		int j = (int)(i & MICRO_PROBE_MASK);
+		ctx.sink += KeyCmp(ctx.probes[j], ctx.pairs[j]);
+	}
+}
+
+static void LoopMakeEntry(MicroContext &ctx, long iterations)
+{
+	KeyDataEntry entry;
+	KeyType key;
+	DataType data;
+	int len;
+	for (long i = 0; i < iterations; i++) {
+		int j = (int)(i & MICRO_PROBE_MASK);
+		data.rid.pageNo = j;
+		data.rid.slotNo = (int)i;
+		MakeEntry(&entry, ctx.probes[j], LEAF_NODE, data, &len);
+		GetKeyData(key, &data, &entry, len, LEAF_NODE);
+		ctx.sink += data.rid.slotNo + key[0];
+	}
+}
+
+static void LoopRestorePage(MicroContext &ctx, long iterations)
+{
+	for (long i = 0; i < iterations; i++) {
+		memcpy((char *)&ctx.work, (char *)&ctx.leafTemplate, sizeof(Page));
+		ctx.sink += ((char *)&ctx.work)[i & (sizeof(Page) - 1)];
+	}
+}
+
+static void LoopInsertRecord(MicroContext &ctx, long iterations)
+{
+	RecordID rid;
+	for (long i = 0; i < iterations; i++) {
+		int j = (int)(i & MICRO_PROBE_MASK);
+		memcpy((char *)&ctx.work, (char *)&ctx.leafTemplate, sizeof(Page));
+		((SortedPage *)&ctx.work)->InsertRecord((char *)&ctx.probeEntries[j],
+												ctx.probeEntryLens[j], rid);
+		ctx.sink += rid.slotNo;
+	}
+}
+
+static void LoopDeleteSlot(MicroContext &ctx, long iterations)
+{
+	MicroBenchPage *page = (MicroBenchPage *)&ctx.work;
+	for (long i = 0; i < iterations; i++) {
+		memcpy((char *)&ctx.work, (char *)&ctx.leafTemplate, sizeof(Page));
+		page->DeleteSlot((int)(i % ctx.entries));
+		ctx.sink += page->NumSlots();
+	}
+}
+
+static void LoopCompactSlots(MicroContext &ctx, long iterations)
+{
+	MicroBenchPage *page = (MicroBenchPage *)&ctx.work;
+	for (long i = 0; i < iterations; i++) {
+		memcpy((char *)&ctx.work, (char *)&ctx.leafTemplate, sizeof(Page));
+		page->DeleteSlot((int)(i % ctx.entries));
+		page->Compact();
+		ctx.sink += page->NumSlots();
+	}
+}
+
+static void LoopGetPageID(MicroContext &ctx, long iterations)
+{
+	BTIndexPage *page = (BTIndexPage *)&ctx.indexTemplate;
+	PageID pid;
+	for (long i = 0; i < iterations; i++) {
+		page->GetPageID(ctx.probes[i & MICRO_PROBE_MASK], pid);
+		ctx.sink += pid;
+	}
+}
+
+static void LoopLeafSearch(MicroContext &ctx, long iterations)
+{
+	BTLeafPage *page = (BTLeafPage *)&ctx.leafTemplate;
+	RecordID rid, dataRid;
+	KeyType keyFound;
+	for (long i = 0; i < iterations; i++) {
+		if (page->_Search(rid, ctx.probes[i & MICRO_PROBE_MASK], dataRid, keyFound) == OK)
+			ctx.sink += rid.slotNo;
+	}
+}
+
+//	Runs loop for the given number of iterations and returns the elapsed
+//	time in microseconds, reading the counters if they are open.
+static double TimeLoop(MicroLoop loop, MicroContext &ctx, long iterations,
+					   PerfCounters *counters, long long values[PerfCounters::NUM_COUNTERS])
+{
+	if (counters != NULL)
+		counters->Start();
+	double start = BTreeBench::NowMicros();
+	loop(ctx, iterations);
+	double elapsed = BTreeBench::NowMicros() - start;
+	if (counters != NULL)
+		counters->Stop(values);
+	return elapsed;
+}
+
+
+//-------------------------------------------------------------------
+// MicroBenchConfig
+//-------------------------------------------------------------------
+
+MicroBenchConfig::MicroBenchConfig()
+	: minSeconds(0.2), useCounters(true), format(BENCH_CSV), outFile(NULL)
+{
+	keyLens.push_back(8);
+	keyLens.push_back(32);
+	keyLens.push_back(128);
+	fillPercents.push_back(25);
+	fillPercents.push_back(50);
+	fillPercents.push_back(90);
+}
+
+static bool ParseIntList(const char *value, std::vector<int> &list, int low, int high)
+{
+	list.clear();
+	while (*value) {
+		char *end;
+		long v = strtol(value, &end, 10);
+		if (end == value || v < low || v > high)
+			return false;
+		list.push_back((int)v);
+		value = (*end == ',') ? end + 1 : end;
+	}
+	return !list.empty();
+}
+
+//-------------------------------------------------------------------
+// MicroBenchConfig::Parse
+//
+// Input   : argc, argv - arguments of the form name=value.
+// Output  : None
+// Return  : OK if every argument was understood, FAIL otherwise.
+// Purpose : Override the default configuration.
+//-------------------------------------------------------------------
+Status MicroBenchConfig::Parse(int argc, char *argv[])
+{
+	for (int i = 0; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *eq = strchr(arg, '=');
+		if (eq == NULL) {
+			cerr << "Bad microbenchmark argument: " << arg << endl;
+			return FAIL;
+		}
+		std::string name(arg, eq - arg);
+		const char *value = eq + 1;
+		bool ok = true;
+
+		if (name == "keylens")
+			ok = ParseIntList(value, keyLens, 4, MAX_KEY_SIZE - 1);
+		else if (name == "fills")
+			ok = ParseIntList(value, fillPercents, 1, 100);
+		else if (name == "seconds")
+			ok = (minSeconds = atof(value)) > 0;
+		else if (name == "counters")
+			useCounters = (atoi(value) != 0);
+		else if (name == "format") {
+			if (strcmp(value, "csv") == 0)
+				format = BENCH_CSV;
+			else if (strcmp(value, "json") == 0)
+				format = BENCH_JSON;
+			else
+				ok = false;
+		}
+		else if (name == "out")
+			outFile = value;
+		else
+			ok = false;
+
+		if (!ok) {
+			cerr << "Bad microbenchmark argument: " << arg << endl;
+			return FAIL;
+		}
+	}
+	return OK;
+}
+
+void MicroBenchConfig::PrintUsage(ostream &os)
+{
+	os << "micro [name=value ...]" << endl;
+	os << "  keylens=l1,l2,...        key lengths in bytes (default 8,32,128)" << endl;
+	os << "  fills=f1,f2,...          page fill percentages (default 25,50,90)" << endl;
+	os << "  seconds=s                minimum measured time per result (default 0.2)" << endl;
+	os << "  counters=0|1             read hardware counters (Linux only, default 1)" << endl;
+	os << "  format=csv|json out=file output format and destination" << endl;
+}
+
+
+//-------------------------------------------------------------------
+// MicroBench
+//-------------------------------------------------------------------
+
+Status MicroBenchPage::DeleteSlot(int slot)
+{
+	RecordID rid;
+	rid.pageNo = pid;
+	rid.slotNo = slot;
+	return HeapPage::DeleteRecord(rid);
+}
+
+const char *MicroBench::PrimitiveName(int primitive)
+{
+	if (primitive < 0 || primitive >= MICRO_NUM_PRIMITIVES)
+		return "unknown";
+	return primitiveNames[primitive];
+}
+
+Status MicroBench::RunBenchmarks()
+{
+	ofstream file;
+	if (config.outFile != NULL) {
+		file.open(config.outFile);
+		if (!file) {
+			cerr << "Cannot open benchmark output " << config.outFile << endl;
+			return FAIL;
+		}
+	}
+	ostream &os = (config.outFile != NULL) ? (ostream &)file : cout;
+
+	Status status = OK;
+	bool first = true;
+	WriteHeader(os, config.format);
+	for (int p = 0; p < MICRO_NUM_PRIMITIVES; p++) {
+		// KeyCmp and MakeEntry do not touch a page, so the fill level
+		// does not apply to them.
+		bool usesPage = (p != MICRO_KEY_CMP && p != MICRO_MAKE_ENTRY);
+		for (size_t k = 0; k < config.keyLens.size(); k++) {
+			for (size_t f = 0; f < (usesPage ? config.fillPercents.size() : 1); f++) {
+				MicroResult result;
+				if (RunOne((MicroPrimitive)p, config.keyLens[k],
+						   usesPage ? config.fillPercents[f] : 0, result) != OK) {
+					status = FAIL;
+					continue;
+				}
+				WriteResult(os, config.format, result, first);
+				first = false;
+				os.flush();
+			}
+		}
+	}
+	WriteFooter(os, config.format);
+	return status;
+}
+
+//	Measures one primitive.  Insert and compact benchmarks restore the page
+//	from a template before every op; the cost of that restore (and of the
+//	delete that precedes a compaction) is measured separately and
+//	subtracted.
+Status MicroBench::RunOne(MicroPrimitive primitive, int keyLen, int fillPercent,
+						  MicroResult &result)
+{
+	MicroContext *ctx = new MicroContext;
+	WorkloadRandom rnd(12345);
+	MicroLoop loop, baseline = NULL;
+
+	ctx->keyLen = keyLen;
+	ctx->sink = 0;
+	ctx->entries = FillPage((SortedPage *)&ctx->leafTemplate, LEAF_NODE, keyLen,
+							fillPercent ? fillPercent : 50);
+	FillPage((SortedPage *)&ctx->indexTemplate, INDEX_NODE, keyLen,
+			 fillPercent ? fillPercent : 50);
+
+	for (int i = 0; i < MICRO_NUM_PROBES; i++) {
+		long v = rnd.Uniform(2 * ctx->entries + 1);
+		DataType data;
+		MakeKey(v, keyLen, ctx->probes[i]);
+		MakeKey(v ^ 1, keyLen, ctx->pairs[i]);
+		data.rid.pageNo = (PageID)v;
+		data.rid.slotNo = i;
+		MakeEntry(&ctx->probeEntries[i], ctx->probes[i], LEAF_NODE, data,
+				  &ctx->probeEntryLens[i]);
+	}
+
+	switch (primitive) {
+	case MICRO_KEY_CMP:			loop = LoopKeyCmp; break;
+	case MICRO_MAKE_ENTRY:		loop = LoopMakeEntry; break;
+	case MICRO_INSERT_RECORD:	loop = LoopInsertRecord; baseline = LoopRestorePage; break;
+	case MICRO_COMPACT_SLOTS:	loop = LoopCompactSlots; baseline = LoopDeleteSlot; break;
+	case MICRO_GET_PAGE_ID:		loop = LoopGetPageID; break;
+	case MICRO_LEAF_SEARCH:		loop = LoopLeafSearch; break;
+	default:
+		delete ctx;
+		return FAIL;
+	}
+
+	// Double the iteration count until a run takes a tenth of the
+	// target, then scale up to the target for the measured run.
+	long long values[PerfCounters::NUM_COUNTERS], baseValues[PerfCounters::NUM_COUNTERS];
+	double target = config.minSeconds * 1e6;
+	long iterations = 64;
+	double elapsed;
+	while ((elapsed = TimeLoop(loop, *ctx, iterations, NULL, values)) < target / 10)
+		iterations *= 2;
+	iterations = (long)(iterations * (target / (elapsed > 0 ? elapsed : 1)));
+	if (iterations < 1)
+		iterations = 1;
+
+	PerfCounters counters;
+	bool haveCounters = config.useCounters && counters.Open();
+	PerfCounters *pc = haveCounters ? &counters : NULL;
+
+	elapsed = TimeLoop(loop, *ctx, iterations, pc, values);
+	if (baseline != NULL) {
+		elapsed -= TimeLoop(baseline, *ctx, iterations, pc, baseValues);
+		if (elapsed < 0)
+			elapsed = 0;
+		for (int i = 0; i < PerfCounters::NUM_COUNTERS; i++)
+			values[i] -= baseValues[i];
+	}
+
+	result.primitive = primitive;
+	result.keyLen = keyLen;
+	result.fillPercent = fillPercent;
+	result.entries = fillPercent ? ctx->entries : 0;
+	result.iterations = iterations;
+	result.nsPerOp = elapsed * 1000.0 / iterations;
+	result.haveCounters = haveCounters;
+	result.cyclesPerOp = (double)values[0] / iterations;
+	result.instructionsPerOp = (double)values[1] / iterations;
+	result.cacheMissesPerOp = (double)values[2] / iterations;
+	result.branchMissesPerOp = (double)values[3] / iterations;
+
+	microSink = ctx->sink;
+	delete ctx;
+	return OK;
+}
+
+void MicroBench::WriteHeader(ostream &os, BenchFormat format)
+{
+	if (format == BENCH_JSON) {
+		os << "[" << endl;
+		return;
+	}
+	os << "primitive,keylen,fill,entries,iterations,ns_per_op,"
+	   << "cycles_per_op,instructions_per_op,cache_misses_per_op,branch_misses_per_op" << endl;
+}
+
+void MicroBench::WriteResult(ostream &os, BenchFormat format,
+							 const MicroResult &r, bool first)
+{
+	char line[512];
+	char counters[256];
+
+	if (format == BENCH_JSON) {
+		if (r.haveCounters)
+			sprintf(counters, ", \"cycles_per_op\": %.2f, \"instructions_per_op\": %.2f, "
+					"\"cache_misses_per_op\": %.4f, \"branch_misses_per_op\": %.4f",
+					r.cyclesPerOp, r.instructionsPerOp, r.cacheMissesPerOp, r.branchMissesPerOp);
+		else
+			counters[0] = '\0';
+		sprintf(line,
+				"%s  {\"primitive\": \"%s\", \"keylen\": %d, \"fill\": %d, \"entries\": %d, "
+				"\"iterations\": %ld, \"ns_per_op\": %.2f%s}",
+				first ? "" : ",\n", PrimitiveName(r.primitive), r.keyLen, r.fillPercent,
+				r.entries, r.iterations, r.nsPerOp, counters);
+		os << line;
+		return;
+	}
+
+	if (r.haveCounters)
+		sprintf(counters, "%.2f,%.2f,%.4f,%.4f", r.cyclesPerOp, r.instructionsPerOp,
+				r.cacheMissesPerOp, r.branchMissesPerOp);
+	else
+		strcpy(counters, ",,,");
+	sprintf(line, "%s,%d,%d,%d,%ld,%.2f,%s", PrimitiveName(r.primitive), r.keyLen,
+			r.fillPercent, r.entries, r.iterations, r.nsPerOp, counters);
+	os << line << endl;
+}
+
+void MicroBench::WriteFooter(ostream &os, BenchFormat format)
+{
+	if (format == BENCH_JSON)
+		os << endl << "]" << endl;
+}
@@ -16,7 +16,8 @@
 // Output  : rid - record id of the inserted record
 // Precond : There is enough space on this page to accomodate this
 //           record.  The records on this page is sorted and the
-//           slots directory is compact.
+//           slots directory is compact, with the high key if any in
+//           the last slot.
 // Postcond: The records on this page is still sorted and the
 //           slots directory is compact.
 // Purpose : Insert the record into this page.
@@ -41,9 +42,20 @@ Status SortedPage::InsertRecord (char * recPtr,
 	if (status != OK)
 		return FAIL;
 	
+	// the high key stays in the last slot
+
+	i = numOfSlots - 1;
+	if (HasHighKey())
+	{
+		Slot tmpSlot = slots[i];
+		slots[i]     = slots[i-1];
+		slots[i-1]   = tmpSlot;
+		i--;
+	}
+
 	// performs a simple insertion sort
 
-	for (i = numOfSlots - 1; i > 0; i--) 
+	for (; i > 0; i--) 
 	{
 		char *x = data + slots[i].offset;
 		char *y = data + slots[i-1].offset;
@@ -102,3 +114,91 @@ Status SortedPage::DeleteRecord (const RecordID& rid)
 	return OK;
 }
 
+
+//-------------------------------------------------------------------
+// SortedPage::UsedSpace
+//
+// Input   : None
+// Output  : None
+// Return  : The number of bytes used by records and their slots.
+// Purpose : Measure how full the page is, independent of how the
+//           free space is accounted for.
+//-------------------------------------------------------------------
+
+int SortedPage::UsedSpace ()
+{
+	int used = 0;
+
+	for (int i = 0; i < GetNumOfRecords(); i++)
+		used += RecordSpace(slots[i].length);
+	
+	return used;
+}
+
+
+//-------------------------------------------------------------------
+// SortedPage::HighKeySpace
+//
+// Input   : None
+// Output  : None
+// Return  : The number of bytes used by the high key and its slot, 0
+//           if there is none.
+//-------------------------------------------------------------------
+
+int SortedPage::HighKeySpace ()
+{
+	if (!HasHighKey())
+		return 0;
+	return RecordSpace(slots[numOfSlots - 1].length);
+}
+
+
+//-------------------------------------------------------------------
+// SortedPage::SetHighKey
+//
+// Input   : key - the new high key, NULL for none.
+// Output  : None
+// Return  : OK if successful, FAIL if the new high key doesn't fit;
+//           the page is then unchanged.
+// Purpose : Replace the high key in the last slot.
+//-------------------------------------------------------------------
+
+Status SortedPage::SetHighKey (const char *key)
+{
+	RecordID rid;
+
+	if (key != NULL && GetKeyLength(key) > AvailableSpace() + HighKeySpace())
+		return FAIL;
+
+	if (HasHighKey())
+	{
+		rid.pageNo = pid;
+		rid.slotNo = numOfSlots - 1;
+		if (SortedPage::DeleteRecord(rid) != OK)
+			return FAIL;
+		type &= ~SORTED_HIGH_KEY;
+	}
+	if (key == NULL)
+		return OK;
+
+	// The directory is compact, so the new record takes the last slot.
+	if (HeapPage::InsertRecord((char *)key, GetKeyLength(key), rid) != OK)
+		return FAIL;
+	type |= SORTED_HIGH_KEY;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// SortedPage::PastHighKey
+//
+// Input   : key - the key being looked for.
+// Output  : None
+// Return  : true if key is at or past the high key, so that it belongs
+//           to a page further right.
+//-------------------------------------------------------------------
+
+bool SortedPage::PastHighKey (const char *key)
+{
+	return HasHighKey() && KeyCmp(key, HighKey()) >= 0;
+}
@@ -0,0 +1,435 @@
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+#include "bufmgr.h"
+#include "db.h"
+#include "btfile.h"
+#include "workload.h"
+
+#define TRACE_MAGIC   "BTTR"
+#define TRACE_VERSION 1
+
+#define TRACE_HAS_LOW  0x1
+#define TRACE_HAS_HIGH 0x2
+
+//-------------------------------------------------------------------
+// Key distributions
+//-------------------------------------------------------------------
+
+ZipfianGenerator::ZipfianGenerator(long n, double theta)
+	: n(0), theta(theta), zeta2(0), zetan(0), eta(0)
+{
+	alpha = 1.0 / (1.0 - theta);
+	Grow(n < 2 ? 2 : n);
+}
+
+void ZipfianGenerator::Grow(long newN)
+{
+	for (long i = n + 1; i <= newN; i++) {
+		zetan += 1.0 / pow((double)i, theta);
+		if (i == 2)
+			zeta2 = zetan;
+	}
+	n = newN;
+	eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+}
+
+long ZipfianGenerator::Next(WorkloadRandom &rnd, long numItems)
+{
+	if (numItems > n)
+		Grow(numItems);
+
+	double u = rnd.NextDouble();
+	double uz = u * zetan;
+	long item;
+	if (uz < 1.0)
+		item = 0;
+	else if (uz < 1.0 + pow(0.5, theta))
+		item = 1;
+	else
+		item = (long)(n * pow(eta * u - eta + 1, alpha));
+	return (item < numItems) ? item : numItems - 1;
+}
+
+long KeyChooser::Next(WorkloadRandom &rnd, long numKeys)
+{
+	switch (dist) {
+	case DIST_ZIPFIAN:
+		{
+			// Scramble with an FNV hash so that the popular keys are
+			// spread over the key space instead of clustering at 0.
+			unsigned long long item = zipf.Next(rnd, numKeys);
+			unsigned long long h = 14695981039346656037ULL;
+			for (int i = 0; i < 8; i++) {
+				h ^= (item >> (i * 8)) & 0xff;
+				h *= 1099511628211ULL;
+			}
+			return (long)(h % (unsigned long long)numKeys);
+		}
+	case DIST_LATEST:
+		return numKeys - 1 - zipf.Next(rnd, numKeys);
+	default:
+		return rnd.Uniform(numKeys);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// YcsbMix::Get
+//
+// Input   : workload - one of 'a' to 'f'.
+// Output  : mix - the operation mix of that workload.
+// Return  : OK, or FAIL for an unknown workload.
+//-------------------------------------------------------------------
+Status YcsbMix::Get(char workload, YcsbMix &mix)
+{
+	memset(&mix, 0, sizeof(mix));
+	mix.dist = DIST_ZIPFIAN;
+	mix.maxScanLen = 100;
+
+	switch (workload) {
+	case 'a': case 'A':
+		mix.readPercent = 50;
+		mix.updatePercent = 50;
+		break;
+	case 'b': case 'B':
+		mix.readPercent = 95;
+		mix.updatePercent = 5;
+		break;
+	case 'c': case 'C':
+		mix.readPercent = 100;
+		break;
+	case 'd': case 'D':
+		mix.readPercent = 95;
+		mix.insertPercent = 5;
+		mix.dist = DIST_LATEST;
+		break;
+	case 'e': case 'E':
+		mix.scanPercent = 95;
+		mix.insertPercent = 5;
+		break;
+	case 'f': case 'F':
+		mix.readPercent = 50;
+		mix.rmwPercent = 50;
+		break;
+	default:
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// WorkloadGenerator
+//-------------------------------------------------------------------
+
+WorkloadGenerator::WorkloadGenerator(const YcsbMix &mix, long recordCount,
+									 unsigned long seed, double theta)
+	: mix(mix), numKeys(recordCount), nextInsert(recordCount), insertStride(1),
+	  rnd(seed), chooser(mix.dist, recordCount, theta)
+{
+}
+
+void WorkloadGenerator::Partition(int part, int numParts)
+{
+	nextInsert = numKeys + part;
+	insertStride = numParts;
+}
+
+void WorkloadGenerator::MakeKey(long n, char *key)
+{
+	sprintf(key, "%010ld", n);
+}
+
+void WorkloadGenerator::MakeRid(long n, RecordID &rid)
+{
+	rid.pageNo = (PageID)(n + 1);
+	rid.slotNo = (int)(n % 1000);
+}
+
+void WorkloadGenerator::MakeInsert(long n, TraceOp &op)
+{
+	op.type = TRACE_INSERT;
+	op.hasLow = true;
+	op.hasHigh = false;
+	MakeKey(n, op.lowKey);
+	MakeRid(n, op.rid);
+	op.limit = 0;
+}
+
+void WorkloadGenerator::MakeDelete(long n, TraceOp &op)
+{
+	MakeInsert(n, op);
+	op.type = TRACE_DELETE;
+}
+
+void WorkloadGenerator::MakeScan(long n, int limit, bool exact, TraceOp &op)
+{
+	op.type = TRACE_SCAN;
+	op.hasLow = true;
+	op.hasHigh = exact;
+	MakeKey(n, op.lowKey);
+	if (exact)
+		MakeKey(n, op.highKey);
+	op.limit = limit;
+}
+
+Status WorkloadGenerator::Load(BTreeFile *btf)
+{
+	TraceOp op;
+	for (long i = 0; i < numKeys; i++) {
+		MakeInsert(i, op);
+		if (btf->Insert(op.lowKey, op.rid) != OK)
+			return FAIL;
+	}
+	return OK;
+}
+
+//-------------------------------------------------------------------
+// WorkloadGenerator::Next
+//
+// Input   : None
+// Output  : ops - the primitive ops of one YCSB operation.
+// Return  : The number of ops written.
+// Purpose : A read is an exact match scan, an update deletes and
+//           reinserts the record, and a read-modify-write does both.
+//-------------------------------------------------------------------
+int WorkloadGenerator::Next(TraceOp ops[WORKLOAD_MAX_OPS])
+{
+	int r = (int)rnd.Uniform(100);
+	long n;
+
+	if ((r -= mix.insertPercent) < 0) {
+		MakeInsert(nextInsert, ops[0]);
+		nextInsert += insertStride;
+		numKeys++;
+		return 1;
+	}
+
+	n = chooser.Next(rnd, numKeys);
+	if ((r -= mix.scanPercent) < 0) {
+		MakeScan(n, 1 + (int)rnd.Uniform(mix.maxScanLen), false, ops[0]);
+		return 1;
+	}
+	if ((r -= mix.updatePercent) < 0) {
+		MakeDelete(n, ops[0]);
+		MakeInsert(n, ops[1]);
+		return 2;
+	}
+	if ((r -= mix.rmwPercent) < 0) {
+		MakeScan(n, 1, true, ops[0]);
+		MakeDelete(n, ops[1]);
+		MakeInsert(n, ops[2]);
+		return 3;
+	}
+	MakeScan(n, 1, true, ops[0]);
+	return 1;
+}
+
+Status WorkloadGenerator::Execute(BTreeFile *btf, const TraceOp &op, int &found)
+{
+	found = 0;
+	switch (op.type) {
+	case TRACE_INSERT:
+		return btf->Insert(op.lowKey, op.rid);
+	case TRACE_DELETE:
+		return btf->Delete(op.lowKey, op.rid);
+	case TRACE_SCAN:
+		{
+			IndexFileScan *scan = btf->OpenScan(op.hasLow ? op.lowKey : NULL,
+												op.hasHigh ? op.highKey : NULL);
+			if (scan == NULL)
+				return FAIL;
+			RecordID rid;
+			char key[MAX_KEY_SIZE];
+			while ((op.limit < 0 || found < op.limit) && scan->GetNext(rid, key) == OK)
+				found++;
+			delete scan;
+			return OK;
+		}
+	}
+	return FAIL;
+}
+
+
+//-------------------------------------------------------------------
+// Trace files
+//-------------------------------------------------------------------
+
+static bool PutInt(FILE *fp, int v)
+{
+	unsigned char b[4];
+	for (int i = 0; i < 4; i++)
+		b[i] = (unsigned char)(((unsigned)v >> (i * 8)) & 0xff);
+	return fwrite(b, 1, 4, fp) == 4;
+}
+
+static bool GetInt(FILE *fp, int &v)
+{
+	unsigned char b[4];
+	if (fread(b, 1, 4, fp) != 4)
+		return false;
+	v = (int)(b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned)b[3] << 24));
+	return true;
+}
+
+static bool PutKey(FILE *fp, const char *key)
+{
+	size_t len = strlen(key);
+	if (len >= MAX_KEY_SIZE)
+		len = MAX_KEY_SIZE - 1;
+	return putc((int)len, fp) != EOF && fwrite(key, 1, len, fp) == len;
+}
+
+static bool GetKey(FILE *fp, char *key)
+{
+	int len = getc(fp);
+	if (len == EOF || len >= MAX_KEY_SIZE)
+		return false;
+	if (fread(key, 1, len, fp) != (size_t)len)
+		return false;
+	key[len] = '\0';
+	return true;
+}
+
+Status TraceWriter::Open(const char *filename)
+{
+	Close();
+	fp = fopen(filename, "wb");
+	if (fp == NULL)
+		return FAIL;
+	numOps = 0;
+	if (fwrite(TRACE_MAGIC, 1, 4, fp) != 4 || putc(TRACE_VERSION, fp) == EOF) {
+		Close();
+		return FAIL;
+	}
+	return OK;
+}
+
+Status TraceWriter::Write(const TraceOp &op)
+{
+	if (fp == NULL)
+		return FAIL;
+
+	bool ok;
+	if (op.type == TRACE_SCAN) {
+		int flags = (op.hasLow ? TRACE_HAS_LOW : 0) | (op.hasHigh ? TRACE_HAS_HIGH : 0);
+		ok = putc(op.type, fp) != EOF && putc(flags, fp) != EOF;
+		if (ok && op.hasLow)
+			ok = PutKey(fp, op.lowKey);
+		if (ok && op.hasHigh)
+			ok = PutKey(fp, op.highKey);
+		ok = ok && PutInt(fp, op.limit);
+	} else {
+		ok = putc(op.type, fp) != EOF && putc(TRACE_HAS_LOW, fp) != EOF
+			&& PutKey(fp, op.lowKey)
+			&& PutInt(fp, op.rid.pageNo) && PutInt(fp, op.rid.slotNo);
+	}
+	if (!ok)
+		return FAIL;
+	numOps++;
+	return OK;
+}
+
+Status TraceWriter::Close()
+{
+	if (fp == NULL)
+		return OK;
+	int r = fclose(fp);
+	fp = NULL;
+	return (r == 0) ? OK : FAIL;
+}
+
+Status TraceReader::Open(const char *filename)
+{
+	Close();
+	fp = fopen(filename, "rb");
+	if (fp == NULL)
+		return FAIL;
+
+	char magic[4];
+	if (fread(magic, 1, 4, fp) != 4 || memcmp(magic, TRACE_MAGIC, 4) != 0
+		|| getc(fp) != TRACE_VERSION) {
+		Close();
+		return FAIL;
+	}
+	return OK;
+}
+
+Status TraceReader::Read(TraceOp &op)
+{
+	if (fp == NULL)
+		return FAIL;
+
+	int type = getc(fp);
+	if (type == EOF)
+		return DONE;
+	int flags = getc(fp);
+	if (flags == EOF)
+		return FAIL;
+
+	op.type = (TraceOpType)type;
+	op.hasLow = (flags & TRACE_HAS_LOW) != 0;
+	op.hasHigh = (flags & TRACE_HAS_HIGH) != 0;
+	op.limit = 0;
+
+	switch (op.type) {
+	case TRACE_INSERT:
+	case TRACE_DELETE:
+		if (!GetKey(fp, op.lowKey) || !GetInt(fp, op.rid.pageNo) || !GetInt(fp, op.rid.slotNo))
+			return FAIL;
+		return OK;
+	case TRACE_SCAN:
+		if (op.hasLow && !GetKey(fp, op.lowKey))
+			return FAIL;
+		if (op.hasHigh && !GetKey(fp, op.highKey))
+			return FAIL;
+		if (!GetInt(fp, op.limit))
+			return FAIL;
+		return OK;
+	}
+	return FAIL;
+}
+
+void TraceReader::Close()
+{
+	if (fp != NULL)
+		fclose(fp);
+	fp = NULL;
+}
+
+//-------------------------------------------------------------------
+// ReplayTrace
+//
+// Input   : btf - the index to run the trace against.
+//           filename - trace written by TraceWriter.
+// Output  : numOps - the number of ops replayed.
+// Return  : OK if the whole trace replayed, FAIL otherwise.
+// Purpose : Replay a recorded trace.  Ops run in order on a single
+//           thread, so a replay onto the same initial tree is
+//           deterministic.
+//-------------------------------------------------------------------
+Status ReplayTrace(BTreeFile *btf, const char *filename, long &numOps)
+{
+	TraceReader reader;
+	TraceOp op;
+	Status s;
+	int found;
+
+	numOps = 0;
+	if (reader.Open(filename) != OK) {
+		cerr << "Cannot open trace " << filename << endl;
+		return FAIL;
+	}
+	while ((s = reader.Read(op)) == OK) {
+		// A failed delete is part of the recorded behaviour, not an
+		// error in the replay.
+		if (WorkloadGenerator::Execute(btf, op, found) != OK && op.type != TRACE_DELETE)
+			return FAIL;
+		numOps++;
+	}
+	return (s == DONE) ? OK : FAIL;
+}
@@ -0,0 +1,80 @@
+#include "replacer.h"
+
+
+//-------------------------------------------------------------------
+// ARC::ARC
+//
+// Input   : bufSize - number of frames.
+//           frames - the frames, shared with the buffer manager.
+// Output  : None
+// Return  : None
+// Purpose : Each ghost list holds as many ids as the pool has frames.
+//           The cold queue's target starts at zero, as in the paper.
+//-------------------------------------------------------------------
+ARC::ARC(int bufSize, ClockFrame **frames)
+	: SampledReplacer(bufSize, frames), target(0), coldGhosts(bufSize), hotGhosts(bufSize)
+{
+}
+
+int ARC::PickVictim()
+{
+	int cold = coldCount;
+	return Sample((cold > 0 && cold > target) ? QUEUE_COLD : QUEUE_HOT);
+}
+
+//	Hits come in under a shared latch, so the move to the hot queue is
+//	made by whichever of them swaps the queue first.
+void ARC::Referenced(int frameNo)
+{
+	if (AtomicCompareAndSwap(&history[frameNo].queue, QUEUE_COLD, QUEUE_HOT)) {
+		AtomicAdd(&coldCount, -1);
+		AtomicAdd(&hotCount, 1);
+	}
+	Touch(frameNo);
+}
+
+
+//-------------------------------------------------------------------
+// ARC::Loaded
+//
+// Input   : frameNo - frame the page was loaded into.
+//           pid - the page.
+// Output  : None
+// Return  : None
+// Purpose : A page on a ghost list goes on the hot queue, and moves
+//           the target towards the queue it was replaced from, by
+//           more the shorter that queue's ghost list is.
+//-------------------------------------------------------------------
+void ARC::Loaded(int frameNo, PageID pid)
+{
+	int queue = QUEUE_HOT;
+	{
+		MutexGuard guard(ghostMutex);
+		int coldGhostCount = coldGhosts.Size();
+		int hotGhostCount = hotGhosts.Size();
+		if (coldGhosts.Remove(pid)) {
+			int delta = (hotGhostCount > coldGhostCount) ? hotGhostCount / coldGhostCount : 1;
+			target = (target + delta < numOfBuf) ? target + delta : numOfBuf;
+		} else if (hotGhosts.Remove(pid)) {
+			int delta = (coldGhostCount > hotGhostCount) ? coldGhostCount / hotGhostCount : 1;
+			target = (target - delta > 0) ? target - delta : 0;
+		} else {
+			queue = QUEUE_COLD;
+		}
+	}
+	history[frameNo].previous = 0;
+	history[frameNo].last = Now();
+	SetQueue(frameNo, queue);
+}
+
+void ARC::Evicted(int frameNo, PageID pid)
+{
+	{
+		MutexGuard guard(ghostMutex);
+		if (history[frameNo].queue == QUEUE_COLD)
+			coldGhosts.Push(pid);
+		else if (history[frameNo].queue == QUEUE_HOT)
+			hotGhosts.Push(pid);
+	}
+	SetQueue(frameNo, QUEUE_NONE);
+}
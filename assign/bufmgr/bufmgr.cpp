@@ -0,0 +1,1167 @@
+#include <algorithm>
+#include <cstring>
+
+#include "bufmgr.h"
+#include "system_defs.h"
+
+Mutex dbMutex;
+Mutex dbIOMutex;
+
+//	Read-ahead requests still out, which the buffer manager must not
+//	go away under.
+static volatile int fillsOut = 0;
+
+//	The frame the page cleaner looks at next.
+static int cleanHand = 0;
+
+volatile int BufMgr::noSwips[FRAME_SWIPS];
+
+//	The pages of the frames, frame i's at framePages + i.
+static Page *framePages = NULL;
+
+
+//-------------------------------------------------------------------
+// BufMgr::BufMgr
+//
+// Input   : bufsize - number of frames in the buffer pool.
+// Output  : None
+// Return  : None
+//-------------------------------------------------------------------
+BufMgr::BufMgr(int bufsize)
+{
+	numOfBuf = bufsize;
+	framePages = PageIO::AllocPages(numOfBuf);
+	frames = new ClockFrame *[numOfBuf];
+	for (int i = 0; i < numOfBuf; i++)
+		frames[i] = new ClockFrame(framePages + i);
+	replacer = new Clock(numOfBuf, frames);
+	partitions = new BufPartition[BUF_PARTITIONS];
+	for (int i = 0; i < BUF_PARTITIONS; i++)
+		partitions[i].hashTable.Reserve(numOfBuf / BUF_PARTITIONS + 1);
+	cleanHand = 0;
+	pageCleaner.Start(this);
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::~BufMgr
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Empty the log, give the pages held for allocation back to
+//           the database, write out the dirty pages and release the
+//           pool, once the cleaner has stopped and any read-ahead is
+//           in.  The log goes first, so that the pages freed while it
+//           was on are given back too.  No other thread may be using
+//           the buffer manager.
+//-------------------------------------------------------------------
+BufMgr::~BufMgr()
+{
+	pageCleaner.Stop();
+	while (fillsOut > 0)
+		YieldThread();
+	logMgr.Close();
+	{
+		MutexGuard guard(dbMutex);
+		spaceMap.Release();
+	}
+	FlushAllPages();
+	pageIO.Close();
+	for (int i = 0; i < numOfBuf; i++)
+		delete frames[i];
+	delete [] frames;
+	PageIO::FreePages(framePages);
+	framePages = NULL;
+	delete replacer;
+	delete [] partitions;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::SetReplacementPolicy
+//
+// Input   : policy - name of the policy, as NewReplacer takes it.
+// Output  : None
+// Return  : OK if successful, FAIL if the policy is unknown.
+// Purpose : Replace pages by another policy from now on.  SystemDefs
+//           builds the buffer manager with Clock and doesn't pass on
+//           its replacement_policy, so its callers pass the same name
+//           here.  The pages in the pool are handed to the new policy
+//           as if they had just been loaded.  No other thread may be
+//           using the buffer manager.
+//-------------------------------------------------------------------
+Status BufMgr::SetReplacementPolicy(const char *policy)
+{
+	Replacer *newReplacer = NewReplacer(policy, numOfBuf, frames);
+	if (newReplacer == NULL)
+		return FAIL;
+
+	delete replacer;
+	replacer = newReplacer;
+	for (int i = 0; i < numOfBuf; i++) {
+		if (frames[i]->IsValid())
+			replacer->Loaded(i, frames[i]->GetPageID());
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::SetReadOnly
+//
+// Input   : readOnly - whether to serve pages from a read-only mapping.
+// Output  : None
+// Return  : OK if successful, FAIL if a frame is pinned, a dirty page
+//           can't be written or the file can't be mapped.
+// Purpose : Switch between the frames and the mapping.  Pages in
+//           frames stay there, and are still current when the mapping
+//           goes, since nothing changes meanwhile.  No page of the
+//           mapping may be pinned when it goes.  No other thread may
+//           be using the buffer manager.
+//-------------------------------------------------------------------
+Status BufMgr::SetReadOnly(bool readOnly)
+{
+	if (readOnly == pageIO.IsMapped())
+		return OK;
+	if (!readOnly) {
+		pageIO.Unmap();
+		return OK;
+	}
+
+	while (fillsOut > 0)
+		YieldThread();
+	if (GetNumOfUnpinnedBuffers() != (unsigned)numOfBuf || FlushAllPages() != OK)
+		return FAIL;
+	return pageIO.Map() ? OK : FAIL;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::SetDirect
+//
+// Input   : direct - whether page I/O is to bypass the OS cache.
+// Output  : None
+// Return  : OK if successful, FAIL if a frame is pinned, a dirty page
+//           can't be written or the file is mapped.
+// Purpose : Reopen the file for direct I/O or not, once every read
+//           and write is in.  No other thread may be using the buffer
+//           manager.
+//-------------------------------------------------------------------
+Status BufMgr::SetDirect(bool direct)
+{
+	if (pageIO.IsMapped())
+		return FAIL;
+	while (fillsOut > 0)
+		YieldThread();
+	if (GetNumOfUnpinnedBuffers() != (unsigned)numOfBuf || FlushAllPages() != OK)
+		return FAIL;
+	pageIO.SetDirect(direct);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::ClaimFrame
+//
+// Input   : part - partition of the page that needs a frame, latched
+//                  exclusively.
+// Output  : frameNo - the frame claimed.
+// Return  : OK with the frame pinned once and holding no page, DONE
+//           if every frame is pinned, FAIL if a dirty victim can't be
+//           written.  While the cleaner runs, the first CLEANER_SKIPS
+//           dirty victims are passed over and the cleaner woken, so
+//           that a miss seldom waits for a write.
+// Purpose : Take a victim from the replacer and evict its page.  The
+//           page's partition guards the frame: the victim is only
+//           claimed under that partition's exclusive latch, where no
+//           new pins can happen.  A frame holding no page is guarded
+//           by the partition of its number.  Other partitions are
+//           only tried, since this one is already latched.
+//-------------------------------------------------------------------
+Status BufMgr::ClaimFrame(BufPartition &part, int &frameNo)
+{
+	int skipped = 0;
+	for (int tries = 0; tries < numOfBuf; tries++) {
+		frameNo = replacer->PickVictim();
+		if (frameNo == INVALID_FRAME)
+			return DONE;
+
+		ClockFrame *frame = frames[frameNo];
+		PageID victim = frame->GetPageID();
+		BufPartition &owner = (victim == INVALID_PAGE)
+			? partitions[frameNo % BUF_PARTITIONS] : Partition(victim);
+		if (&owner != &part && !owner.latch.TryLockExclusive())
+			continue;
+
+		// The frame may have changed hands since the replacer saw it.
+		Status s = DONE;
+		if (frame->IsDirty() && skipped < CLEANER_SKIPS && pageCleaner.IsRunning()) {
+			skipped++;
+			pageCleaner.Wake();
+		} else if (frame->HasPageID(victim) && frame->Claim()) {
+			s = OK;
+			if (victim != INVALID_PAGE) {
+				if (frame->IsDirty())
+					s = frame->Write();
+				if (s == OK) {
+					owner.hashTable.Delete(victim);
+					replacer->Evicted(frameNo, victim);
+					frame->EmptyIt();
+				} else {
+					frame->Unpin();
+				}
+			}
+		}
+
+		if (&owner != &part)
+			owner.latch.UnlockExclusive();
+		if (s != DONE)
+			return s;
+	}
+	return DONE;
+}
+
+
+//-------------------------------------------------------------------
+// FrameFill
+//
+// A read into frames, of pages that lie next to each other in the file;
+// when it completes, the buffer manager finishes the loads.  Read-ahead
+// allocates these and they delete themselves.
+//-------------------------------------------------------------------
+class FrameFill : public IORequest
+{
+	public :
+
+		FrameFill(BufMgr *bm, PageID first, bool owned) : bm(bm), owned(owned)
+		{
+			pid = first;
+			pages = run;
+			count = 0;
+		}
+
+		void Add(int frameNo, Page *framePage)
+		{
+			if (count == 0)
+				page = framePage;
+			frameNos[count] = frameNo;
+			run[count] = framePage;
+			count++;
+		}
+
+		void Complete()
+		{
+			for (int i = 0; i < count; i++)
+				bm->FinishLoad(frameNos[i], pid + i, status);
+			if (!owned) {
+				IORequest::Complete();
+				return;
+			}
+			delete this;
+			AtomicAdd(&fillsOut, -1);
+		}
+
+	private :
+
+		BufMgr *bm;
+		bool owned;
+		int frameNos[BUF_READAHEAD];
+		Page *run[BUF_READAHEAD];
+};
+
+//-------------------------------------------------------------------
+// BufMgr::StartLoad
+//
+// Input   : part - partition of pid, latched exclusively.
+//           pid - page to read.
+//           frameNo - frame claimed for it.
+// Output  : None
+// Return  : None
+// Purpose : Map the page to the frame before it is read, so that the
+//           partition can be let go during the read.  The claim's pin
+//           becomes the read's; threads that find the page meanwhile
+//           pin it and wait for FinishLoad.
+//-------------------------------------------------------------------
+void BufMgr::StartLoad(BufPartition &part, PageID pid, int frameNo)
+{
+	ClockFrame *frame = frames[frameNo];
+	frame->SetLoading(true);
+	frame->SetPageID(pid);
+	part.hashTable.Insert(pid, frameNo);
+	replacer->Loaded(frameNo, pid);
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::FinishLoad
+//
+// Input   : frameNo - frame StartLoad mapped pid to.
+//           pid - page read.
+//           s - how the read went.
+// Output  : None
+// Return  : None
+// Purpose : End the load and drop the read's pin.  A page that
+//           couldn't be read is dropped from the pool again.  Both
+//           happen under the partition latch, so that FreePage never
+//           finds the read's pin on a page that is no longer loading.
+//-------------------------------------------------------------------
+void BufMgr::FinishLoad(int frameNo, PageID pid, Status s)
+{
+	ClockFrame *frame = frames[frameNo];
+	BufPartition &part = Partition(pid);
+	if (s != OK) {
+		part.latch.LockExclusive();
+		part.hashTable.Delete(pid);
+		replacer->Freed(frameNo);
+		frame->EmptyIt();
+		frame->SetLoading(false);
+		frame->Unpin();
+		part.latch.UnlockExclusive();
+	} else {
+		part.latch.LockShared();
+		frame->SetImage(logMgr.IsLogging());
+		frame->SetLoading(false);
+		frame->Unpin();
+		part.latch.UnlockShared();
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::WaitForLoad
+//
+// Input   : pid - page the caller has pinned in frameNo.
+//           frameNo - its frame.
+// Output  : None
+// Return  : OK once the page is in the frame, FAIL with the caller's
+//           pin dropped if it couldn't be read.
+//-------------------------------------------------------------------
+Status BufMgr::WaitForLoad(PageID pid, int frameNo)
+{
+	ClockFrame *frame = frames[frameNo];
+	while (frame->IsLoading())
+		YieldThread();
+	if (!frame->HasPageID(pid)) {
+		frame->Unpin();
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::LoadPage
+//
+// Input   : part - partition of pid, not latched.
+//           pid - page to bring in.
+//           emptyPage - true if the page needn't be read from disk.
+//           pin - whether to pin the page for the caller.
+// Output  : frameNo - frame holding the page, pinned if pin is set.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Find or map the page with the partition latched
+//           exclusively, then read it without the latch, so that
+//           misses in one partition are read at once.  While every
+//           frame is pinned, wait for another thread to unpin one,
+//           without holding the latch.
+//-------------------------------------------------------------------
+Status BufMgr::LoadPage(BufPartition &part, PageID pid, bool emptyPage, int &frameNo, bool pin)
+{
+	for (int i = 0; ; i++) {
+		part.latch.LockExclusive();
+
+		// Another thread may have loaded it meanwhile.
+		frameNo = part.hashTable.LookUp(pid);
+		if (frameNo != INVALID_FRAME) {
+			if (pin)
+				frames[frameNo]->Pin();
+			replacer->Referenced(frameNo);
+			part.latch.UnlockExclusive();
+			AtomicAdd(&part.totalHit, 1);
+			return pin ? WaitForLoad(pid, frameNo) : OK;
+		}
+
+		Status s = ClaimFrame(part, frameNo);
+		if (s == OK) {
+			ClockFrame *frame = frames[frameNo];
+			if (emptyPage) {
+				frame->SetPageID(pid);
+				part.hashTable.Insert(pid, frameNo);
+				replacer->Loaded(frameNo, pid);
+				part.latch.UnlockExclusive();
+				return OK;
+			}
+			StartLoad(part, pid, frameNo);
+			if (pin)
+				frame->Pin();
+			part.latch.UnlockExclusive();
+			FrameFill fill(this, pid, false);
+			fill.Add(frameNo, frame->GetPage());
+			pageIO.Run(&fill);
+			return pin ? WaitForLoad(pid, frameNo) : OK;
+		}
+
+		part.latch.UnlockExclusive();
+		if (s != DONE || i == PIN_RETRIES)
+			return FAIL;
+		SleepMicros(PIN_RETRY_MICROS);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::ReserveFrame
+//
+// Input   : pid - page to read ahead.
+// Output  : frameNo - the frame it is to be read into.
+// Return  : OK if the page was mapped to frameNo, DONE if it is in the
+//           pool already, FAIL if no frame could be had for it.
+// Purpose : Claim a frame for a page read ahead and start its load.
+//-------------------------------------------------------------------
+Status BufMgr::ReserveFrame(PageID pid, int &frameNo)
+{
+	BufPartition &part = Partition(pid);
+	part.latch.LockShared();
+	frameNo = part.hashTable.LookUp(pid);
+	part.latch.UnlockShared();
+	if (frameNo != INVALID_FRAME)
+		return DONE;
+
+	part.latch.LockExclusive();
+	if (part.hashTable.LookUp(pid) != INVALID_FRAME) {
+		part.latch.UnlockExclusive();
+		return DONE;
+	}
+	if (ClaimFrame(part, frameNo) != OK) {
+		part.latch.UnlockExclusive();
+		return FAIL;
+	}
+	StartLoad(part, pid, frameNo);
+	part.latch.UnlockExclusive();
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::Prefetch
+//
+// Input   : pid - first page that will be needed soon.
+//           howmany - pages from pid on, up to BUF_READAHEAD.
+// Output  : None
+// Return  : OK if the pages are in the pool or being read, DONE if
+//           not all could be read ahead, FAIL if pid is invalid.
+// Purpose : Start reading pages into the pool without waiting for them
+//           or pinning them.  The reads are handed to PageIO's threads,
+//           so the caller goes on with the page it has.  Pages not in
+//           the pool that lie next to each other are read with one
+//           request.  Pages past the end of the database are left out.
+//           Read-only pages are left to the OS to read ahead.
+//-------------------------------------------------------------------
+Status BufMgr::Prefetch(PageID pid, int howmany)
+{
+	if (pid == INVALID_PAGE)
+		return FAIL;
+	if (pageIO.IsMapped()) {
+		pageIO.WillNeed(pid, std::min(howmany, BUF_READAHEAD));
+		return OK;
+	}
+	if (pageIO.GetThreads() == 0)
+		return DONE;
+	howmany = std::min(std::min(howmany, BUF_READAHEAD), MINIBASE_DB->GetNumOfPages() - pid);
+
+	Status result = OK;
+	FrameFill *fill = NULL;
+	for (int i = 0; i < howmany; i++) {
+		int frameNo;
+		Status s = ReserveFrame(pid + i, frameNo);
+		if (s == OK) {
+			if (fill == NULL) {
+				AtomicAdd(&fillsOut, 1);
+				fill = new FrameFill(this, pid + i, true);
+			}
+			fill->Add(frameNo, frames[frameNo]->GetPage());
+			continue;
+		}
+		if (fill != NULL) {
+			pageIO.Submit(fill);
+			fill = NULL;
+		}
+		if (s != DONE) {
+			result = DONE;
+			break;
+		}
+	}
+	if (fill != NULL)
+		pageIO.Submit(fill);
+	return result;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::PinPage
+//
+// Input   : pid - page to pin.
+//           emptyPage - true if the page needn't be read from disk.
+// Output  : page - the page in the buffer pool.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Pin a page, loading it if it isn't in the pool.  A hit
+//           only takes the partition's latch shared.  A read-only
+//           page is the one in the mapping, and always a hit.
+//-------------------------------------------------------------------
+Status BufMgr::PinPage(PageID pid, Page*& page, bool emptyPage)
+{
+	if (pid == INVALID_PAGE)
+		return FAIL;
+
+	BufPartition &part = Partition(pid);
+	AtomicAdd(&part.totalCall, 1);
+
+	if (pageIO.IsMapped()) {
+		page = pageIO.MappedPage(pid);
+		if (page == NULL || emptyPage)
+			return FAIL;
+		AtomicAdd(&part.totalHit, 1);
+		return OK;
+	}
+
+	part.latch.LockShared();
+	int frameNo = part.hashTable.LookUp(pid);
+	if (frameNo != INVALID_FRAME) {
+		frames[frameNo]->Pin();
+		replacer->Referenced(frameNo);
+		part.latch.UnlockShared();
+		AtomicAdd(&part.totalHit, 1);
+		if (frames[frameNo]->IsLoading() && WaitForLoad(pid, frameNo) != OK)
+			return FAIL;
+		page = frames[frameNo]->GetPage();
+		return OK;
+	}
+	part.latch.UnlockShared();
+
+	Status s = LoadPage(part, pid, emptyPage, frameNo);
+	if (s != OK)
+		return s;
+	page = frames[frameNo]->GetPage();
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::UnpinPage
+//
+// Input   : pid - page to unpin.
+//           dirty - true if the caller changed the page.
+//           hate - true if the caller won't use the page again soon;
+//                  the replacer then takes it before pages in use.
+// Output  : None
+// Return  : OK if successful, FAIL if the page isn't pinned.
+//-------------------------------------------------------------------
+Status BufMgr::UnpinPage(PageID pid, bool dirty)
+{
+	return UnpinPage(pid, dirty, false);
+}
+
+Status BufMgr::UnpinPage(PageID pid, bool dirty, bool hate)
+{
+	if (pageIO.IsMapped())
+		return (pageIO.MappedPage(pid) != NULL && !dirty) ? OK : FAIL;
+	if (dirty && LogPages(&pid, 1) != OK)
+		return FAIL;
+
+	BufPartition &part = Partition(pid);
+	bool unpinned = false;
+
+	// The shared latch keeps the frame from being evicted before it
+	// is marked dirty.
+	part.latch.LockShared();
+	int frameNo = part.hashTable.LookUp(pid);
+	if (frameNo != INVALID_FRAME) {
+		unpinned = frames[frameNo]->Unpin();
+		if (unpinned && dirty)
+			Dirty(frames[frameNo]);
+		if (unpinned && hate)
+			replacer->Hated(frameNo);
+	}
+	part.latch.UnlockShared();
+	return unpinned ? OK : FAIL;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::DirtyPage
+//
+// Input   : pid - a page the caller has pinned.
+// Output  : None
+// Return  : OK if successful, FAIL if the page isn't pinned.
+// Purpose : Mark a page dirty without unpinning it.
+//-------------------------------------------------------------------
+Status BufMgr::DirtyPage(PageID pid)
+{
+	if (pageIO.IsMapped() || LogPages(&pid, 1) != OK)
+		return FAIL;
+
+	BufPartition &part = Partition(pid);
+	bool pinned = false;
+
+	part.latch.LockShared();
+	int frameNo = part.hashTable.LookUp(pid);
+	if (frameNo != INVALID_FRAME && frames[frameNo]->GetPinCount() > 0) {
+		Dirty(frames[frameNo]);
+		pinned = true;
+	}
+	part.latch.UnlockShared();
+	return pinned ? OK : FAIL;
+}
+
+
+//	A page changed while nothing is logged loses its image, which would
+//	leave changes out of the log if logging started again.
+void BufMgr::Dirty(ClockFrame *frame)
+{
+	if (!logMgr.IsLogging())
+		frame->SetImage(false);
+	frame->DirtyIt();
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::LogPages
+//
+// Input   : pids - pages the caller has pinned and changed.
+//           count - how many, up to LOG_GROUP_PAGES.
+// Output  : None
+// Return  : OK if successful, FAIL if a page isn't pinned or there
+//           are too many.
+// Purpose : Log the changes made to the pages since they were last
+//           logged as one group, and keep the pages as they are now
+//           as their images, to be written out in their place.  The
+//           caller's latches on the pages keep them from changing
+//           meanwhile.  An image isn't replaced while it is written.
+//-------------------------------------------------------------------
+Status BufMgr::LogPages(const PageID *pids, int count)
+{
+	if (!logMgr.IsLogging())
+		return OK;
+	if (count > LOG_GROUP_PAGES)
+		return FAIL;
+
+	char changes[LOG_GROUP_PAGES * LOG_PAGE_BYTES];
+	int logged[LOG_GROUP_PAGES];
+	int numLogged = 0;
+	int length = 0;
+	for (int i = 0; i < count; i++) {
+		BufPartition &part = Partition(pids[i]);
+		part.latch.LockShared();
+		int frameNo = part.hashTable.LookUp(pids[i]);
+		bool pinned = (frameNo != INVALID_FRAME && frames[frameNo]->GetPinCount() > 0);
+		part.latch.UnlockShared();
+		if (!pinned)
+			return FAIL;
+
+		ClockFrame *frame = frames[frameNo];
+		int n = LogMgr::Encode(pids[i], frame->GetPage(), frame->GetImage(), changes + length);
+		if (n > 0) {
+			logged[numLogged++] = frameNo;
+			length += n;
+		}
+	}
+	if (length == 0)
+		return OK;
+
+	LSN end = logMgr.Append(changes, length);
+	for (int i = 0; i < numLogged; i++) {
+		ClockFrame *frame = frames[logged[i]];
+		BufPartition &part = Partition(frame->GetPageID());
+		part.latch.LockExclusive();
+		while (frame->IsWriting()) {
+			part.latch.UnlockExclusive();
+			YieldThread();
+			part.latch.LockExclusive();
+		}
+		frame->SetImage(true);
+		frame->SetLSN(end);
+		part.latch.UnlockExclusive();
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::CopyPage
+//
+// Input   : pid - page to copy.
+// Output  : copy - the page's contents.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Copy a page under its partition's latch.  A page that has
+//           to be loaded is read without being pinned for the copy,
+//           so FreePage never finds a pin of a copy.
+//-------------------------------------------------------------------
+Status BufMgr::CopyPage(PageID pid, Page *copy)
+{
+	int frameNo = INVALID_FRAME;
+	return CopyPage(pid, copy, frameNo);
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::CopyPage
+//
+// Input   : pid - page to copy.
+//           frameNo - the frame pid was last found in, or INVALID_FRAME.
+// Output  : copy - the page's contents.
+//           frameNo - the frame pid was copied from.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Copy a page straight from the frame given if it still
+//           holds it.  A frame's page id changes before its contents
+//           do when it is given another page, so a copy taken between
+//           two checks of the page id is of pid; whether the page was
+//           changed in place meanwhile is for its version to tell, as
+//           with any copy.  Such copies aren't counted in the stats.
+//-------------------------------------------------------------------
+Status BufMgr::CopyPage(PageID pid, Page *copy, int &frameNo)
+{
+	if (pid == INVALID_PAGE)
+		return FAIL;
+
+	if (pageIO.IsMapped()) {
+		Page *page = pageIO.MappedPage(pid);
+		if (page == NULL)
+			return FAIL;
+		memcpy((char *)copy, (char *)page, sizeof(Page));
+		frameNo = INVALID_FRAME;
+		return OK;
+	}
+
+	if (frameNo >= 0 && frameNo < numOfBuf) {
+		ClockFrame *frame = frames[frameNo];
+		if (frame->HasPageID(pid) && !frame->IsLoading()) {
+			memcpy((char *)copy, (char *)frame->GetPage(), sizeof(Page));
+			MemoryFence();
+			if (frame->HasPageID(pid) && !frame->IsLoading()) {
+				replacer->Referenced(frameNo);
+				return OK;
+			}
+		}
+	}
+
+	BufPartition &part = Partition(pid);
+	AtomicAdd(&part.totalCall, 1);
+
+	// Copy once the page is in; it may be evicted again before that.
+	for (bool first = true; ; first = false) {
+		part.latch.LockShared();
+		frameNo = part.hashTable.LookUp(pid);
+		bool loading = (frameNo != INVALID_FRAME && frames[frameNo]->IsLoading());
+		if (frameNo != INVALID_FRAME && !loading) {
+			memcpy((char *)copy, (char *)frames[frameNo]->GetPage(), sizeof(Page));
+			replacer->Referenced(frameNo);
+			part.latch.UnlockShared();
+			if (first)
+				AtomicAdd(&part.totalHit, 1);
+			return OK;
+		}
+		part.latch.UnlockShared();
+
+		if (loading) {
+			YieldThread();
+			continue;
+		}
+		Status s = LoadPage(part, pid, false, frameNo, false);
+		if (s != OK)
+			return s;
+	}
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::NewPage
+//
+// Input   : howmany - number of consecutive pages to allocate.
+//           near - a page to allocate after, or INVALID_PAGE.
+//           owner - whose extents to allocate from.
+// Output  : pid - the first page allocated.
+//           firstpage - the first page, pinned.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Allocate the pages through the space map, which takes
+//           them from the database an extent at a time.
+//-------------------------------------------------------------------
+Status BufMgr::NewPage(PageID& pid, Page*& firstpage, int howmany)
+{
+	return NewPage(pid, firstpage, howmany, INVALID_PAGE, SPACE_NO_OWNER);
+}
+
+Status BufMgr::NewPage(PageID& pid, Page*& firstpage, int howmany, PageID near, int owner)
+{
+	if (pageIO.IsMapped())
+		return FAIL;
+
+	Status s;
+	{
+		MutexGuard guard(dbMutex);
+		s = spaceMap.Allocate(pid, howmany, near, owner);
+	}
+	if (s != OK)
+		return FAIL;
+
+	s = PinPage(pid, firstpage, true);
+	if (s != OK) {
+		MutexGuard guard(dbMutex);
+		spaceMap.Free(pid, howmany);
+		return FAIL;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::FreePage
+//
+// Input   : pid - page to free.
+// Output  : None
+// Return  : OK if successful, FAIL if another pin than the caller's
+//           is held on the page.
+// Purpose : Drop the page from the pool, with the caller's pin, and
+//           give it back to the space map.  The cleaner's pin is
+//           waited out.
+//-------------------------------------------------------------------
+Status BufMgr::FreePage(PageID pid)
+{
+	if (pageIO.IsMapped())
+		return FAIL;
+
+	BufPartition &part = Partition(pid);
+
+	part.latch.LockExclusive();
+	int frameNo = part.hashTable.LookUp(pid);
+	while (frameNo != INVALID_FRAME && frames[frameNo]->IsWriting()) {
+		part.latch.UnlockExclusive();
+		YieldThread();
+		part.latch.LockExclusive();
+		frameNo = part.hashTable.LookUp(pid);
+	}
+	if (frameNo != INVALID_FRAME) {
+		ClockFrame *frame = frames[frameNo];
+		int pins = frame->GetPinCount();
+		if (pins > 1) {
+			part.latch.UnlockExclusive();
+			return FAIL;
+		}
+		if (pins == 1)
+			frame->Unpin();
+		part.hashTable.Delete(pid);
+		replacer->Freed(frameNo);
+		frame->EmptyIt();
+	}
+	part.latch.UnlockExclusive();
+
+	MutexGuard guard(dbMutex);
+	return spaceMap.Free(pid, 1);
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::FlushPage
+//
+// Input   : pid - page to write out.
+// Output  : None
+// Return  : OK if successful, FAIL if the page isn't in the pool or
+//           can't be written.  A read-only page is always written.
+//-------------------------------------------------------------------
+Status BufMgr::FlushPage(PageID pid)
+{
+	if (pageIO.IsMapped())
+		return (pageIO.MappedPage(pid) != NULL) ? OK : FAIL;
+
+	BufPartition &part = Partition(pid);
+	Status s = FAIL;
+
+	part.latch.LockExclusive();
+	int frameNo = part.hashTable.LookUp(pid);
+	if (frameNo != INVALID_FRAME)
+		s = frames[frameNo]->IsDirty() ? frames[frameNo]->Write() : OK;
+	part.latch.UnlockExclusive();
+	return s;
+}
+
+
+//	A page taken to be written, to be sorted by page id.
+struct FrameRef
+{
+	PageID pid;
+	int frameNo;
+
+	bool operator<(const FrameRef &other) const { return pid < other.pid; }
+};
+
+//-------------------------------------------------------------------
+// BufMgr::FlushAllPages
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if a page can't be written.
+// Purpose : Write out every dirty page, pinned or not, and wait for
+//           the writes other threads have out, so that every change
+//           made before the call is in the file once it returns.  A
+//           write out already may be older than the page's last
+//           change, so it is waited for before the page is taken;
+//           and a cleaner batch or an eviction may take the dirty bit
+//           after the page is looked at, so all frames are waited for
+//           at the end.  A checkpoint relies on this to empty the log.
+//-------------------------------------------------------------------
+Status BufMgr::FlushAllPages()
+{
+	FrameRef *taken = new FrameRef[numOfBuf];
+	int count = 0;
+	for (int i = 0; i < numOfBuf; i++) {
+		while (frames[i]->IsWriting())
+			YieldThread();
+		if (TakeForWrite(i, false, taken[count]))
+			count++;
+	}
+	Status s = WriteTaken(taken, count);
+	delete [] taken;
+	for (int i = 0; i < numOfBuf; i++) {
+		while (frames[i]->IsWriting())
+			YieldThread();
+	}
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::DiscardAllPages
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if a page is pinned.
+// Purpose : Drop every page from the pool without writing it, with the
+//           log not yet written and the pages held for allocation, as
+//           if the process had died: for tests of recovery, which
+//           then open an index to replay the log.  No other thread
+//           may be using the buffer manager.
+//-------------------------------------------------------------------
+Status BufMgr::DiscardAllPages()
+{
+	if (GetNumOfUnpinnedBuffers() != (unsigned)numOfBuf)
+		return FAIL;
+	pageCleaner.Stop();
+	while (fillsOut > 0)
+		YieldThread();
+
+	for (int i = 0; i < numOfBuf; i++) {
+		ClockFrame *frame = frames[i];
+		PageID pid = frame->GetPageID();
+		if (pid == INVALID_PAGE)
+			continue;
+		BufPartition &part = Partition(pid);
+		part.latch.LockExclusive();
+		part.hashTable.Delete(pid);
+		replacer->Freed(i);
+		frame->EmptyIt();
+		part.latch.UnlockExclusive();
+	}
+	logMgr.Discard();
+	{
+		MutexGuard guard(dbMutex);
+		spaceMap.Discard();
+	}
+	pageCleaner.Start(this);
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::CleanPages
+//
+// Input   : keepDirty - unpinned dirty pages that may be left.
+// Output  : None
+// Return  : The number of pages written.
+// Purpose : Take unpinned dirty pages from where the last call left
+//           off and write them.
+//-------------------------------------------------------------------
+int BufMgr::CleanPages(int keepDirty)
+{
+	if (minibase_globals == NULL || MINIBASE_DB == NULL)
+		return 0;
+
+	int dirty = 0;
+	for (int i = 0; i < numOfBuf; i++) {
+		if (frames[i]->IsDirty() && frames[i]->NotPinned())
+			dirty++;
+	}
+	// Taken pages are pinned until written, so a batch leaves most of
+	// the pool to misses.
+	int wanted = std::min(dirty - keepDirty, std::min(CLEANER_BATCH, numOfBuf / 8 + 1));
+	if (wanted <= 0)
+		return 0;
+
+	FrameRef taken[CLEANER_BATCH];
+	int count = 0;
+	for (int n = 0; n < numOfBuf && count < wanted; n++) {
+		int i = cleanHand;
+		cleanHand = (cleanHand + 1) % numOfBuf;
+		if (TakeForWrite(i, true, taken[count]))
+			count++;
+	}
+	WriteTaken(taken, count);
+	return count;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::TakeForWrite
+//
+// Input   : frameNo - frame to look at.
+//           unpinnedOnly - whether to pass over a pinned page.
+// Output  : taken - the page and frame, if taken.
+// Return  : true if the page in the frame was dirty and is taken.
+// Purpose : Pin a dirty page and mark it writing, so it can't be
+//           evicted while it is written and FreePage waits for it.
+//           Its dirty bit is cleared once it is marked, so a change
+//           made while it is written marks it dirty again.  A page
+//           being loaded or written already isn't taken.
+//-------------------------------------------------------------------
+bool BufMgr::TakeForWrite(int frameNo, bool unpinnedOnly, FrameRef &taken)
+{
+	ClockFrame *frame = frames[frameNo];
+	PageID pid = frame->GetPageID();
+	if (pid == INVALID_PAGE || !frame->IsDirty() || (unpinnedOnly && !frame->NotPinned()))
+		return false;
+
+	BufPartition &part = Partition(pid);
+	part.latch.LockShared();
+	bool take = frame->HasPageID(pid) && !frame->IsLoading() && !frame->IsWriting()
+		&& (!unpinnedOnly || frame->NotPinned());
+	if (take) {
+		frame->SetWriting(true);
+		take = frame->TakeDirty();
+		if (take)
+			frame->Pin();
+		else
+			frame->SetWriting(false);
+	}
+	part.latch.UnlockShared();
+
+	taken.pid = pid;
+	taken.frameNo = frameNo;
+	return take;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::WriteTaken
+//
+// Input   : taken - pages TakeForWrite took.
+//           count - how many.
+// Output  : None
+// Return  : OK if successful, FAIL if a page can't be written.
+// Purpose : Write the pages in order of page id, pages that lie next
+//           to each other in the file with one request, all handed to
+//           PageIO at once and then waited for, once the log of them
+//           is on disk.  A page that can't be written is marked dirty
+//           again.  Each is let go under its partition latch, as with
+//           a load.
+//-------------------------------------------------------------------
+Status BufMgr::WriteTaken(FrameRef *taken, int count)
+{
+	LSN lsn = 0;
+	for (int i = 0; i < count; i++)
+		lsn = std::max(lsn, frames[taken[i].frameNo]->GetLSN());
+	if (logMgr.Force(lsn) != OK) {
+		for (int i = 0; i < count; i++) {
+			ClockFrame *frame = frames[taken[i].frameNo];
+			BufPartition &part = Partition(taken[i].pid);
+			part.latch.LockShared();
+			frame->DirtyIt();
+			frame->SetWriting(false);
+			frame->Unpin();
+			part.latch.UnlockShared();
+		}
+		return FAIL;
+	}
+
+	std::sort(taken, taken + count);
+	IORequest *writes = new IORequest[count];
+	Page **pages = new Page *[count];
+	int numWrites = 0;
+
+	for (int start = 0, end; start < count; start = end) {
+		pages[start] = frames[taken[start].frameNo]->GetLoggedPage();
+		for (end = start + 1; end < count && taken[end].pid == taken[end - 1].pid + 1; end++)
+			pages[end] = frames[taken[end].frameNo]->GetLoggedPage();
+
+		IORequest &w = writes[numWrites++];
+		w.pid = taken[start].pid;
+		w.page = pages[start];
+		w.pages = pages + start;
+		w.count = end - start;
+		w.write = true;
+		pageIO.Submit(&w);
+	}
+
+	Status result = OK;
+	for (int n = 0, start = 0; n < numWrites; start += writes[n].count, n++) {
+		pageIO.Wait(&writes[n]);
+		if (writes[n].status != OK)
+			result = FAIL;
+		for (int i = start; i < start + writes[n].count; i++) {
+			ClockFrame *frame = frames[taken[i].frameNo];
+			BufPartition &part = Partition(taken[i].pid);
+			part.latch.LockShared();
+			if (writes[n].status != OK)
+				frame->DirtyIt();
+			frame->SetWriting(false);
+			frame->Unpin();
+			part.latch.UnlockShared();
+		}
+	}
+	delete [] writes;
+	delete [] pages;
+	return result;
+}
+
+
+//-------------------------------------------------------------------
+// BufMgr::GetStat
+//
+// Input   : None
+// Output  : pinNo - pins since the last ResetStat.
+//           missNo - those that had to load the page.
+// Return  : OK
+//-------------------------------------------------------------------
+Status BufMgr::GetStat(long& pinNo, long& missNo)
+{
+	long calls = 0, hits = 0;
+	for (int i = 0; i < BUF_PARTITIONS; i++) {
+		calls += partitions[i].totalCall;
+		hits += partitions[i].totalHit;
+	}
+	pinNo = calls;
+	missNo = calls - hits;
+	return OK;
+}
+
+void BufMgr::ResetStat()
+{
+	for (int i = 0; i < BUF_PARTITIONS; i++) {
+		partitions[i].totalCall = 0;
+		partitions[i].totalHit = 0;
+	}
+}
+
+
+unsigned int BufMgr::GetNumOfBuffers()
+{
+	return numOfBuf;
+}
+
+//	Only a snapshot while other threads pin and unpin.
+unsigned int BufMgr::GetNumOfUnpinnedBuffers()
+{
+	unsigned int count = 0;
+	for (int i = 0; i < numOfBuf; i++) {
+		if (frames[i]->NotPinned())
+			count++;
+	}
+	return count;
+}
@@ -0,0 +1,125 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif
+
+#include "cleaner.h"
+#include "bufmgr.h"
+
+PageCleaner pageCleaner;
+
+
+//-------------------------------------------------------------------
+// PageCleaner
+//-------------------------------------------------------------------
+
+PageCleaner::PageCleaner()
+	: bm(NULL), woken(0), stopping(0), running(false), enabled(true)
+{
+}
+
+PageCleaner::~PageCleaner()
+{
+	Stop();
+}
+
+#ifdef _WIN32
+
+static DWORD WINAPI RunCleaner(LPVOID cleaner)
+{
+	PageCleaner::Worker(cleaner);
+	return 0;
+}
+
+#endif
+
+
+//-------------------------------------------------------------------
+// PageCleaner::Start
+//
+// Input   : bm - the buffer manager to clean.
+// Output  : None
+// Return  : None
+// Purpose : Start the thread, if the cleaner is enabled and not
+//           running already.
+//-------------------------------------------------------------------
+void PageCleaner::Start(BufMgr *bm)
+{
+	if (running || !enabled)
+		return;
+
+	this->bm = bm;
+	woken = 0;
+	stopping = 0;
+#ifdef _WIN32
+	thread = CreateThread(NULL, 0, RunCleaner, this, 0, NULL);
+	running = (thread != NULL);
+#else
+	running = (pthread_create(&thread, NULL, Worker, this) == 0);
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// PageCleaner::Stop
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Stop the thread and wait for it, with any write it has
+//           out.  The pages it hasn't got to stay dirty.
+//-------------------------------------------------------------------
+void PageCleaner::Stop()
+{
+	if (!running)
+		return;
+
+	stopping = 1;
+#ifdef _WIN32
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+	running = false;
+	bm = NULL;
+}
+
+
+//-------------------------------------------------------------------
+// PageCleaner::Run
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Sleep for an interval or until woken, then have the
+//           buffer manager write pages a batch at a time, at most as
+//           many as the pool has frames.
+//-------------------------------------------------------------------
+void PageCleaner::Run()
+{
+	int numOfBuf = bm->GetNumOfBuffers();
+
+	while (!stopping) {
+		for (int waited = 0; !woken && !stopping && waited < CLEANER_INTERVAL_MICROS;
+			 waited += CLEANER_POLL_MICROS)
+			SleepMicros(CLEANER_POLL_MICROS);
+		if (stopping)
+			break;
+
+		int keepDirty = woken ? 0 : numOfBuf * CLEANER_DIRTY_PERCENT / 100;
+		woken = 0;
+		for (int written = 0; written < numOfBuf && !stopping; ) {
+			int n = bm->CleanPages(keepDirty);
+			if (n == 0)
+				break;
+			written += n;
+		}
+	}
+}
+
+void *PageCleaner::Worker(void *cleaner)
+{
+	((PageCleaner *)cleaner)->Run();
+	return NULL;
+}
@@ -0,0 +1,246 @@
+#include <cstring>
+
+#include "frame.h"
+#include "clockframe.h"
+#include "latch.h"
+#include "bufmgr.h"
+#include "system_defs.h"
+#include "pageio.h"
+
+
+//-------------------------------------------------------------------
+// Frame
+//-------------------------------------------------------------------
+
+Frame::Frame(Page *data)
+	: pid(INVALID_PAGE), data(data), pinCount(0), dirty(false), loading(0), writing(0),
+	  image(NULL), imageValid(false), lsn(0)
+{
+	for (int i = 0; i < FRAME_SWIPS; i++)
+		swips[i] = INVALID_FRAME;
+}
+
+Frame::~Frame()
+{
+	PageIO::FreePages(image);
+}
+
+void Frame::Pin()
+{
+	AtomicAdd(&pinCount, 1);
+}
+
+//	Returns false, changing nothing, if the frame wasn't pinned.
+bool Frame::Unpin()
+{
+	for (;;) {
+		int count = pinCount;
+		if (count <= 0)
+			return false;
+		if (AtomicCompareAndSwap(&pinCount, count, count - 1))
+			return true;
+	}
+}
+
+//	Pins the frame if nobody has it pinned.  Only done under the
+//	exclusive latch of the partition guarding the frame, which keeps
+//	out new pins; see BufMgr::ClaimFrame.
+bool Frame::Claim()
+{
+	return AtomicCompareAndSwap(&pinCount, 0, 1);
+}
+
+//	Leaves the frame pinned by whoever claimed it.  The page id goes
+//	before anything else of the page's can change; see BufMgr::CopyPage.
+void Frame::EmptyIt()
+{
+	pid = INVALID_PAGE;
+	dirty = false;
+	imageValid = false;
+	lsn = 0;
+	MemoryFence();
+}
+
+void Frame::DirtyIt()
+{
+	dirty = true;
+}
+
+//	Clears the dirty bit before the page is written, so that a change
+//	made while the write is out marks the page dirty again.
+bool Frame::TakeDirty()
+{
+	bool wasDirty = dirty;
+	dirty = false;
+	return wasDirty;
+}
+
+//	The page has to be in the frame before loading is cleared.
+void Frame::SetLoading(bool l)
+{
+	MemoryFence();
+	loading = l;
+	MemoryFence();
+}
+
+bool Frame::IsLoading()
+{
+	return loading != 0;
+}
+
+//	Counts the writes out, since FlushPage may write a page the cleaner
+//	is writing too.  A write is counted before the dirty bit is taken,
+//	so a page never looks clean and not writing while its write is
+//	out; see BufMgr::FlushAllPages.
+void Frame::SetWriting(bool w)
+{
+	AtomicAdd(&writing, w ? 1 : -1);
+}
+
+bool Frame::IsWriting()
+{
+	return writing != 0;
+}
+
+void Frame::SetPageID(PageID p)
+{
+	pid = p;
+}
+
+bool Frame::IsDirty()
+{
+	return dirty;
+}
+
+bool Frame::IsValid()
+{
+	return pid != INVALID_PAGE;
+}
+
+//	The frame is clean unless the write fails.  The log goes first.
+Status Frame::Write()
+{
+	if (logMgr.Force(lsn) != OK)
+		return FAIL;
+	SetWriting(true);
+	TakeDirty();
+	Status s = pageIO.Write(pid, GetLoggedPage());
+	if (s != OK)
+		dirty = true;
+	SetWriting(false);
+	return s;
+}
+
+bool Frame::NotPinned()
+{
+	return pinCount == 0;
+}
+
+int Frame::GetPinCount()
+{
+	return pinCount;
+}
+
+bool Frame::HasPageID(PageID p)
+{
+	return pid == p;
+}
+
+PageID Frame::GetPageID()
+{
+	return pid;
+}
+
+Page *Frame::GetPage()
+{
+	return data;
+}
+
+//	Not cleared when the page changes: they are only hints.
+volatile int *Frame::GetSwips()
+{
+	return swips;
+}
+
+//	NULL if the page hasn't been logged or read since the log was on.
+Page *Frame::GetImage()
+{
+	return imageValid ? image : NULL;
+}
+
+//	Takes the page as it is now as its image, or forgets the image.
+//	Not while the frame is being written.  The image is written in
+//	place of the page, so it is aligned for direct I/O as well.
+void Frame::SetImage(bool valid)
+{
+	if (valid) {
+		if (image == NULL)
+			image = PageIO::AllocPages(1);
+		memcpy((char *)image, (char *)data, MINIBASE_PAGESIZE);
+	}
+	imageValid = valid;
+}
+
+//	What is written out: the image while the log is on, since the page
+//	itself may hold changes that are half made and not logged yet.
+Page *Frame::GetLoggedPage()
+{
+	return (imageValid && logMgr.IsLogging()) ? image : data;
+}
+
+LSN Frame::GetLSN()
+{
+	return lsn;
+}
+
+void Frame::SetLSN(LSN l)
+{
+	lsn = l;
+}
+
+
+//-------------------------------------------------------------------
+// ClockFrame
+//
+// The reference bit is set by every pin and unpin, and cleared by
+// the clock hand passing an unpinned frame.
+//-------------------------------------------------------------------
+
+ClockFrame::ClockFrame(Page *data) : Frame(data), referenced(false)
+{
+}
+
+ClockFrame::~ClockFrame()
+{
+}
+
+void ClockFrame::Pin()
+{
+	Frame::Pin();
+	if (!referenced)
+		referenced = true;
+}
+
+bool ClockFrame::Unpin()
+{
+	if (!Frame::Unpin())
+		return false;
+	if (!referenced)
+		referenced = true;
+	return true;
+}
+
+void ClockFrame::UnsetReferenced()
+{
+	referenced = false;
+}
+
+bool ClockFrame::IsReferenced()
+{
+	return referenced;
+}
+
+bool ClockFrame::IsVictim()
+{
+	return NotPinned() && !referenced;
+}
@@ -0,0 +1,126 @@
+#include "hash.h"
+
+
+HashTable::HashTable() : slots(NULL), mask(0), count(0)
+{
+	Resize(HASH_MIN_SLOTS);
+}
+
+HashTable::~HashTable()
+{
+	delete [] slots;
+}
+
+
+//-------------------------------------------------------------------
+// HashTable::Resize
+//
+// Input   : numSlots - new size of the table, a power of two that
+//                      holds every entry at most half full.
+// Output  : None
+// Return  : None
+// Purpose : Move every entry to a new table of numSlots slots.
+//-------------------------------------------------------------------
+void HashTable::Resize(unsigned numSlots)
+{
+	Slot *old = slots;
+	unsigned oldSize = (old == NULL) ? 0 : mask + 1;
+
+	slots = new Slot[numSlots];
+	mask = numSlots - 1;
+	shift = 32;
+	for (unsigned n = numSlots; n > 1; n >>= 1)
+		shift--;
+	for (unsigned i = 0; i < numSlots; i++)
+		slots[i].pid = INVALID_PAGE;
+
+	for (unsigned i = 0; i < oldSize; i++) {
+		if (old[i].pid == INVALID_PAGE)
+			continue;
+		unsigned s = Home(old[i].pid);
+		while (slots[s].pid != INVALID_PAGE)
+			s = (s + 1) & mask;
+		slots[s] = old[i];
+	}
+	delete [] old;
+}
+
+void HashTable::Reserve(int entries)
+{
+	unsigned numSlots = mask + 1;
+	while (numSlots < 2 * (unsigned)entries)
+		numSlots *= 2;
+	if (numSlots != mask + 1)
+		Resize(numSlots);
+}
+
+
+//-------------------------------------------------------------------
+// HashTable::Insert
+//
+// Input   : pid - page to map, which must not be in the table yet.
+//           frameNo - frame holding it.
+// Output  : None
+// Return  : None
+//-------------------------------------------------------------------
+void HashTable::Insert(PageID pid, int frameNo)
+{
+	if (2 * (unsigned)(count + 1) > mask + 1)
+		Resize(2 * (mask + 1));
+
+	unsigned s = Home(pid);
+	while (slots[s].pid != INVALID_PAGE)
+		s = (s + 1) & mask;
+	slots[s].pid = pid;
+	slots[s].frameNo = frameNo;
+	count++;
+}
+
+
+//-------------------------------------------------------------------
+// HashTable::Delete
+//
+// Input   : pid - page to unmap.
+// Output  : None
+// Return  : OK if successful, FAIL if pid isn't in the table.
+// Purpose : Empty pid's slot, then move back each later entry of the
+//           run whose home slot doesn't lie between the hole and
+//           itself, so that no lookup finds a gap before its entry.
+//-------------------------------------------------------------------
+Status HashTable::Delete(PageID pid)
+{
+	unsigned hole = Home(pid);
+	while (slots[hole].pid != pid) {
+		if (slots[hole].pid == INVALID_PAGE)
+			return FAIL;
+		hole = (hole + 1) & mask;
+	}
+
+	for (unsigned s = (hole + 1) & mask; slots[s].pid != INVALID_PAGE; s = (s + 1) & mask) {
+		unsigned home = Home(slots[s].pid);
+		if (((s - home) & mask) >= ((s - hole) & mask)) {
+			slots[hole] = slots[s];
+			hole = s;
+		}
+	}
+	slots[hole].pid = INVALID_PAGE;
+	count--;
+	return OK;
+}
+
+
+int HashTable::LookUp(PageID pid)
+{
+	for (unsigned s = Home(pid); slots[s].pid != INVALID_PAGE; s = (s + 1) & mask) {
+		if (slots[s].pid == pid)
+			return slots[s].frameNo;
+	}
+	return INVALID_FRAME;
+}
+
+void HashTable::EmptyIt()
+{
+	for (unsigned i = 0; i <= mask; i++)
+		slots[i].pid = INVALID_PAGE;
+	count = 0;
+}
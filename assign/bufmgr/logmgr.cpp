@@ -0,0 +1,757 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+#include "logmgr.h"
+#include "bufmgr.h"
+#include "system_defs.h"
+
+LogMgr logMgr;
+
+//	The file starts with a header in a block of its own, and the groups
+//	follow, each after a LogGroupHeader.  A group holds the changes of
+//	one page after another: the page id, flags and the number of ranges,
+//	then each range's offset and length and its bytes.
+const unsigned LOG_FILE_MAGIC = 0x4c4f4731;		// "LOG1"
+const unsigned LOG_GROUP_MAGIC = 0x47525031;	// "GRP1"
+const unsigned LOG_STAMP_MAGIC = 0x53544d31;	// "STM1"
+const unsigned LOG_VERSION = 1;
+const int LOG_HEADER_BYTES = 512;
+const char LOG_STAMP_NAME[] = "~log";			// the stamp page's entry in the directory
+
+const unsigned short LOG_PAGE_ZEROED = 1;		// the page is zeroed before its ranges are set
+const int LOG_PAGE_HEADER_BYTES = (int)sizeof(PageID) + 4;
+const int LOG_RANGE_BYTES = 4;
+
+struct LogFileHeader
+{
+	unsigned magic;
+	unsigned version;
+	unsigned stamp;
+	PageID stampPage;
+	LSN base;				// where the first group starts
+	unsigned checksum;		// of the header with this field zero
+};
+
+struct LogGroupHeader
+{
+	unsigned magic;
+	unsigned length;		// of the changes that follow
+	LSN lsn;				// where the group starts
+	unsigned checksum;		// of the changes
+};
+
+//	FNV-1a.
+static unsigned Checksum(const void *data, size_t length)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	unsigned h = 2166136261u;
+	for (size_t i = 0; i < length; i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static unsigned HeaderChecksum(LogFileHeader header)
+{
+	header.checksum = 0;
+	return Checksum(&header, sizeof(header));
+}
+
+
+//-------------------------------------------------------------------
+// The log file, by platform
+//-------------------------------------------------------------------
+
+#ifdef _WIN32
+
+#define NO_FILE INVALID_HANDLE_VALUE
+
+static bool OpenLog(const char *name, bool create, void *&file)
+{
+	file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL,
+					   create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	return file != INVALID_HANDLE_VALUE;
+}
+
+static void CloseLog(void *&file)
+{
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+}
+
+static Status WriteLog(void *file, const char *data, size_t length, LSN offset)
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD n = 0;
+	BOOL ok = WriteFile(file, data, (DWORD)length, &n, &ov);
+	return (ok && n == (DWORD)length) ? OK : FAIL;
+}
+
+static Status ReadLog(void *file, std::vector<char> &data)
+{
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+		return FAIL;
+	data.resize((size_t)size.QuadPart);
+	if (data.empty())
+		return OK;
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	DWORD n = 0;
+	BOOL ok = ReadFile(file, &data[0], (DWORD)data.size(), &n, &ov);
+	return (ok && n == (DWORD)data.size()) ? OK : FAIL;
+}
+
+static Status SyncLog(void *file)
+{
+	return FlushFileBuffers(file) ? OK : FAIL;
+}
+
+static Status TruncateLog(void *file, LSN length)
+{
+	LARGE_INTEGER end;
+	end.QuadPart = (LONGLONG)length;
+	return (SetFilePointerEx(file, end, NULL, FILE_BEGIN) && SetEndOfFile(file)) ? OK : FAIL;
+}
+
+#else
+
+#define NO_FILE -1
+
+static bool OpenLog(const char *name, bool create, int &file)
+{
+	file = open(name, create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+	return file >= 0;
+}
+
+static void CloseLog(int &file)
+{
+	if (file >= 0)
+		close(file);
+	file = -1;
+}
+
+static Status WriteLog(int file, const char *data, size_t length, LSN offset)
+{
+	while (length > 0) {
+		ssize_t n = pwrite(file, data, length, (off_t)offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FAIL;
+		data += n;
+		length -= n;
+		offset += n;
+	}
+	return OK;
+}
+
+static Status ReadLog(int file, std::vector<char> &data)
+{
+	struct stat st;
+	if (fstat(file, &st) != 0)
+		return FAIL;
+	data.resize((size_t)st.st_size);
+	size_t done = 0;
+	while (done < data.size()) {
+		ssize_t n = pread(file, &data[done], data.size() - done, (off_t)done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FAIL;
+		done += n;
+	}
+	return OK;
+}
+
+//	Growing the file changes its size, which fdatasync writes too.
+static Status SyncLog(int file)
+{
+#if defined(__APPLE__)
+	return (fsync(file) == 0) ? OK : FAIL;
+#else
+	return (fdatasync(file) == 0) ? OK : FAIL;
+#endif
+}
+
+static Status TruncateLog(int file, LSN length)
+{
+	return (ftruncate(file, (off_t)length) == 0) ? OK : FAIL;
+}
+
+#endif
+
+
+//-------------------------------------------------------------------
+// LogMgr
+//-------------------------------------------------------------------
+
+LogMgr::LogMgr()
+	: file(NO_FILE), mode(LOG_OFF), logging(false), attachedTo(NULL), stamp(0),
+	  stampPage(INVALID_PAGE), base(0), written(0), appended(0), flushed(0), failed(false),
+	  updates(0), checkpointing(0)
+{
+}
+
+LogMgr::~LogMgr()
+{
+	CloseLog(file);
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::SetMode
+//
+// Input   : mode - how updates are to be logged.
+// Output  : None
+// Return  : None
+// Purpose : Stop logging at once, after a checkpoint, or have the
+//           next Attach start it.
+//-------------------------------------------------------------------
+void LogMgr::SetMode(LogMode m)
+{
+	if (m == LOG_OFF && logging) {
+		Checkpoint();
+		logging = false;
+		CloseLog(file);
+	} else if (m != LOG_OFF && !logging) {
+		attachedTo = NULL;
+	}
+	mode = m;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Attach
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if the log can't be opened or
+//           replayed, or has to be replayed into a read-only database.
+// Purpose : Replay the groups the log holds for this database, if the
+//           stamps match; then, if logging is on, give the database a
+//           stamp page if it has none, write every page out and start
+//           the log afresh.  No update may be running.
+//-------------------------------------------------------------------
+Status LogMgr::Attach()
+{
+	if (minibase_globals == NULL || MINIBASE_DB == NULL)
+		return FAIL;
+	const void *db = MINIBASE_DB;
+	if (attachedTo == db)
+		return OK;
+	Detach();
+
+	const char *name = minibase_globals->GlobalLogName;
+	bool readOnly = MINIBASE_BM->IsReadOnly();
+	bool stamped = (ReadStamp() == OK);
+	bool exists = (name != NULL && OpenLog(name, false, file));
+	LSN from = appended;
+	bool replayed = false;
+	if (exists && stamped) {
+		std::vector<char> log;
+		LogFileHeader header;
+		if (ReadLog(file, log) != OK)
+			return FAIL;
+		if (log.size() >= (size_t)LOG_HEADER_BYTES) {
+			memcpy(&header, &log[0], sizeof(header));
+			replayed = header.magic == LOG_FILE_MAGIC && header.version == LOG_VERSION
+				&& header.checksum == HeaderChecksum(header)
+				&& header.stamp == stamp && header.stampPage == stampPage
+				&& log.size() > (size_t)LOG_HEADER_BYTES;
+		}
+		if (replayed) {
+			if (readOnly) {
+				cerr << "The log " << name << " has to be replayed into a database opened for writing." << endl;
+				CloseLog(file);
+				return FAIL;
+			}
+			LSN end;
+			if (Replay(log, header.base, end) != OK) {
+				cerr << "Unable to replay the log " << name << endl;
+				CloseLog(file);
+				return FAIL;
+			}
+			from = std::max(from, end);
+		}
+	}
+
+	Status s = OK;
+	if (mode == LOG_OFF || readOnly) {
+		// Emptied, so that nothing changed from now on is undone by
+		// replaying it again.
+		if (replayed)
+			s = Restart(from);
+		CloseLog(file);
+	} else {
+		if (!exists && (name == NULL || !OpenLog(name, true, file))) {
+			cerr << "Unable to open the log " << (name != NULL ? name : "") << endl;
+			return FAIL;
+		}
+		if (!stamped)
+			s = NewStamp();
+		if (s == OK)
+			s = Restart(from);
+		if (s != OK)
+			CloseLog(file);
+		logging = (s == OK);
+	}
+	if (s == OK)
+		attachedTo = db;
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Close
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Leave the database written out and the log empty.  If the
+//           checkpoint fails, the log is left to replay.
+//-------------------------------------------------------------------
+void LogMgr::Close()
+{
+	if (logging)
+		Checkpoint();
+	Detach();
+}
+
+//-------------------------------------------------------------------
+// LogMgr::Discard
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Drop the groups not written out yet and close the file,
+//           as a crash would, so that the next Attach replays what
+//           was written.  For tests of recovery; no update may be
+//           running.
+//-------------------------------------------------------------------
+void LogMgr::Discard()
+{
+	{
+		MutexGuard guard(appendMutex);
+		buffer.clear();
+		written = appended;
+	}
+	Detach();
+}
+
+void LogMgr::Detach()
+{
+	logging = false;
+	CloseLog(file);
+	attachedTo = NULL;
+}
+
+
+//	The stamp page holds LOG_STAMP_MAGIC and the stamp.  Callers hold
+//	dbMutex.
+Status LogMgr::ReadStamp()
+{
+	if (MINIBASE_DB->GetFileEntry(LOG_STAMP_NAME, stampPage) != OK)
+		return FAIL;
+	Page *page;
+	if (MINIBASE_BM->PinPage(stampPage, page) != OK)
+		return FAIL;
+	unsigned words[2];
+	memcpy(words, page, sizeof(words));
+	MINIBASE_BM->UnpinPage(stampPage, false);
+	stamp = words[1];
+	return (words[0] == LOG_STAMP_MAGIC) ? OK : FAIL;
+}
+
+//	Allocated like an index's header page.  Callers hold dbMutex.
+Status LogMgr::NewStamp()
+{
+	Page *page;
+	if (spaceMap.Allocate(stampPage, 1) != OK)
+		return FAIL;
+	if (MINIBASE_BM->PinPage(stampPage, page, true) != OK)
+		return FAIL;
+	stamp = ((unsigned)time(NULL) * 2654435769u) ^ (unsigned)clock() ^ (unsigned)stampPage;
+	unsigned words[2] = { LOG_STAMP_MAGIC, stamp };
+	memset((char *)page, 0, MINIBASE_PAGESIZE);
+	memcpy((char *)page, words, sizeof(words));
+	MINIBASE_BM->UnpinPage(stampPage, true);
+	return MINIBASE_DB->AddFileEntry(LOG_STAMP_NAME, stampPage);
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Replay
+//
+// Input   : log - the whole file.
+//           from - where its first group starts.
+// Output  : end - where the last whole group ends.
+// Return  : OK if successful, FAIL if a page can't be pinned.
+// Purpose : Apply the groups in order, through the buffer pool, up to
+//           the first that was only partly written.
+//-------------------------------------------------------------------
+Status LogMgr::Replay(const std::vector<char> &log, LSN from, LSN &end)
+{
+	size_t pos = LOG_HEADER_BYTES;
+	end = from;
+	while (log.size() - pos >= sizeof(LogGroupHeader)) {
+		LogGroupHeader group;
+		memcpy(&group, &log[pos], sizeof(group));
+		const char *changes = &log[pos + sizeof(group)];
+		if (group.magic != LOG_GROUP_MAGIC || group.lsn != end
+			|| group.length > log.size() - pos - sizeof(group)
+			|| Checksum(changes, group.length) != group.checksum)
+			break;
+		if (ApplyGroup(changes, group.length) != OK)
+			return FAIL;
+		pos += sizeof(group) + group.length;
+		end += sizeof(group) + group.length;
+	}
+	return OK;
+}
+
+Status LogMgr::ApplyGroup(const char *changes, int length)
+{
+	const char *p = changes;
+	const char *end = changes + length;
+	while (p < end) {
+		if (end - p < LOG_PAGE_HEADER_BYTES)
+			return FAIL;
+		PageID pid;
+		unsigned short flags, ranges;
+		memcpy(&pid, p, sizeof(pid));
+		memcpy(&flags, p + sizeof(pid), 2);
+		memcpy(&ranges, p + sizeof(pid) + 2, 2);
+		p += LOG_PAGE_HEADER_BYTES;
+
+		Page *page;
+		bool zeroed = (flags & LOG_PAGE_ZEROED) != 0;
+		if (MINIBASE_BM->PinPage(pid, page, zeroed) != OK)
+			return FAIL;
+		if (zeroed)
+			memset((char *)page, 0, MINIBASE_PAGESIZE);
+		Status s = OK;
+		for (int r = 0; r < ranges && s == OK; r++) {
+			unsigned short offset, count;
+			if (end - p < LOG_RANGE_BYTES) {
+				s = FAIL;
+				break;
+			}
+			memcpy(&offset, p, 2);
+			memcpy(&count, p + 2, 2);
+			p += LOG_RANGE_BYTES;
+			if (end - p < count || offset + count > MINIBASE_PAGESIZE) {
+				s = FAIL;
+				break;
+			}
+			memcpy((char *)page + offset, p, count);
+			p += count;
+		}
+		MINIBASE_BM->UnpinPage(pid, true);
+		if (s != OK)
+			return s;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Restart
+//
+// Input   : from - where the next group is to start.
+// Output  : None
+// Return  : OK if successful, FAIL if a page, the header or a sync
+//           can't be written.
+// Purpose : Write every dirty page and sync the database file, then
+//           empty the log.  The header goes first, so that a crash
+//           before the file is cut short leaves groups that don't
+//           follow it.  The pages freed meanwhile are free from then
+//           on.  Callers hold dbMutex and hold off updates.
+//-------------------------------------------------------------------
+Status LogMgr::Restart(LSN from)
+{
+	Status s = MINIBASE_BM->FlushAllPages();
+	if (s == OK)
+		s = pageIO.Sync();
+	if (s != OK)
+		return s;
+
+	{
+		MutexGuard guard(flushMutex);
+		LogFileHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = LOG_FILE_MAGIC;
+		header.version = LOG_VERSION;
+		header.stamp = stamp;
+		header.stampPage = stampPage;
+		header.base = from;
+		header.checksum = HeaderChecksum(header);
+		char block[LOG_HEADER_BYTES];
+		memset(block, 0, sizeof(block));
+		memcpy(block, &header, sizeof(header));
+		s = WriteLog(file, block, sizeof(block), 0);
+		if (s == OK)
+			s = TruncateLog(file, sizeof(block));
+		if (s == OK)
+			s = SyncLog(file);
+
+		MutexGuard appendGuard(appendMutex);
+		if (s != OK)
+			return s;
+		buffer.clear();
+		base = written = appended = flushed = from;
+		failed = false;
+	}
+	return spaceMap.Settle();
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Encode
+//
+// Input   : pid - the page.
+//           page - what it holds now.
+//           image - what it held when last logged, or NULL.
+// Output  : out - the page's changes.
+// Return  : Their length, 0 if the page is the same as image.
+// Purpose : Describe the bytes that differ as ranges.  A range goes on
+//           over fewer equal bytes than a new range would take, so the
+//           changes never take more than the whole page would.
+//-------------------------------------------------------------------
+int LogMgr::Encode(PageID pid, const Page *page, const Page *image, char *out)
+{
+	static const char zeros[MINIBASE_PAGESIZE] = { 0 };
+	const unsigned char *now = (const unsigned char *)page;
+	const unsigned char *was = (const unsigned char *)((image != NULL) ? (const char *)image : zeros);
+	if (image != NULL && memcmp(now, was, MINIBASE_PAGESIZE) == 0)
+		return 0;
+
+	unsigned short flags = (image == NULL) ? LOG_PAGE_ZEROED : 0;
+	unsigned short ranges = 0;
+	int length = LOG_PAGE_HEADER_BYTES;
+	for (int i = 0; i < MINIBASE_PAGESIZE; ) {
+		if (now[i] == was[i]) {
+			i++;
+			continue;
+		}
+		int end = i + 1;
+		for (int j = end; j < MINIBASE_PAGESIZE && j - end < LOG_RANGE_BYTES; j++) {
+			if (now[j] != was[j])
+				end = j + 1;
+		}
+		unsigned short offset = (unsigned short)i;
+		unsigned short count = (unsigned short)(end - i);
+		memcpy(out + length, &offset, 2);
+		memcpy(out + length + 2, &count, 2);
+		memcpy(out + length + LOG_RANGE_BYTES, now + i, count);
+		length += LOG_RANGE_BYTES + count;
+		ranges++;
+		i = end;
+	}
+	memcpy(out, &pid, sizeof(pid));
+	memcpy(out + sizeof(pid), &flags, 2);
+	memcpy(out + sizeof(pid) + 2, &ranges, 2);
+	return length;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Append
+//
+// Input   : changes, length - the changes of the pages in the group.
+// Output  : None
+// Return  : Where the log ends after the group.
+// Purpose : Add the group to the buffer, and write the buffer out once
+//           it holds LOG_BUFFER_BYTES.
+//-------------------------------------------------------------------
+LSN LogMgr::Append(const char *changes, int length)
+{
+	LogGroupHeader group;
+	group.magic = LOG_GROUP_MAGIC;
+	group.length = length;
+	group.checksum = Checksum(changes, length);
+
+	LSN end;
+	bool full;
+	{
+		MutexGuard guard(appendMutex);
+		group.lsn = appended;
+		buffer.insert(buffer.end(), (const char *)&group, (const char *)&group + sizeof(group));
+		buffer.insert(buffer.end(), changes, changes + length);
+		appended += sizeof(group) + length;
+		end = appended;
+		full = (buffer.size() >= (size_t)LOG_BUFFER_BYTES);
+	}
+	if (full)
+		Force(end);
+	return end;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Force
+//
+// Input   : lsn - how far the log has to be on disk.
+// Output  : None
+// Return  : OK if successful, FAIL if the log can't be written.
+// Purpose : Write out and sync everything appended so far, unless
+//           that much is on disk already.  One thread writes at a
+//           time; those waiting for it usually find their groups
+//           written when their turn comes, so that one sync serves
+//           them all.
+//-------------------------------------------------------------------
+Status LogMgr::Force(LSN lsn)
+{
+	if (!logging)
+		return OK;
+	{
+		MutexGuard guard(appendMutex);
+		if (lsn <= flushed)
+			return OK;
+		if (failed)
+			return FAIL;
+	}
+
+	MutexGuard guard(flushMutex);
+	LSN start, end;
+	{
+		MutexGuard appendGuard(appendMutex);
+		if (lsn <= flushed)
+			return OK;
+		buffer.swap(writing);
+		start = written;
+		end = written = appended;
+	}
+	Status s = OK;
+	if (!writing.empty())
+		s = WriteLog(file, &writing[0], writing.size(), LOG_HEADER_BYTES + (start - base));
+	if (s == OK)
+		s = SyncLog(file);
+	writing.clear();
+
+	MutexGuard appendGuard(appendMutex);
+	if (s == OK)
+		flushed = end;
+	else
+		failed = true;
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::BeginUpdate
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Count the update as running, once no checkpoint is.
+//-------------------------------------------------------------------
+void LogMgr::BeginUpdate()
+{
+	for (;;) {
+		AtomicAdd(&updates, 1);
+		if (!checkpointing)
+			return;
+		AtomicAdd(&updates, -1);
+		while (checkpointing)
+			SleepMicros(LOG_WAIT_MICROS);
+	}
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::EndUpdate
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if the log can't be written.
+// Purpose : Commit the update, and take a checkpoint if the log has
+//           outgrown LOG_CHECKPOINT_BYTES.
+//-------------------------------------------------------------------
+Status LogMgr::EndUpdate()
+{
+	AtomicAdd(&updates, -1);
+	Status s = Commit();
+	if (s == OK)
+		s = Checkpoint(LOG_CHECKPOINT_BYTES);
+	return s;
+}
+
+Status LogMgr::Commit()
+{
+	if (!logging || mode != LOG_SYNC)
+		return OK;
+	LSN end;
+	{
+		MutexGuard guard(appendMutex);
+		end = appended;
+	}
+	return Force(end);
+}
+
+
+//-------------------------------------------------------------------
+// LogMgr::Checkpoint
+//
+// Input   : minLength - how long the log has to be to be emptied.
+// Output  : None
+// Return  : OK if successful, FAIL if a page or the log can't be
+//           written.
+// Purpose : Hold new updates off, wait for the running ones, and then
+//           write every page out and empty the log.  The log is
+//           forced as the pages are written.
+//-------------------------------------------------------------------
+Status LogMgr::Checkpoint()
+{
+	return Checkpoint(0);
+}
+
+Status LogMgr::Checkpoint(LSN minLength)
+{
+	if (!logging)
+		return OK;
+	{
+		MutexGuard guard(appendMutex);
+		if (appended - base < minLength || (minLength > 0 && checkpointing))
+			return OK;
+	}
+
+	MutexGuard guard(checkpointMutex);
+	{
+		MutexGuard appendGuard(appendMutex);
+		if (appended - base < minLength)
+			return OK;
+	}
+	checkpointing = 1;
+	MemoryFence();
+	while (updates > 0)
+		YieldThread();
+
+	// The updates waited for may have logged more.
+	LSN end;
+	{
+		MutexGuard appendGuard(appendMutex);
+		end = appended;
+	}
+	Status s;
+	{
+		MutexGuard dbGuard(dbMutex);
+		s = Restart(end);
+	}
+	MemoryFence();
+	checkpointing = 0;
+	return s;
+}
@@ -0,0 +1,22 @@
+#include "replacer.h"
+
+
+LRUK::LRUK(int bufSize, ClockFrame **frames)
+	: SampledReplacer(bufSize, frames)
+{
+}
+
+//	Compares the second to last references, where never (0) is oldest,
+//	then the last ones.
+bool LRUK::Older(int a, int b)
+{
+	if (history[a].previous != history[b].previous)
+		return history[a].previous < history[b].previous;
+	return history[a].last < history[b].last;
+}
+
+//	Every page is on the cold queue; only the order counts.
+int LRUK::PickVictim()
+{
+	return Sample(QUEUE_COLD);
+}
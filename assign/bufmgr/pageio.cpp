@@ -0,0 +1,872 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <winioctl.h>
+#include <malloc.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+#include "pageio.h"
+#include "bufmgr.h"
+#include "system_defs.h"
+
+PageIO pageIO;
+
+
+//-------------------------------------------------------------------
+// IORequest
+//-------------------------------------------------------------------
+
+IORequest::IORequest()
+	: pid(INVALID_PAGE), page(NULL), pages(NULL), count(1), write(false), status(OK),
+	  done(0), next(NULL)
+{
+}
+
+IORequest::~IORequest()
+{
+}
+
+void IORequest::Complete()
+{
+	MemoryFence();
+	done = 1;
+}
+
+
+//-------------------------------------------------------------------
+// PageIO, the parts that differ by platform
+//
+// On Windows the file is opened for overlapped I/O, the only way to
+// give ReadFile and WriteFile a position without them waiting for
+// each other; each call waits for its own transfer.
+//-------------------------------------------------------------------
+
+#ifdef _WIN32
+
+#define SRW(p) ((PSRWLOCK)&(p))
+#define COND(p) ((PCONDITION_VARIABLE)&(p))
+
+PageIO::PageIO() : file(INVALID_HANDLE_VALUE), queueLock(NULL), queueReady(NULL),
+	mapping(NULL), mapped(NULL), mappedBytes(0), mappedPages(0), openFor(NULL), direct(false),
+	directOpen(false), head(NULL), tail(NULL), numThreads(PAGEIO_THREADS), started(false), stopping(false)
+{
+}
+
+PageIO::~PageIO()
+{
+	StopThreads();
+	Close();
+}
+
+//	Callers hold openMutex.
+static bool OpenFile(const char *name, void *&file, bool direct)
+{
+	DWORD flags = FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED;
+	if (direct)
+		flags |= FILE_FLAG_NO_BUFFERING;
+	file = CreateFileA(name, GENERIC_READ | GENERIC_WRITE,
+					   FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+					   OPEN_EXISTING, flags, NULL);
+	return file != INVALID_HANDLE_VALUE;
+}
+
+static void CloseFile(void *&file)
+{
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	file = INVALID_HANDLE_VALUE;
+}
+
+//	Maps at most bytes of the file, as far as it goes.
+static char *MapFile(void *file, size_t bytes, void *&mapping, size_t &mappedBytes)
+{
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+		return NULL;
+	mappedBytes = ((ULONGLONG)size.QuadPart < bytes) ? (size_t)size.QuadPart : bytes;
+	if (mappedBytes == 0)
+		return NULL;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+		return NULL;
+	char *view = (char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, mappedBytes);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		mapping = NULL;
+	}
+	return view;
+}
+
+static void UnmapFile(char *view, size_t bytes, void *&mapping)
+{
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	mapping = NULL;
+}
+
+//	PrefetchVirtualMemory would do, from Windows 8 on.
+static void AdviseWillNeed(char *start, size_t bytes)
+{
+}
+
+static Status TransferPage(void *file, PageID pid, Page *page, bool write)
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ULONGLONG offset = (ULONGLONG)pid * MINIBASE_PAGESIZE;
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (ov.hEvent == NULL)
+		return FAIL;
+
+	DWORD n = 0;
+	BOOL ok = write ? WriteFile(file, page, MINIBASE_PAGESIZE, NULL, &ov)
+					: ReadFile(file, page, MINIBASE_PAGESIZE, NULL, &ov);
+	if (!ok && GetLastError() == ERROR_IO_PENDING)
+		ok = TRUE;
+	if (ok)
+		ok = GetOverlappedResult(file, &ov, &n, TRUE);
+	CloseHandle(ov.hEvent);
+	return (ok && n == (DWORD)MINIBASE_PAGESIZE) ? OK : FAIL;
+}
+
+//	Windows only scatters and gathers with unbuffered files, so a run
+//	is read or written a page at a time.
+static Status TransferPages(void *file, PageID first, Page **pages, int count, bool write)
+{
+	for (int i = 0; i < count; i++) {
+		if (TransferPage(file, first + i, pages[i], write) != OK)
+			return FAIL;
+	}
+	return OK;
+}
+
+//	NTFS gives a file that isn't sparse all its blocks as it grows.
+static Status AllocateSpace(void *file, PageID first, int count)
+{
+	return DONE;
+}
+
+//	The file is made sparse first, which it stays.
+static Status ReleaseSpace(void *file, PageID first, int count)
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (ov.hEvent == NULL)
+		return FAIL;
+
+	FILE_SET_SPARSE_BUFFER sparse;
+	sparse.SetSparse = TRUE;
+	FILE_ZERO_DATA_INFORMATION zero;
+	zero.FileOffset.QuadPart = (LONGLONG)first * MINIBASE_PAGESIZE;
+	zero.BeyondFinalZero.QuadPart = (LONGLONG)(first + count) * MINIBASE_PAGESIZE;
+	DWORD n;
+	BOOL ok = DeviceIoControl(file, FSCTL_SET_SPARSE, &sparse, sizeof(sparse), NULL, 0, NULL, &ov);
+	if (!ok && GetLastError() == ERROR_IO_PENDING)
+		ok = TRUE;
+	if (ok)
+		ok = GetOverlappedResult(file, &ov, &n, TRUE);
+	if (ok) {
+		ResetEvent(ov.hEvent);
+		ok = DeviceIoControl(file, FSCTL_SET_ZERO_DATA, &zero, sizeof(zero), NULL, 0, NULL, &ov);
+		if (!ok && GetLastError() == ERROR_IO_PENDING)
+			ok = TRUE;
+		if (ok)
+			ok = GetOverlappedResult(file, &ov, &n, TRUE);
+	}
+	CloseHandle(ov.hEvent);
+	return ok ? OK : DONE;
+}
+
+static Status SyncFile(void *file)
+{
+	return FlushFileBuffers(file) ? OK : FAIL;
+}
+
+static DWORD WINAPI RunWorker(LPVOID io)
+{
+	PageIO::Worker(io);
+	return 0;
+}
+
+void PageIO::StartThreads()
+{
+	stopping = false;
+	for (int i = 0; i < numThreads; i++)
+		threads[i] = CreateThread(NULL, 0, RunWorker, this, 0, NULL);
+}
+
+void PageIO::StopThreads()
+{
+	if (!started)
+		return;
+	AcquireSRWLockExclusive(SRW(queueLock));
+	stopping = true;
+	ReleaseSRWLockExclusive(SRW(queueLock));
+	WakeAllConditionVariable(COND(queueReady));
+	for (int i = 0; i < numThreads; i++) {
+		WaitForSingleObject(threads[i], INFINITE);
+		CloseHandle(threads[i]);
+	}
+	started = false;
+}
+
+IORequest *PageIO::Next()
+{
+	AcquireSRWLockExclusive(SRW(queueLock));
+	while (head == NULL && !stopping)
+		SleepConditionVariableSRW(COND(queueReady), SRW(queueLock), INFINITE, 0);
+	IORequest *req = head;
+	if (req != NULL) {
+		head = req->next;
+		if (head == NULL)
+			tail = NULL;
+	}
+	ReleaseSRWLockExclusive(SRW(queueLock));
+	return req;
+}
+
+void PageIO::Submit(IORequest *req)
+{
+	if (numThreads == 0 || !Open()) {
+		Run(req);
+		return;
+	}
+	if (!started) {
+		MutexGuard guard(openMutex);
+		if (!started) {
+			StartThreads();
+			started = true;
+		}
+	}
+	req->next = NULL;
+	AcquireSRWLockExclusive(SRW(queueLock));
+	if (tail != NULL)
+		tail->next = req;
+	else
+		head = req;
+	tail = req;
+	ReleaseSRWLockExclusive(SRW(queueLock));
+	WakeConditionVariable(COND(queueReady));
+}
+
+#else
+
+PageIO::PageIO() : file(-1), mapping(NULL), mapped(NULL), mappedBytes(0), mappedPages(0), openFor(NULL), direct(false),
+	directOpen(false), head(NULL), tail(NULL), numThreads(PAGEIO_THREADS), started(false), stopping(false)
+{
+	pthread_mutex_init(&queueLock, NULL);
+	pthread_cond_init(&queueReady, NULL);
+}
+
+PageIO::~PageIO()
+{
+	StopThreads();
+	Close();
+	pthread_cond_destroy(&queueReady);
+	pthread_mutex_destroy(&queueLock);
+}
+
+//	Without O_DIRECT, as on OS X, F_NOCACHE keeps pages out of the cache.
+static bool OpenFile(const char *name, int &file, bool direct)
+{
+#ifdef O_DIRECT
+	file = open(name, direct ? O_RDWR | O_DIRECT : O_RDWR);
+#else
+	file = open(name, O_RDWR);
+#ifdef F_NOCACHE
+	if (file >= 0 && direct)
+		fcntl(file, F_NOCACHE, 1);
+#endif
+#endif
+	return file >= 0;
+}
+
+static void CloseFile(int &file)
+{
+	if (file >= 0)
+		close(file);
+	file = -1;
+}
+
+//	Maps at most bytes of the file, as far as it goes.
+static char *MapFile(int file, size_t bytes, void *&, size_t &mappedBytes)
+{
+	struct stat st;
+	if (fstat(file, &st) != 0)
+		return NULL;
+	mappedBytes = ((size_t)st.st_size < bytes) ? (size_t)st.st_size : bytes;
+	if (mappedBytes == 0)
+		return NULL;
+	void *view = mmap(NULL, mappedBytes, PROT_READ, MAP_SHARED, file, 0);
+	return (view == MAP_FAILED) ? NULL : (char *)view;
+}
+
+static void UnmapFile(char *view, size_t bytes, void *&)
+{
+	munmap(view, bytes);
+}
+
+//	The advice is taken in whole pages of memory.
+static void AdviseWillNeed(char *start, size_t bytes)
+{
+	size_t align = (size_t)sysconf(_SC_PAGESIZE);
+	size_t skew = (size_t)start % align;
+	posix_madvise(start - skew, bytes + skew, POSIX_MADV_WILLNEED);
+}
+
+static Status TransferPage(int file, PageID pid, Page *page, bool write)
+{
+	char *p = (char *)page;
+	size_t left = MINIBASE_PAGESIZE;
+	off_t offset = (off_t)pid * MINIBASE_PAGESIZE;
+	while (left > 0) {
+		ssize_t n = write ? pwrite(file, p, left, offset) : pread(file, p, left, offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FAIL;
+		p += n;
+		left -= n;
+		offset += n;
+	}
+	return OK;
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+//	After a short transfer, the rest goes a page at a time.
+static Status TransferPages(int file, PageID first, Page **pages, int count, bool write)
+{
+	struct iovec iov[IOV_MAX];
+	while (count > 0) {
+		int n = (count < IOV_MAX) ? count : IOV_MAX;
+		for (int i = 0; i < n; i++) {
+			iov[i].iov_base = pages[i];
+			iov[i].iov_len = MINIBASE_PAGESIZE;
+		}
+		off_t offset = (off_t)first * MINIBASE_PAGESIZE;
+		ssize_t done;
+		do
+			done = write ? pwritev(file, iov, n, offset) : preadv(file, iov, n, offset);
+		while (done < 0 && errno == EINTR);
+		if (done < 0)
+			return FAIL;
+
+		for (int i = (int)(done / MINIBASE_PAGESIZE); i < n; i++) {
+			if (TransferPage(file, first + i, pages[i], write) != OK)
+				return FAIL;
+		}
+		first += n;
+		pages += n;
+		count -= n;
+	}
+	return OK;
+}
+
+//	Where fallocate isn't there, as on OS X, the file is left to get
+//	its blocks as it is written.
+static Status AllocateSpace(int file, PageID first, int count)
+{
+#ifdef FALLOC_FL_KEEP_SIZE
+	if (fallocate(file, FALLOC_FL_KEEP_SIZE, (off_t)first * MINIBASE_PAGESIZE,
+				  (off_t)count * MINIBASE_PAGESIZE) == 0)
+		return OK;
+#endif
+	return DONE;
+}
+
+static Status ReleaseSpace(int file, PageID first, int count)
+{
+#if defined(FALLOC_FL_PUNCH_HOLE)
+	if (fallocate(file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+				  (off_t)first * MINIBASE_PAGESIZE, (off_t)count * MINIBASE_PAGESIZE) == 0)
+		return OK;
+#elif defined(F_PUNCHHOLE)
+	fpunchhole_t hole;
+	memset(&hole, 0, sizeof(hole));
+	hole.fp_offset = (off_t)first * MINIBASE_PAGESIZE;
+	hole.fp_length = (off_t)count * MINIBASE_PAGESIZE;
+	if (fcntl(file, F_PUNCHHOLE, &hole) == 0)
+		return OK;
+#endif
+	return DONE;
+}
+
+//	Only the data has to be on the device; the file's size doesn't change.
+static Status SyncFile(int file)
+{
+#if defined(__APPLE__)
+	return (fsync(file) == 0) ? OK : FAIL;
+#else
+	return (fdatasync(file) == 0) ? OK : FAIL;
+#endif
+}
+
+void PageIO::StartThreads()
+{
+	stopping = false;
+	for (int i = 0; i < numThreads; i++)
+		pthread_create(&threads[i], NULL, Worker, this);
+}
+
+void PageIO::StopThreads()
+{
+	if (!started)
+		return;
+	pthread_mutex_lock(&queueLock);
+	stopping = true;
+	pthread_cond_broadcast(&queueReady);
+	pthread_mutex_unlock(&queueLock);
+	for (int i = 0; i < numThreads; i++)
+		pthread_join(threads[i], NULL);
+	started = false;
+}
+
+IORequest *PageIO::Next()
+{
+	pthread_mutex_lock(&queueLock);
+	while (head == NULL && !stopping)
+		pthread_cond_wait(&queueReady, &queueLock);
+	IORequest *req = head;
+	if (req != NULL) {
+		head = req->next;
+		if (head == NULL)
+			tail = NULL;
+	}
+	pthread_mutex_unlock(&queueLock);
+	return req;
+}
+
+void PageIO::Submit(IORequest *req)
+{
+	if (numThreads == 0 || !Open()) {
+		Run(req);
+		return;
+	}
+	if (!started) {
+		MutexGuard guard(openMutex);
+		if (!started) {
+			StartThreads();
+			started = true;
+		}
+	}
+	req->next = NULL;
+	pthread_mutex_lock(&queueLock);
+	if (tail != NULL)
+		tail->next = req;
+	else
+		head = req;
+	tail = req;
+	pthread_cond_signal(&queueReady);
+	pthread_mutex_unlock(&queueLock);
+}
+
+#endif
+
+
+//-------------------------------------------------------------------
+// PageIO::Open
+//
+// Input   : None
+// Output  : None
+// Return  : true if the file of MINIBASE_DB is open.
+// Purpose : Open the database file on first use, or when the database
+//           has changed since it was opened.  The database is created
+//           after the buffer manager, so it can't be opened before.
+//-------------------------------------------------------------------
+bool PageIO::Open()
+{
+	if (minibase_globals == NULL || MINIBASE_DB == NULL)
+		return false;
+	const void *db = MINIBASE_DB;
+	if (openFor == db)
+		return true;
+
+	MutexGuard guard(openMutex);
+	if (openFor == db)
+		return true;
+	UnmapLocked();
+	CloseFile(file);
+	openFor = NULL;
+	directOpen = false;
+	const char *name = MINIBASE_DB->GetName();
+	if (direct && OpenFile(name, file, true)) {
+		directOpen = ProbeDirect();
+		if (!directOpen)
+			CloseFile(file);
+	}
+	if (!directOpen && !OpenFile(name, file, false))
+		return false;
+	MemoryFence();
+	openFor = db;
+	return true;
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::Close
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Close the file.  No request may be out, and no page of
+//           the mapping in use.
+//-------------------------------------------------------------------
+void PageIO::Close()
+{
+	MutexGuard guard(openMutex);
+	UnmapLocked();
+	CloseFile(file);
+	openFor = NULL;
+	directOpen = false;
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::SetDirect
+//
+// Input   : on - whether to open the file for direct I/O.
+// Output  : None
+// Return  : None
+// Purpose : Close the file, if this changes how it is opened, for the
+//           next use to open it again.
+//-------------------------------------------------------------------
+void PageIO::SetDirect(bool on)
+{
+	MutexGuard guard(openMutex);
+	if (on == direct)
+		return;
+	direct = on;
+	UnmapLocked();
+	CloseFile(file);
+	openFor = NULL;
+	directOpen = false;
+}
+
+//	Whether a page can be read from the file just opened for direct
+//	I/O; a device with sectors bigger than a page can't.  Callers hold
+//	openMutex.
+bool PageIO::ProbeDirect()
+{
+	Page *page = AllocPages(1);
+	bool ok = (TransferPage(file, 0, page, false) == OK);
+	FreePages(page);
+	return ok;
+}
+
+Page *PageIO::AllocPages(int count)
+{
+	size_t bytes = (size_t)count * sizeof(Page);
+#ifdef _WIN32
+	void *pages = _aligned_malloc(bytes, PAGEIO_ALIGN);
+	if (pages == NULL)
+		throw std::bad_alloc();
+#else
+	void *pages;
+	if (posix_memalign(&pages, PAGEIO_ALIGN, bytes) != 0)
+		throw std::bad_alloc();
+#endif
+	return (Page *)pages;
+}
+
+void PageIO::FreePages(Page *pages)
+{
+#ifdef _WIN32
+	_aligned_free(pages);
+#else
+	free(pages);
+#endif
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::Map
+//
+// Input   : None
+// Output  : None
+// Return  : true if the file is mapped.
+// Purpose : Map the pages of the database that the file holds, read
+//           only.
+//-------------------------------------------------------------------
+bool PageIO::Map()
+{
+	if (!Open())
+		return false;
+
+	MutexGuard guard(openMutex);
+	if (mapped != NULL)
+		return true;
+	size_t bytes = (size_t)MINIBASE_DB->GetNumOfPages() * MINIBASE_PAGESIZE;
+	char *view = MapFile(file, bytes, mapping, mappedBytes);
+	if (view == NULL)
+		return false;
+	mappedPages = (int)(mappedBytes / MINIBASE_PAGESIZE);
+	MemoryFence();
+	mapped = view;
+	return true;
+}
+
+//	No page of the mapping may be in use.
+void PageIO::Unmap()
+{
+	MutexGuard guard(openMutex);
+	UnmapLocked();
+}
+
+//	Callers hold openMutex.
+void PageIO::UnmapLocked()
+{
+	if (mapped == NULL)
+		return;
+	char *view = mapped;
+	mapped = NULL;
+	mappedPages = 0;
+	MemoryFence();
+	UnmapFile(view, mappedBytes, mapping);
+}
+
+void PageIO::WillNeed(PageID pid, int count)
+{
+	Page *first = MappedPage(pid);
+	if (first == NULL)
+		return;
+	if (count > mappedPages - pid)
+		count = mappedPages - pid;
+	AdviseWillNeed((char *)first, (size_t)count * MINIBASE_PAGESIZE);
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::Preallocate
+//
+// Input   : first, count - pages of the database.
+// Output  : None
+// Return  : OK if successful, DONE if the file system doesn't take
+//           the advice, FAIL if the file can't be opened.
+// Purpose : Have the pages' blocks allocated on the device before
+//           they are written, in one piece where there is room.  The
+//           data of pages that have blocks already stays as it is.
+//-------------------------------------------------------------------
+Status PageIO::Preallocate(PageID first, int count)
+{
+	if (!Open())
+		return FAIL;
+	count = std::min(count, MINIBASE_DB->GetNumOfPages() - first);
+	if (first < 0 || count <= 0)
+		return FAIL;
+	return AllocateSpace(file, first, count);
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::PunchHole
+//
+// Input   : first, count - pages nothing is kept in.
+// Output  : None
+// Return  : OK if successful, DONE if the file system doesn't take
+//           the advice, FAIL if the file can't be opened.
+// Purpose : Give the pages' blocks back to the file system.  The file
+//           keeps its size, and the pages read as zeros until they are
+//           written again.  No request for them may be out.
+//-------------------------------------------------------------------
+Status PageIO::PunchHole(PageID first, int count)
+{
+	if (!Open())
+		return FAIL;
+	count = std::min(count, MINIBASE_DB->GetNumOfPages() - first);
+	if (first < 0 || count <= 0)
+		return FAIL;
+	return ReleaseSpace(file, first, count);
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::Sync
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if the file can't be opened or
+//           synced.
+// Purpose : Wait until every page written so far is on the device,
+//           not only in the OS cache.
+//-------------------------------------------------------------------
+Status PageIO::Sync()
+{
+	if (!Open())
+		return FAIL;
+	return SyncFile(file);
+}
+
+
+//-------------------------------------------------------------------
+// PageIO::Transfer
+//
+// Input   : pid - page to read or write.
+//           page - where it is read to or written from.
+//           write - which.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Read or write the page at its place in the file, or
+//           through DB if the file can't be opened.
+//-------------------------------------------------------------------
+Status PageIO::Transfer(PageID pid, Page *page, bool write)
+{
+	if (!Open()) {
+		if (minibase_globals == NULL || MINIBASE_DB == NULL)
+			return FAIL;
+		MutexGuard guard(dbIOMutex);
+		return write ? MINIBASE_DB->WritePage(pid, page) : MINIBASE_DB->ReadPage(pid, page);
+	}
+	if (pid < 0 || pid >= MINIBASE_DB->GetNumOfPages())
+		return FAIL;
+	return TransferPage(file, pid, page, write);
+}
+
+Status PageIO::Read(PageID pid, Page *page)
+{
+	return Transfer(pid, page, false);
+}
+
+Status PageIO::Write(PageID pid, Page *page)
+{
+	return Transfer(pid, page, true);
+}
+
+//-------------------------------------------------------------------
+// PageIO::TransferRun
+//
+// Input   : first - page of pages[0].
+//           pages - the pages, for first, first + 1, and so on.
+//           count - how many.
+//           write - whether to write or read them.
+// Output  : None
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Read or write pages that lie next to each other in the
+//           file in as few calls as possible.
+//-------------------------------------------------------------------
+Status PageIO::TransferRun(PageID first, Page **pages, int count, bool write)
+{
+	if (!Open()) {
+		for (int i = 0; i < count; i++) {
+			if (Transfer(first + i, pages[i], write) != OK)
+				return FAIL;
+		}
+		return OK;
+	}
+	if (first < 0 || first + count > MINIBASE_DB->GetNumOfPages())
+		return FAIL;
+	return TransferPages(file, first, pages, count, write);
+}
+
+Status PageIO::ReadRun(PageID first, Page **pages, int count)
+{
+	return TransferRun(first, pages, count, false);
+}
+
+Status PageIO::WriteRun(PageID first, Page **pages, int count)
+{
+	return TransferRun(first, pages, count, true);
+}
+
+
+//	A page of a scatter list, to be sorted by page id.
+struct ListEntry
+{
+	PageID pid;
+	Page *page;
+
+	bool operator<(const ListEntry &other) const { return pid < other.pid; }
+};
+
+//-------------------------------------------------------------------
+// PageIO::TransferList
+//
+// Input   : pids - pages to read or write, in any order.
+//           pages - where each is read to or written from.
+//           count - how many.
+//           write - whether to write or read them.
+// Output  : None
+// Return  : OK if successful, FAIL if any page failed.
+// Purpose : Sort the pages by page id and transfer each run of them
+//           that lie next to each other in the file in one call.
+//-------------------------------------------------------------------
+Status PageIO::TransferList(const PageID *pids, Page **pages, int count, bool write)
+{
+	std::vector<ListEntry> sorted(count);
+	for (int i = 0; i < count; i++) {
+		sorted[i].pid = pids[i];
+		sorted[i].page = pages[i];
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	std::vector<Page *> run(count);
+	Status result = OK;
+	for (int start = 0, end; start < count; start = end) {
+		run[0] = sorted[start].page;
+		for (end = start + 1; end < count && sorted[end].pid == sorted[end - 1].pid + 1; end++)
+			run[end - start] = sorted[end].page;
+		if (TransferRun(sorted[start].pid, &run[0], end - start, write) != OK)
+			result = FAIL;
+	}
+	return result;
+}
+
+Status PageIO::ReadPages(const PageID *pids, Page **pages, int count)
+{
+	return TransferList(pids, pages, count, false);
+}
+
+Status PageIO::WritePages(const PageID *pids, Page **pages, int count)
+{
+	return TransferList(pids, pages, count, true);
+}
+
+//	The request may be gone once Complete returns.
+void PageIO::Run(IORequest *req)
+{
+	if (req->count > 1)
+		req->status = TransferRun(req->pid, req->pages, req->count, req->write);
+	else
+		req->status = Transfer(req->pid, req->page, req->write);
+	req->Complete();
+}
+
+void PageIO::SetThreads(int n)
+{
+	MutexGuard guard(openMutex);
+	StopThreads();
+	numThreads = (n < 0) ? 0 : (n > PAGEIO_THREADS) ? PAGEIO_THREADS : n;
+}
+
+void PageIO::Wait(IORequest *req)
+{
+	while (!req->IsDone())
+		YieldThread();
+	MemoryFence();
+}
+
+void *PageIO::Worker(void *io)
+{
+	IORequest *req;
+	while ((req = ((PageIO *)io)->Next()) != NULL)
+		((PageIO *)io)->Run(req);
+	return NULL;
+}
@@ -0,0 +1,283 @@
+#include <cstring>
+
+#include "replacer.h"
+#include "latch.h"
+
+
+Replacer::Replacer()
+{
+}
+
+Replacer::~Replacer()
+{
+}
+
+
+//-------------------------------------------------------------------
+// NewReplacer
+//
+// Input   : policy - name of the replacement policy.
+//           bufSize - number of frames.
+//           frames - the frames, shared with the buffer manager.
+// Output  : None
+// Return  : The replacer, or NULL if policy is unknown.
+//-------------------------------------------------------------------
+Replacer *NewReplacer(const char *policy, int bufSize, ClockFrame **frames)
+{
+	if (strcmp(policy, "Clock") == 0)
+		return new Clock(bufSize, frames);
+	if (strcmp(policy, "LRU2") == 0)
+		return new LRUK(bufSize, frames);
+	if (strcmp(policy, "2Q") == 0)
+		return new TwoQ(bufSize, frames);
+	if (strcmp(policy, "ARC") == 0)
+		return new ARC(bufSize, frames);
+	return NULL;
+}
+
+
+//-------------------------------------------------------------------
+// Clock::Clock
+//
+// Input   : bufSize - number of frames.
+//           frames - the frames, shared with the buffer manager.
+// Output  : None
+// Return  : None
+//-------------------------------------------------------------------
+Clock::Clock(int bufSize, ClockFrame **frames)
+	: current(0), numOfBuf(bufSize), frames(frames)
+{
+}
+
+Clock::~Clock()
+{
+}
+
+
+//-------------------------------------------------------------------
+// Clock::PickVictim
+//
+// Input   : None
+// Output  : None
+// Return  : An unpinned frame that wasn't referenced since the hand
+//           last passed it, or INVALID_FRAME after two turns of the
+//           clock without one.
+// Purpose : Move the hand, clearing the reference bits of unpinned
+//           frames on the way.  Nothing is latched, so the frame may
+//           be pinned again before the caller claims it.
+//-------------------------------------------------------------------
+int Clock::PickVictim()
+{
+	for (int i = 0; i < 2 * numOfBuf; i++) {
+		int frameNo = (int)((unsigned)AtomicAdd(&current, 1) % (unsigned)numOfBuf);
+		ClockFrame *frame = frames[frameNo];
+		if (!frame->NotPinned())
+			continue;
+		if (frame->IsReferenced())
+			frame->UnsetReferenced();
+		else
+			return frameNo;
+	}
+	return INVALID_FRAME;
+}
+
+//	Frames without a page and hated pages are taken the next time the
+//	hand comes by.
+void Clock::Freed(int frameNo)
+{
+	frames[frameNo]->UnsetReferenced();
+}
+
+void Clock::Hated(int frameNo)
+{
+	frames[frameNo]->UnsetReferenced();
+}
+
+
+//-------------------------------------------------------------------
+// GhostList
+//
+// A ring of page ids in the order they were pushed.  Removing an id
+// leaves a hole in the ring, which is skipped when it becomes the
+// oldest slot.  The hash table maps each id to its slot.
+//-------------------------------------------------------------------
+
+GhostList::GhostList(int capacity)
+	: capacity(capacity > 0 ? capacity : 1), head(0), used(0), count(0)
+{
+	ring = new PageID[this->capacity];
+	positions.Reserve(this->capacity);
+}
+
+GhostList::~GhostList()
+{
+	delete [] ring;
+}
+
+void GhostList::PopOldest()
+{
+	if (ring[head] != INVALID_PAGE) {
+		positions.Delete(ring[head]);
+		count--;
+	}
+	head = (head + 1) % capacity;
+	used--;
+}
+
+void GhostList::Push(PageID pid)
+{
+	Remove(pid);
+	if (used == capacity)
+		PopOldest();
+	int slot = (head + used) % capacity;
+	ring[slot] = pid;
+	positions.Insert(pid, slot);
+	used++;
+	count++;
+}
+
+bool GhostList::Remove(PageID pid)
+{
+	int slot = positions.LookUp(pid);
+	if (slot == INVALID_FRAME)
+		return false;
+	positions.Delete(pid);
+	ring[slot] = INVALID_PAGE;
+	count--;
+	return true;
+}
+
+
+//-------------------------------------------------------------------
+// SampledReplacer
+//-------------------------------------------------------------------
+
+SampledReplacer::SampledReplacer(int bufSize, ClockFrame **frames)
+	: numOfBuf(bufSize), frames(frames), hand(0), now(1), coldCount(0), hotCount(0)
+{
+	history = new History[numOfBuf];
+	for (int i = 0; i < numOfBuf; i++) {
+		history[i].last = 0;
+		history[i].previous = 0;
+		history[i].queue = QUEUE_NONE;
+	}
+}
+
+SampledReplacer::~SampledReplacer()
+{
+	delete [] history;
+}
+
+//	References in the same tick count as one.
+void SampledReplacer::Touch(int frameNo)
+{
+	History &h = history[frameNo];
+	unsigned t = Now();
+	if (h.last != t) {
+		h.previous = h.last;
+		h.last = t;
+	}
+}
+
+//	Only called with the frame's partition latched exclusively, so no
+//	hit can move the frame at the same time.
+void SampledReplacer::SetQueue(int frameNo, int queue)
+{
+	int old = history[frameNo].queue;
+	if (old == queue)
+		return;
+	if (old == QUEUE_COLD)
+		AtomicAdd(&coldCount, -1);
+	else if (old == QUEUE_HOT)
+		AtomicAdd(&hotCount, -1);
+	if (queue == QUEUE_COLD)
+		AtomicAdd(&coldCount, 1);
+	else if (queue == QUEUE_HOT)
+		AtomicAdd(&hotCount, 1);
+	history[frameNo].queue = queue;
+}
+
+bool SampledReplacer::Older(int a, int b)
+{
+	return history[a].last < history[b].last;
+}
+
+
+//-------------------------------------------------------------------
+// SampledReplacer::Sample
+//
+// Input   : queue - the queue to replace from.
+// Output  : None
+// Return  : The oldest unpinned frame on queue among the frames
+//           sampled, else the oldest unpinned one on another queue;
+//           INVALID_FRAME if every frame was pinned.
+// Purpose : Advance time and the hand, and look at REPLACER_SAMPLE
+//           frames from where the hand was, taking further samples
+//           until one has an unpinned frame or the whole pool was
+//           looked at.
+//-------------------------------------------------------------------
+int SampledReplacer::Sample(int queue)
+{
+	int sample = (REPLACER_SAMPLE < numOfBuf) ? REPLACER_SAMPLE : numOfBuf;
+	AtomicAdd(&now, 1);
+
+	for (int looked = 0; looked < numOfBuf; looked += sample) {
+		unsigned start = (unsigned)(AtomicAdd(&hand, sample) - sample);
+		int best = INVALID_FRAME;
+		int other = INVALID_FRAME;
+		for (int i = 0; i < sample; i++) {
+			int frameNo = (int)((start + i) % (unsigned)numOfBuf);
+			if (!frames[frameNo]->NotPinned())
+				continue;
+			int q = history[frameNo].queue;
+			if (q == QUEUE_NONE)
+				return frameNo;
+			int &pick = (q == queue) ? best : other;
+			if (pick == INVALID_FRAME || Older(frameNo, pick))
+				pick = frameNo;
+		}
+		if (best != INVALID_FRAME)
+			return best;
+		if (other != INVALID_FRAME)
+			return other;
+	}
+	return INVALID_FRAME;
+}
+
+void SampledReplacer::Referenced(int frameNo)
+{
+	Touch(frameNo);
+}
+
+//	Loading is the page's first reference.
+void SampledReplacer::Loaded(int frameNo, PageID /* pid */)
+{
+	history[frameNo].previous = 0;
+	history[frameNo].last = Now();
+	SetQueue(frameNo, QUEUE_COLD);
+}
+
+void SampledReplacer::Evicted(int frameNo, PageID /* pid */)
+{
+	SetQueue(frameNo, QUEUE_NONE);
+}
+
+void SampledReplacer::Freed(int frameNo)
+{
+	SetQueue(frameNo, QUEUE_NONE);
+}
+
+//	A hated page goes back to the cold queue with no history, which
+//	makes it the first victim of any sample it is in; the pins a scan
+//	takes on its way through a page don't count as reuse.  Hits come in
+//	under a shared latch, so moving queues is a swap, as in ARC.
+void SampledReplacer::Hated(int frameNo)
+{
+	History &h = history[frameNo];
+	h.previous = 0;
+	h.last = 0;
+	if (AtomicCompareAndSwap(&h.queue, QUEUE_HOT, QUEUE_COLD)) {
+		AtomicAdd(&hotCount, -1);
+		AtomicAdd(&coldCount, 1);
+	}
+}
@@ -0,0 +1,438 @@
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <algorithm>
+
+#include "spacemap.h"
+#include "db.h"
+#include "logmgr.h"
+#include "pageio.h"
+#include "system_defs.h"
+
+SpaceMap spaceMap;
+
+//	The index of the lowest bit set in w, which isn't 0.
+static int LowestBit(unsigned w)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, w);
+	return (int)i;
+#else
+	return __builtin_ctz(w);
+#endif
+}
+
+//	How many bits are set in w from bit b up, before the first clear one.
+static int OnesFrom(unsigned w, int b)
+{
+	unsigned rest = w >> b;
+	return (rest == ~0u) ? 32 : LowestBit(~rest);
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap
+//-------------------------------------------------------------------
+
+SpaceMap::SpaceMap() : db(NULL), grownTo(0), numFree(0), cursor(0)
+{
+}
+
+//	Starts a new map if the database isn't the one the pages are from.
+void SpaceMap::Attach()
+{
+	const void *current = MINIBASE_DB;
+	if (db == current)
+		return;
+	db = current;
+	int words = (MINIBASE_DB->GetNumOfPages() + 31) / 32;
+	freeBits.assign(words, 0);
+	wordBits.assign((words + 31) / 32, 0);
+	owners.assign(words, SPACE_NO_OWNER);
+	punched.assign(words, false);
+	pending.clear();
+	lastPage.clear();
+	grownTo = 0;
+	numFree = 0;
+	cursor = 0;
+}
+
+//	Sets the pages free or not, which they aren't yet.
+void SpaceMap::Mark(PageID first, int count, bool free)
+{
+	for (PageID pid = first; pid < first + count; pid++) {
+		int w = pid / 32;
+		unsigned bit = 1u << (pid % 32);
+		if (free)
+			freeBits[w] |= bit;
+		else
+			freeBits[w] &= ~bit;
+		if (freeBits[w] != 0)
+			wordBits[w / 32] |= 1u << (w % 32);
+		else
+			wordBits[w / 32] &= ~(1u << (w % 32));
+	}
+	numFree += free ? count : -count;
+}
+
+//	The first word from word on with a page free, or -1.
+int SpaceMap::NextWord(int word)
+{
+	if (word >= (int)freeBits.size())
+		return -1;
+	int s = word / 32;
+	unsigned bits = wordBits[s] & (~0u << (word % 32));
+	while (bits == 0) {
+		if (++s >= (int)wordBits.size())
+			return -1;
+		bits = wordBits[s];
+	}
+	return s * 32 + LowestBit(bits);
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::FindRun
+//
+// Input   : count - number of pages.
+// Output  : None
+// Return  : The first of count free pages next to each other, or
+//           INVALID_PAGE if no pages held are.
+// Purpose : A single page comes from the word of the cursor or the
+//           next one with a page free, so pages freed together are
+//           handed out together.  A run is looked for from the start.
+//           Any owner's pages will do.
+//-------------------------------------------------------------------
+PageID SpaceMap::FindRun(int count)
+{
+	if (count == 1) {
+		int w = NextWord(cursor);
+		if (w < 0)
+			w = NextWord(0);
+		if (w < 0)
+			return INVALID_PAGE;
+		cursor = w;
+		return w * 32 + LowestBit(freeBits[w]);
+	}
+
+	PageID start = INVALID_PAGE;
+	int run = 0;
+	for (int w = NextWord(0); w >= 0; w = NextWord(w + 1)) {
+		unsigned bits = freeBits[w];
+		while (bits != 0) {
+			int b = LowestBit(bits);
+			int len = OnesFrom(bits, b);
+			PageID pid = w * 32 + b;
+			if (run == 0 || pid != start + run) {
+				start = pid;
+				run = 0;
+			}
+			run += len;
+			if (run >= count)
+				return start;
+			bits = (len == 32) ? 0 : bits & ~(((1u << len) - 1) << b);
+		}
+	}
+	return INVALID_PAGE;
+}
+
+
+//	The first free page from page from on, before page to, in an extent
+//	of owner's or of nobody's, or INVALID_PAGE.
+PageID SpaceMap::FindFree(PageID from, PageID to, int owner)
+{
+	if (from < 0)
+		from = 0;
+	for (int w = NextWord(from / 32); w >= 0 && w * 32 < to; w = NextWord(w + 1)) {
+		if (owners[w] != owner && owners[w] != SPACE_NO_OWNER)
+			continue;
+		unsigned bits = freeBits[w];
+		if (w == from / 32)
+			bits &= ~0u << (from % 32);
+		if (bits != 0) {
+			PageID pid = w * 32 + LowestBit(bits);
+			return (pid < to) ? pid : INVALID_PAGE;
+		}
+	}
+	return INVALID_PAGE;
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Extend
+//
+// Input   : count - number of pages wanted.
+//           owner - whose extent it is.
+// Output  : first - the first of them.
+// Return  : OK if successful, FAIL if DB has no count free pages
+//           next to each other.
+// Purpose : Take an extent of SPACE_EXTENT pages from DB, or of count
+//           if more, and keep what count leaves.  Where DB has no run
+//           that long, a shorter one will do.
+//-------------------------------------------------------------------
+Status SpaceMap::Extend(int count, PageID &first, int owner)
+{
+	for (int n = std::max(count, SPACE_EXTENT); ; n = std::max(count, n / 2)) {
+		if (MINIBASE_DB->AllocatePage(first, n) == OK) {
+			if (n > count)
+				Mark(first + count, n - count, true);
+			for (int w = first / 32; w <= (first + n - 1) / 32; w++) {
+				if (owners[w] == SPACE_NO_OWNER)
+					owners[w] = owner;
+			}
+			Grow(first, first + n);
+			return OK;
+		}
+		if (n == count)
+			return FAIL;
+	}
+}
+
+
+//	Has the file preallocated up to page end, from first on, in pieces
+//	of SPACE_GROW pages.
+void SpaceMap::Grow(PageID first, PageID end)
+{
+	if (end <= grownTo)
+		return;
+	PageID from = std::max(grownTo, first - first % SPACE_GROW);
+	PageID to = end + (SPACE_GROW - end % SPACE_GROW) % SPACE_GROW;
+	pageIO.Preallocate(from, to - from);
+	grownTo = to;
+}
+
+//	Gives blocks back to the words of the pages taken that had a hole.
+void SpaceMap::Refill(PageID first, int count)
+{
+	for (int w = first / 32; w <= (first + count - 1) / 32; w++) {
+		if (punched[w]) {
+			pageIO.Preallocate(w * 32, 32);
+			punched[w] = false;
+		}
+	}
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Allocate
+//
+// Input   : count - number of pages next to each other.
+//           near - a page to put a single page after, or INVALID_PAGE.
+//           owner - whose extents to take a single page from.
+// Output  : first - the first of them.
+// Return  : OK if successful, FAIL otherwise.
+// Purpose : Take the pages from those held if the owner has them
+//           free, from a new extent if not, and from any held if the
+//           database has no room left.
+//-------------------------------------------------------------------
+Status SpaceMap::Allocate(PageID &first, int count, PageID near, int owner)
+{
+	if (minibase_globals == NULL || MINIBASE_DB == NULL || count <= 0)
+		return FAIL;
+	Attach();
+
+	first = INVALID_PAGE;
+	if (count > 1)
+		first = FindRun(count);
+	else if (owner != SPACE_NO_OWNER) {
+		if (near != INVALID_PAGE)
+			first = FindFree(near + 1, near + SPACE_EXTENT, owner);
+		std::map<int, PageID>::iterator last = lastPage.find(owner);
+		if (first == INVALID_PAGE && last != lastPage.end())
+			first = FindFree(last->second + 1, last->second + SPACE_EXTENT, owner);
+	} else {
+		first = FindFree(cursor * 32, (int)freeBits.size() * 32, owner);
+		if (first == INVALID_PAGE)
+			first = FindFree(0, cursor * 32, owner);
+	}
+
+	if (first != INVALID_PAGE)
+		Mark(first, count, false);
+	else if (Extend(count, first, owner) != OK) {
+		first = FindRun(count);
+		if (first == INVALID_PAGE)
+			return FAIL;
+		Mark(first, count, false);
+	}
+	Refill(first, count);
+	cursor = first / 32;
+	if (owner != SPACE_NO_OWNER)
+		lastPage[owner] = first;
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Free
+//
+// Input   : first, count - the pages.
+// Output  : None
+// Return  : OK if successful, FAIL if a page is out of the database
+//           or free already, or DB didn't take a page back.
+// Purpose : Take the pages back, and give DB back each word they leave
+//           with every page free, and pages beyond SPACE_HOLD.  While
+//           the log is on, the pages wait for the next checkpoint
+//           instead; see Settle.
+//-------------------------------------------------------------------
+Status SpaceMap::Free(PageID first, int count)
+{
+	if (minibase_globals == NULL || MINIBASE_DB == NULL)
+		return FAIL;
+	Attach();
+	if (first < 0 || count <= 0 || first + count > (int)freeBits.size() * 32)
+		return FAIL;
+	for (PageID pid = first; pid < first + count; pid++) {
+		if (freeBits[pid / 32] & (1u << (pid % 32)))
+			return FAIL;
+	}
+	if (logMgr.IsLogging()) {
+		for (PageID pid = first; pid < first + count; pid++)
+			pending.push_back(pid);
+		return OK;
+	}
+	Mark(first, count, true);
+	return Trim(first / 32, (first + count - 1) / 32);
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Settle
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if DB didn't take a page back.
+// Purpose : Free the pages freed since the last checkpoint, as Free
+//           does with the log off.  Until the update that frees a
+//           page is on disk, a crash can bring back the pages that
+//           point at it, so it must keep what it held: it can't be
+//           handed out again, given back to DB or have a hole punched
+//           over it.  A checkpoint has every update on disk, and the
+//           log emptied, so nothing replays into the pages either.
+//-------------------------------------------------------------------
+Status SpaceMap::Settle()
+{
+	if (db == NULL || minibase_globals == NULL || db != MINIBASE_DB) {
+		pending.clear();
+		return OK;
+	}
+	Status s = OK;
+	for (size_t i = 0; i < pending.size(); i++) {
+		PageID pid = pending[i];
+		if ((freeBits[pid / 32] & (1u << (pid % 32))) == 0)
+			Mark(pid, 1, true);
+	}
+	for (size_t i = 0; i < pending.size(); i++) {
+		if (Trim(pending[i] / 32, pending[i] / 32) != OK)
+			s = FAIL;
+	}
+	pending.clear();
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Trim
+//
+// Input   : from, to - the words that pages were freed in.
+// Output  : None
+// Return  : OK if successful, FAIL if DB didn't take a page back.
+// Purpose : Give DB back the words from from to to that have every
+//           page free.  Past SPACE_HOLD pages held free, give back
+//           runs from the start of the map until half that are left.
+//-------------------------------------------------------------------
+Status SpaceMap::Trim(int from, int to)
+{
+	for (int w = from; w <= to; w++) {
+		if (freeBits[w] == ~0u && GiveBack(w * 32, 32) != OK)
+			return FAIL;
+	}
+	if (numFree <= SPACE_HOLD)
+		return OK;
+	while (numFree > SPACE_HOLD / 2) {
+		int w = NextWord(0);
+		PageID start = w * 32 + LowestBit(freeBits[w]);
+		int len = std::min(FreeRun(start), numFree - SPACE_HOLD / 2);
+		if (GiveBack(start, len) != OK)
+			return FAIL;
+	}
+	return OK;
+}
+
+//	How many pages from start on are free, next to each other.
+int SpaceMap::FreeRun(PageID start)
+{
+	int len = 0;
+	for (PageID pid = start; pid < (int)freeBits.size() * 32
+		 && (freeBits[pid / 32] & (1u << (pid % 32))); pid++)
+		len++;
+	return len;
+}
+
+//	Deallocates free pages in DB, and punches a hole in the file over
+//	the words they cover whole.
+Status SpaceMap::GiveBack(PageID start, int count)
+{
+	if (MINIBASE_DB->DeallocatePage(start, count) != OK)
+		return FAIL;
+	Mark(start, count, false);
+	int first = (start + 31) / 32;
+	int end = (start + count) / 32;
+	if (first < end) {
+		pageIO.PunchHole(first * 32, (end - first) * 32);
+		for (int w = first; w < end; w++)
+			punched[w] = true;
+	}
+	return OK;
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Release
+//
+// Input   : None
+// Output  : None
+// Return  : OK if successful, FAIL if DB didn't take a page back.
+// Purpose : Give the pages held back to DB, a run at a time, and
+//           start over.
+//-------------------------------------------------------------------
+Status SpaceMap::Release()
+{
+	Status s = OK;
+	if (db != NULL && minibase_globals != NULL && db == MINIBASE_DB) {
+		for (int w = NextWord(0); w >= 0; w = NextWord(w)) {
+			PageID start = w * 32 + LowestBit(freeBits[w]);
+			int len = FreeRun(start);
+			if (GiveBack(start, len) != OK) {
+				s = FAIL;
+				Mark(start, len, false);
+			}
+		}
+	}
+	Discard();
+	return s;
+}
+
+
+//-------------------------------------------------------------------
+// SpaceMap::Discard
+//
+// Input   : None
+// Output  : None
+// Return  : None
+// Purpose : Forget the pages held without giving them back, as a crash
+//           would, and start over.
+//-------------------------------------------------------------------
+void SpaceMap::Discard()
+{
+	db = NULL;
+	freeBits.clear();
+	wordBits.clear();
+	owners.clear();
+	punched.clear();
+	pending.clear();
+	lastPage.clear();
+	grownTo = 0;
+	numFree = 0;
+	cursor = 0;
+}
@@ -0,0 +1,52 @@
+#include "replacer.h"
+
+
+//-------------------------------------------------------------------
+// TwoQ::TwoQ
+//
+// Input   : bufSize - number of frames.
+//           frames - the frames, shared with the buffer manager.
+// Output  : None
+// Return  : None
+// Purpose : The cold queue may hold a quarter of the pool, and its
+//           ghost list half the pool's worth of ids, as in the paper.
+//-------------------------------------------------------------------
+TwoQ::TwoQ(int bufSize, ClockFrame **frames)
+	: SampledReplacer(bufSize, frames), coldGhosts(bufSize / 2)
+{
+	maxCold = (bufSize / 4 > 0) ? bufSize / 4 : 1;
+}
+
+int TwoQ::PickVictim()
+{
+	return Sample((coldCount > maxCold) ? QUEUE_COLD : QUEUE_HOT);
+}
+
+//	The cold queue is FIFO: hits don't move its pages.
+void TwoQ::Referenced(int frameNo)
+{
+	if (history[frameNo].queue == QUEUE_HOT)
+		Touch(frameNo);
+}
+
+void TwoQ::Loaded(int frameNo, PageID pid)
+{
+	bool wasGhost;
+	{
+		MutexGuard guard(ghostMutex);
+		wasGhost = coldGhosts.Remove(pid);
+	}
+	history[frameNo].previous = 0;
+	history[frameNo].last = Now();
+	SetQueue(frameNo, wasGhost ? QUEUE_HOT : QUEUE_COLD);
+}
+
+//	Only victims of the cold queue are remembered.
+void TwoQ::Evicted(int frameNo, PageID pid)
+{
+	if (history[frameNo].queue == QUEUE_COLD) {
+		MutexGuard guard(ghostMutex);
+		coldGhosts.Push(pid);
+	}
+	SetQueue(frameNo, QUEUE_NONE);
+}
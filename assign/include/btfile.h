@@ -6,12 +6,31 @@
 #include "index.h"
 #include "btfilescan.h"
 #include "bt.h"
+#include "latch.h"
+#include "frame.h"
+
+class TraceWriter;
+
+#define BT_MAX_HEIGHT       32		// deepest tree Insert and Delete can walk
+#define BT_MAX_INDEX_ENTRY  (MAX_KEY_SIZE + (int)sizeof(PageID))
+#define BT_MIN_USED_SPACE   (HEAPPAGE_DATA_SIZE / 2)	// below this a non-root page underflows
+#define BT_OPTIMISTIC_ATTEMPTS 8	// conflicts a lock-free walk takes before latching the index pages
+#define BT_CACHED_LEVELS    2		// index levels from the root kept pinned
+#define BT_CACHED_PAGES     16		// pages kept pinned, at most an eighth of the buffer pool
+#define BT_REORG_RUN        32		// pages Reorganize takes at a time to put leaves in
+#define BT_FORMAT_MAGIC     0x42547265	// marks a header page that records its format
+#define BT_FORMAT_VERSION   2		// 1 had no format record
+#define BT_FORMAT_OFFSET    16		// of the format record, past any width of root page id
 
 enum PrintOption
 { SINGLE,
   RECURSIVE
 };
 
+//	Insert, Delete, Search and scans may run in several threads at once
+//	on one BTreeFile; see OptimisticSearch, CrabToLeaf, Insert and
+//	Descend for the latch protocol.
+//	Opening, DestroyFile and the Print and Dump functions may not.
 class BTreeFile: public IndexFile {
 	
 public:
@@ -19,12 +38,17 @@ public:
 	friend class BTreeDriver;
 	friend class BTreeFileScan;
 
-    BTreeFile(Status& status, const char *filename);
+    // A read-only index must exist; Insert, Delete and DestroyFile
+    // fail on it.  Under a read-only buffer manager every index must
+    // be opened read-only.
+    BTreeFile(Status& status, const char *filename, bool readOnly = false);
 
 	~BTreeFile();
 	
+    // While the log is on, each is one update of it, and the index is
+    // recovered from the log when next opened after a crash; see
+    // LogMgr.
     Status DestroyFile();
-	
     Status Insert(const char *key, const RecordID rid); 
     Status Delete(const char *key, const RecordID rid);
     
@@ -33,6 +57,14 @@ public:
 
 	Status Search(const char *key,  PageID& foundPid);
 
+	// Compacts and reorders up to steps leaves, going on from the last
+	// call; DONE once a pass over the leaves is over.  May run beside
+	// any other operation, but in one thread at a time.
+	Status Reorganize(int steps);
+
+	// Records every Insert, Delete and scan into writer (NULL to stop).
+	void SetTraceWriter(TraceWriter *writer) { trace = writer; }
+
 	Status PrintTree (PageID pageID, PrintOption option);
 	Status PrintWhole ();
 	Status DumpStatistics();
@@ -45,6 +77,28 @@ private:
 		void Init(PageID hpid) {
 			HeapPage::Init(hpid);
 			SetRootPageID(INVALID_PAGE);
+			Format *format = (Format *)(HeapPage::data + BT_FORMAT_OFFSET);
+			format->magic = BT_FORMAT_MAGIC;
+			format->version = BT_FORMAT_VERSION;
+			format->pageIDSize = sizeof(PageID);
+		}
+
+		// Whether the page holds a header at all.  A header page that
+		// was never written, or had a hole punched over it, reads as
+		// zeros, with DB's own page 0 as the root.
+		bool IsValid() {
+			return GetRootPageID() != 0;
+		}
+
+		// Whether pages written in this format can be read: the version is
+		// not newer and page ids are as wide as they are here.  Version 1
+		// headers, which record nothing, were written with 4-byte ids.
+		bool IsReadable() {
+			Format *format = (Format *)(HeapPage::data + BT_FORMAT_OFFSET);
+			if (format->magic != BT_FORMAT_MAGIC)
+				return sizeof(PageID) == 4;
+			return format->version <= BT_FORMAT_VERSION
+				&& format->pageIDSize == (int)sizeof(PageID);
 		}
 
 		PageID GetRootPageID() {
@@ -56,11 +110,47 @@ private:
 			PageID *ptr = (PageID *)(HeapPage::data);
 			*ptr = pid;
 		}
+
+	private:
+		// Kept at a fixed offset so that it can be read before the width
+		// of the page ids around it is known.
+		struct Format {
+			int magic;
+			short version;
+			short pageIDSize;
+		};
     };
 
 	BTreeHeaderPage *header;   // header page
     PageID           headerID; // page number of header page
     char            *dbname;       // copied from arg of the constructor.	
+	TraceWriter     *trace;        // NULL unless ops are being recorded
+	bool             readOnly;     // opened only to be read
+	EventCounter     merges;       // advanced by every merge and redistribution
+
+	// Index pages near the root, each holding a pin of its own, so a
+	// walk finds them without the buffer manager.  Entries are added
+	// and removed only under the page's exclusive latch, and cleared
+	// before the page is freed; see CachePage.
+	struct CachedPage {
+		volatile PageID pid;	// INVALID_PAGE if the entry is unused
+		SortedPage * volatile page;
+		volatile int swips[FRAME_SWIPS];	// see BufMgr::Swips
+	};
+	CachedPage       cache[BT_CACHED_PAGES];
+	int              maxCached;    // entries the buffer pool can spare
+	volatile int     numCached;
+	int              cacheHand;    // next entry to give up for a new root
+	Mutex            cacheMutex;   // serializes adding and removing entries
+
+	// Where Reorganize is: the leaf it does next is the one for
+	// reorgKey, and goes after reorgPrev.  Leaves are moved to the
+	// reorgLeft pages from reorgRun on, which are allocated but unused.
+	KeyType          reorgKey;
+	PageID           reorgPrev;
+	PageID           reorgRun;
+	int              reorgLeft;
+	Mutex            reorgMutex;
     
 	int				totalDataPages;
 	int				totalIndexPages;
@@ -74,27 +164,83 @@ private:
 	int				totalNumData;
 	int				hight; // hight of Tree
 
-	Status _Search( const char *key,  PageID, PageID&);
-	Status _SearchIndex (const char *key,  PageID currIndexID, BTIndexPage *currIndex, PageID& foundID);
 	Status _PrintTree ( PageID pageID);
 
 	Status BTreeFile::_DumpStatistics(PageID);
 	Status BTreeFile::__DumpStatistics(PageID);
 
 	// You may add members and methods here.
-	Status BTreeFile::InsertRootIsLeaf(const char * key, const RecordID rid, BTLeafPage *& oldRoot);
 	//value will be INVALID_PAGE if we don't need to push up.
 	struct IndexEntry {
 		KeyType key;
 		PageID value;
 	};
-	Status BTreeFile::InsertRootIsIndex(const char * key, const RecordID rid, BTIndexPage * root);
-	Status BTreeFile::InsertIntoIndex(const char * key, const RecordID rid, BTIndexPage* curPage, IndexEntry *&newEntry);
-	Status BTreeFile::InsertIntoLeaf(const char * key, const RecordID rid, BTLeafPage* curPage, IndexEntry *&newEntry);
+	// An index page on the way from the root to a leaf, and the slot of
+	// the child taken (-1 for the left link).  page is NULL once the
+	// page has been released.
+	struct PathEntry {
+		PageID pid;
+		SortedPage *page;
+		int slot;
+		bool dirty;
+	};
+	// The pages a delete holds exclusive latches on.
+	struct TreePath {
+		PathEntry level[BT_MAX_HEIGHT];
+		int depth;				// index pages on the path
+		int top;				// pages above this level have been released
+		bool headerLatched;		// the root page id may still change
+		bool rootChanged;		// and it did
+	};
+	// The index pages a walk came through, from the root down, and the
+	// merge count it started at; an insert posts separators through it.
+	struct WalkPath {
+		PageID level[BT_MAX_HEIGHT];
+		unsigned merges;
+	};
+	SortedPage *LookUpCached(PageID pid, volatile int **swips = NULL);
+	void CachePage(PageID pid, bool makeRoom);
+	void CacheUpperPage(PageID pid, unsigned mergesSeen);
+	void UncachePage(PageID pid);
+	void DropCache();
+	Status PinLatched(PageID pid, SortedPage *&page);
+	Status LatchPage(PageID pid, LatchMode mode, SortedPage *&page);
+	Status ReleasePage(PageID pid, LatchMode mode, bool dirty, bool hate = false);
+	Status MoveRight(const char *key, LatchMode mode, PageID &pid, SortedPage *&page);
+	Status SearchLeaf(const char *key, LatchMode leafMode, PageID &leafID,
+					  BTLeafPage *&leaf, int &depth, WalkPath *walk = NULL);
+	Status OptimisticSearch(const char *key, LatchMode leafMode, PageID &leafID,
+							BTLeafPage *&leaf, int &depth, WalkPath *walk, bool &gaveUp);
+	Status CrabToLeaf(const char *key, LatchMode leafMode, PageID &leafID,
+					  BTLeafPage *&leaf, int &depth, WalkPath *walk);
+	Status Descend(const char *key, TreePath &path, PageID &leafID, BTLeafPage *&leaf);
+	Status ReleasePath(TreePath &path, int to);
+	Status NewNode(NodeType type, PageID near, PageID &pid, SortedPage *&page);
+	Status DestroyIndex();
+	Status InsertKey(const char *key, const RecordID rid);
+	Status DeleteKey(const char *key, const RecordID rid);
+	Status DropNode(PageID pid);
+	Status SplitLeaf(BTLeafPage *leaf, const char *key, const RecordID rid, IndexEntry *newEntry);
+	Status DivideLeaf(BTLeafPage *leaf, BTLeafPage *right, const char *key,
+					  const RecordID rid, IndexEntry *newEntry);
+	Status SplitIndex(BTIndexPage *index, IndexEntry *newEntry);
+	Status DivideIndex(BTIndexPage *index, BTIndexPage *right, IndexEntry *newEntry,
+					   IndexEntry *pushed);
+	Status GrowRoot(IndexEntry *newEntry);
+	Status PostSeparator(IndexEntry *newEntry, PageID leftID, int height,
+						 WalkPath &walk, int depth);
+	Status MergeLeaves(PathEntry &parent, int sepSlot, PageID leftID, BTLeafPage *left,
+					   PageID rightID, BTLeafPage *right, PageID childID);
+	Status FixUnderflow(PathEntry &parent, PageID childID, SortedPage *child);
+	Status ReleaseMerged(PageID leftID, PageID rightID);
+	Status ReleaseSiblings(PageID leftID, PageID rightID, PageID childID);
+	Status RedistributeLeaves(BTLeafPage *left, BTLeafPage *right);
+	Status ReorganizeLeaf();
+	Status MoveLeaf(PathEntry &parent, PageID leafID, BTLeafPage *leaf, PageID &placeID);
+	Status EndReorganize();
+	Status RedistributeIndex(BTIndexPage *left, BTIndexPage *right, char *sepKey);
 	Status BTreeFile::RebalanceLeaf(BTLeafPage* leftPage, BTLeafPage* rightPage);
-	Status BTreeFile::RebalanceIndex(BTIndexPage* leftPage, BTIndexPage* rightPage, IndexEntry *& indexToPush);
-	Status BTreeFile::DeleteIsIndex(const char * key, const RecordID rid, BTIndexPage * index);
-	Status BTreeFile::DeleteIsLeaf(const char * key, const RecordID rid, BTLeafPage * leaf, bool &mergedWithRight);
+	Status RebalanceIndex(BTIndexPage* leftPage, BTIndexPage* rightPage, IndexEntry *indexToPush);
 };
 
 
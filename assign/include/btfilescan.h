@@ -3,8 +3,11 @@
 
 #include "btfile.h"
 #include "btleaf.h"
+#include <cstring>
 
 class BTreeFile;
+class TraceWriter;
+struct TraceOp;
 
 class BTreeFileScan : public IndexFileScan {
 	
@@ -16,18 +19,37 @@ public:
 
 	~BTreeFileScan();	
 
+	// Closed scans are kept on a free list and reused by the next
+	// OpenScan instead of going back to the heap.
+	static void *operator new(size_t size);
+	static void operator delete(void *p);
+
 private:
-	BTreeFileScan::BTreeFileScan(BTLeafPage * lp, RecordID rid, RecordID dataRid, char * curKey, const char * hi = NULL, bool upperBounded = true)
-	 :current_entry(rid), hi(hi), leaf(lp), upperBounded(upperBounded), current_data(dataRid){
-		 if(lp !=NULL) memcpy(this->curKey, curKey, strlen(curKey)+1);
+	BTreeFileScan::BTreeFileScan(BTreeFile *btf, const char *lo, const char *hi)
+	 :btf(btf), leafID(INVALID_PAGE), slot(0), version(0), merges(0), started(false), done(false),
+	  lastKeyCount(0), hi(hi), upperBounded(hi != NULL), trace(NULL), traceOp(NULL){
+		 strncpy(lastKey, (lo != NULL) ? lo : "", MAX_KEY_SIZE); //assume "" is lowest string
 	}
 
-	BTLeafPage * leaf;
-	RecordID current_entry;
-	RecordID current_data;
+	//	No page stays latched or pinned between calls.  The scan remembers
+	//	where it stopped and the leaf's version.  If the leaf changed in
+	//	the meantime but nothing was merged, what comes after the last
+	//	key returned is still on the leaf or to its right; otherwise it
+	//	searches for that key from the root.
+	BTreeFile * btf;
+	PageID leafID;			// leaf of the next entry, INVALID_PAGE to search
+	int slot;				// slot of the next entry on leafID
+	unsigned version;		// version of leafID when slot was taken
+	unsigned merges;		// the tree's merge count then
+	bool started;			// whether an entry has been returned yet
+	bool done;
+	char lastKey[MAX_KEY_SIZE];	// last key returned, or the low key until then
+	RecordID lastRid;
+	int lastKeyCount;		// entries returned so far with key lastKey
 	const char * hi;
-	char curKey[MAX_KEY_SIZE];
 	bool upperBounded;
+	TraceWriter * trace;
+	TraceOp * traceOp;	// limit counts the entries returned so far
 };
 
 #endif
\ No newline at end of file
@@ -20,10 +20,16 @@ public:
 	Status Insert (const char *key, PageID pageNo, RecordID& rid);
 	Status Delete (const char *key, RecordID& curRid);
 	Status GetPageID (const char *key, PageID & pageNo);
+	Status GetPageID (const char *key, PageID & pageNo, int &slot);
 	Status GetSibling(const char *key, PageID & pageNo, int &left);
 	Status GetFirst (RecordID& rid, char *key, PageID & pageNo);
 	Status GetNext (RecordID& rid, char *key, PageID & pageNo);
 	
+	PageID GetChild (int slot);
+	void   SetChild (int slot, PageID pageNo);
+	void   GetKey (int slot, char *key);
+	Status DeleteEntry (int slot);
+
 	PageID GetLeftLink (void);
 	void   SetLeftLink (PageID left);
 	    
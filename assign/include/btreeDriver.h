@@ -50,8 +50,8 @@ private:
 	bool Test5();
 	bool Test6();
 	bool Test7();
+	bool Test8();
 	bool customTestCases(); 
-	void testPerformance();
 };
 
 
@@ -0,0 +1,147 @@
+
+#ifndef _B_TREE_BENCH_H_
+#define _B_TREE_BENCH_H_
+
+#include "btfile.h"
+#include "index.h"
+#include "logmgr.h"
+#include "workload.h"
+#include <vector>
+
+//	The workloads the benchmark knows how to run.  Every workload runs
+//	against a freshly created database and buffer pool.
+enum BenchWorkload {
+	BENCH_SEQ_INSERT,		// insert keys 0..n-1 in order
+	BENCH_RANDOM_INSERT,	// insert a random permutation of 0..n-1
+	BENCH_ZIPF_INSERT,		// insert n keys drawn from a Zipfian distribution
+	BENCH_POINT_LOOKUP,		// exact match scans on a loaded tree
+	BENCH_SHORT_SCAN,		// range scans of shortScanLen entries
+	BENCH_LONG_SCAN,		// range scans of longScanLen entries
+	BENCH_MIXED,			// readPercent lookups, the rest inserts
+	BENCH_DELETE_CHURN,		// delete a live key and insert a new one
+	BENCH_YCSB_A,			// YCSB core workloads A-F, see workload.h
+	BENCH_YCSB_B,
+	BENCH_YCSB_C,
+	BENCH_YCSB_D,
+	BENCH_YCSB_E,
+	BENCH_YCSB_F,
+	BENCH_REPLAY,			// replay traceFile; every other workload is in "all"
+	BENCH_NUM_WORKLOADS
+};
+
+enum BenchFormat {
+	BENCH_CSV,
+	BENCH_JSON
+};
+
+//	Parameters of a benchmark run.  Every combination of workload, key count,
+//	buffer pool size and thread count is run once.
+struct BenchConfig {
+	std::vector<int> workloads;
+	std::vector<int> keyCounts;
+	std::vector<int> bufPoolSizes;
+	std::vector<int> threadCounts;	// threads running the measured phase
+	int numOps;				// measured operations for the read/mixed workloads, in total
+	int readPercent;		// lookups in BENCH_MIXED, 0-100
+	int shortScanLen;
+	int longScanLen;
+	double zipfTheta;
+	unsigned long seed;
+	unsigned dbPages;
+	BenchFormat format;
+	const char *outFile;	// NULL for stdout
+	const char *traceFile;	// input of BENCH_REPLAY
+	const char *recordFile;	// if set, the measured ops are recorded here (last run wins)
+	const char *policy;		// buffer replacement policy
+	int ioThreads;			// PageIO threads, 0 to read and write synchronously
+	bool cleaner;			// whether the page cleaner runs
+	bool readOnly;			// read-only workloads run on the mapped file
+	bool direct;			// page I/O bypasses the OS cache
+	bool reorganize;		// the loaded tree is reorganized before the measured phase
+	LogMode log;			// how updates are logged
+
+	BenchConfig();
+	Status Parse(int argc, char *argv[]);
+	static void PrintUsage(ostream &os);
+};
+
+//	What one run measured.  Latencies are in microseconds.  With more than
+//	one thread, seconds is wall clock time rather than the sum of the
+//	latencies.
+struct BenchResult {
+	BenchWorkload workload;
+	int numKeys;
+	int bufPoolSize;
+	int threads;
+	long numOps;
+	double seconds;
+	double opsPerSec;
+	double latP50, latP90, latP99, latP999, latMax;
+	long pins;
+	long misses;
+	double hitRate;
+};
+
+//	The measured phase as run by one thread.  Thread part of numParts
+//	takes every numParts-th key to insert and an equal share of the
+//	other operations, so that threads never insert the same key.
+class BenchThread {
+
+public:
+
+	BenchThread(const BenchConfig &config, BTreeFile *btf, BenchWorkload workload,
+				int numKeys, std::vector<long> &keys, int part, int numParts,
+				const WorkloadRandom &rnd)
+		: reader(NULL), status(OK), config(config), btf(btf), workload(workload),
+		  numKeys(numKeys), keys(keys), part(part), numParts(numParts), rnd(rnd) {}
+
+	Status Run();
+
+	std::vector<double> latencies;
+	TraceReader *reader;	// BENCH_REPLAY only, which runs on one thread
+	Status status;
+
+private:
+
+	const BenchConfig &config;
+	BTreeFile *btf;
+	BenchWorkload workload;
+	int numKeys;
+	std::vector<long> &keys;
+	int part, numParts;
+	WorkloadRandom rnd;
+};
+
+class BTreeBench {
+
+public:
+
+	BTreeBench(const BenchConfig &config) : config(config) {}
+
+	Status RunBenchmarks();
+
+	static const char *WorkloadName(int workload);
+
+	// Monotonic high resolution clock, in microseconds.
+	static double NowMicros();
+
+private:
+
+	const BenchConfig &config;
+
+	Status RunOne(BenchWorkload workload, int numKeys, int bufPoolSize,
+				  int numThreads, BenchResult &result);
+	Status RunWorkload(BTreeFile *&btf, BenchWorkload workload, int numKeys,
+					   int numThreads, std::vector<double> &latencies,
+					   double &wallMicros);
+
+	static Status RunThreads(std::vector<BenchThread *> &threads);
+	static void Summarize(std::vector<double> &latencies, double wallMicros,
+						  BenchResult &result);
+	static void WriteHeader(ostream &os, BenchFormat format);
+	static void WriteResult(ostream &os, BenchFormat format,
+							const BenchResult &result, bool first);
+	static void WriteFooter(ostream &os, BenchFormat format);
+};
+
+#endif
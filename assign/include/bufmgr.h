@@ -1,4 +1,3 @@
-
 #ifndef _BUF_H
 #define _BUF_H
 
@@ -7,19 +6,71 @@
 #include "frame.h"
 #include "replacer.h"
 #include "hash.h"
+#include "latch.h"
+#include "pageio.h"
+#include "cleaner.h"
+#include "spacemap.h"
+
+//	The page table is split into partitions by page id, each with its
+//	own latch, hash table and statistics.  Hits take only the shared
+//	latch of their partition; misses take it exclusively to map the
+//	page to a frame, but not while it is read.  The frames
+//	are shared by all partitions, and a miss may take a victim from
+//	another partition if it can latch that one without waiting.
+const int BUF_PARTITIONS = 16;
+
+//	How long a pin waits for a frame to be unpinned when every frame
+//	is pinned, before it fails.
+const int PIN_RETRIES = 1000;
+const int PIN_RETRY_MICROS = 1000;
+
+//	The most pages one Prefetch reads.
+const int BUF_READAHEAD = 8;
+
+struct BufPartition
+{
+	Latch latch;
+	HashTable hashTable;
+	volatile int totalCall;
+	volatile int totalHit;
+
+	BufPartition() : totalCall(0), totalHit(0) {}
+};
+
+//	The database is not thread safe.  dbMutex is held around page
+//	allocation and the file directory, dbIOMutex around reading and
+//	writing pages through DB, which PageIO only falls back on.  dbMutex comes before any partition latch, since
+//	allocating pins the space map, and dbIOMutex after them.
+extern Mutex dbMutex;
+extern Mutex dbIOMutex;
 
+struct FrameRef;
+
+//	SystemDefs, in a prebuilt library, allocates the buffer manager with
+//	the size this class used to have; it must not grow.
 class BufMgr 
 {
 	private:
 
-		HashTable *hashTable;
+		BufPartition *partitions;
 		ClockFrame **frames;
 		Replacer *replacer;
 		int   numOfBuf;
 
-		int FindFrame( PageID pid );
-		long totalCall;
-		long totalHit;
+		BufPartition &Partition( PageID pid ) { return partitions[(unsigned)pid % BUF_PARTITIONS]; }
+		Status ClaimFrame( BufPartition &part, int &frameNo );
+		Status LoadPage( BufPartition &part, PageID pid, bool emptyPage, int &frameNo, bool pin=true );
+		void StartLoad( BufPartition &part, PageID pid, int frameNo );
+		void FinishLoad( int frameNo, PageID pid, Status s );
+		Status WaitForLoad( PageID pid, int frameNo );
+		Status ReserveFrame( PageID pid, int &frameNo );
+		bool TakeForWrite( int frameNo, bool unpinnedOnly, FrameRef &taken );
+		Status WriteTaken( FrameRef *taken, int count );
+		void Dirty( ClockFrame *frame );
+		friend class FrameFill;
+
+		// What Swips gives for pages that aren't in a frame.
+		static volatile int noSwips[FRAME_SWIPS];
 
 	public:
 
@@ -27,12 +78,79 @@ class BufMgr
 		~BufMgr();      
 		Status PinPage( PageID pid, Page*& page, bool emptyPage=false );
 		Status UnpinPage( PageID pid, bool dirty=false );
+		// The prebuilt database calls the two argument form.
+		Status UnpinPage( PageID pid, bool dirty, bool hate );
+		// Marks a page the caller keeps pinned as changed, for callers
+		// that change a page many times before unpinning it.
+		Status DirtyPage( PageID pid );
+		// Logs the changes to pages the caller has pinned as one group,
+		// which is replayed after a crash whole or not at all: changes
+		// that only make sense together, logged before any of the
+		// pages is unpinned.  Unpinning a page dirty and DirtyPage log
+		// a page on its own.  Does nothing while the log is off; see
+		// LogMgr.
+		Status LogPages( const PageID *pids, int count );
 		Status NewPage( PageID& pid, Page*& firstpage,int howmany=1 ); 
+		// A page after near, if one is free close by, in an extent of
+		// owner's; see SpaceMap.
+		Status NewPage( PageID& pid, Page*& firstpage, int howmany, PageID near, int owner );
 		Status FreePage( PageID pid ); 
 		Status FlushPage( PageID pid );
 		Status FlushAllPages();
-		Status  GetStat(long& pinNo, long& missNo) { pinNo = totalCall; missNo = totalCall-totalHit; return OK;}
-		void   ResetStat() { totalHit = 0; totalCall = 0; }
+		// Drops every page without writing it, as a crash would; see
+		// LogMgr::Discard.
+		Status DiscardAllPages();
+
+		// Writes unpinned dirty pages, up to CLEANER_BATCH of them or an
+		// eighth of the pool and in order of page id, until no more
+		// than keepDirty are left.
+		// Returns how many were written.  For the page cleaner.
+		int CleanPages( int keepDirty );
+
+		// Starts reading pages the caller will want soon, without
+		// waiting for them or pinning them: howmany pages from pid on,
+		// up to BUF_READAHEAD, read together.
+		Status Prefetch( PageID pid, int howmany=1 );
+		Status  GetStat(long& pinNo, long& missNo);
+		void   ResetStat();
+
+		// Copies a page without leaving it pinned, for readers that hold
+		// no latch on it; the copy may be torn by a writer and must be
+		// checked against the page's version before use.  FreePage never
+		// finds a page pinned by a copy.
+		Status CopyPage( PageID pid, Page *copy );
+		// Like CopyPage, but first tries the page in frameNo, where the
+		// caller last found it, without the page table or any latch.
+		// frameNo is set to the frame the page was copied from.
+		Status CopyPage( PageID pid, Page *copy, int &frameNo );
+
+		// FRAME_SWIPS frame numbers the page in frameNo can keep for the
+		// pages it refers to, so that a walk goes from a page straight
+		// to its child's frame: swizzled references kept beside the
+		// page instead of in it.  They are never unswizzled; CopyPage
+		// checks a hint before using it.  frameNo may be INVALID_FRAME,
+		// as CopyPage leaves it for a read-only page.
+		volatile int *Swips( int frameNo )
+		{
+			return (frameNo != INVALID_FRAME) ? frames[frameNo]->GetSwips() : noSwips;
+		}
+
+		// Serves every pin from a read-only mapping of the database
+		// file instead of the frames, for a database opened only to
+		// be read: pages aren't copied, and processes mapping the same
+		// file share them in the OS cache.  Nothing can be changed
+		// meanwhile; unpinning a page dirty, NewPage and FreePage fail.
+		// Frames are written out first, and must all be unpinned.
+		Status SetReadOnly( bool readOnly );
+		bool IsReadOnly() { return pageIO.IsMapped(); }
+
+		// Switches page I/O to or from bypassing the OS cache, see
+		// PageIO::SetDirect.  Frames are written out first, and must
+		// all be unpinned.
+		Status SetDirect( bool direct );
+
+		// "Clock" (the default), "LRU2", "2Q" or "ARC".
+		Status SetReplacementPolicy( const char *policy );
 
 		unsigned int GetNumOfBuffers();
 		unsigned int GetNumOfUnpinnedBuffers();
@@ -0,0 +1,65 @@
+#ifndef _CLEANER_H
+#define _CLEANER_H
+
+#include "minirel.h"
+#include "latch.h"
+
+class BufMgr;
+
+const int CLEANER_BATCH = 64;				// most pages written per pass
+const int CLEANER_INTERVAL_MICROS = 10000;	// between looks at the pool
+const int CLEANER_POLL_MICROS = 1000;		// how soon it notices Wake or Stop
+const int CLEANER_DIRTY_PERCENT = 10;		// unpinned frames it leaves dirty
+const int CLEANER_SKIPS = 8;				// dirty victims a miss passes over
+
+//	Writes dirty pages out on a thread of its own, ahead of eviction, so
+//	that a miss finds a clean victim instead of waiting for a write.
+//	Every CLEANER_INTERVAL_MICROS it has the buffer manager write
+//	unpinned dirty pages until only CLEANER_DIRTY_PERCENT of the pool
+//	is left dirty; a page rewritten all the time is written once per
+//	interval at most.  A miss that passes over a dirty victim wakes it
+//	at once, and then it writes every unpinned dirty page.
+//
+//	The buffer manager starts it when it is built and stops it before
+//	it goes away, unless it is disabled.
+class PageCleaner
+{
+	public :
+
+		PageCleaner();
+		~PageCleaner();
+
+		void Start(BufMgr *bm);
+		void Stop();
+		bool IsRunning() { return running; }
+		void Wake() { woken = 1; }
+
+		// Whether Start starts the thread.  Takes effect at the next Start.
+		void SetEnabled(bool on) { enabled = on; }
+		bool IsEnabled() { return enabled; }
+
+		// What the thread runs.
+		static void *Worker(void *cleaner);
+
+	private :
+
+#ifdef _WIN32
+		void *thread;
+#else
+		pthread_t thread;
+#endif
+		BufMgr *bm;
+		volatile int woken;
+		volatile int stopping;
+		volatile bool running;
+		bool enabled;
+
+		void Run();
+
+		PageCleaner(const PageCleaner &);
+		PageCleaner &operator=(const PageCleaner &);
+};
+
+extern PageCleaner pageCleaner;
+
+#endif
@@ -7,18 +7,18 @@ class ClockFrame : public Frame
 {
 	private :
 		
-		bool referenced;
+		volatile bool referenced;
 
  	public :
 
-		ClockFrame();
+		ClockFrame(Page *data);
 		~ClockFrame();
 	
-		void Unpin();
-		Status Free();
+		void Pin();
+		bool Unpin();
 		void UnsetReferenced();
 		bool IsReferenced();
 		bool IsVictim();
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -2,37 +2,67 @@
 #define FRAME_H
 
 #include "page.h"
+#include "logmgr.h"
 
 #define INVALID_FRAME -1
+#define FRAME_SWIPS   64	// child hints kept per frame, see BufMgr::Swips
 
+//	A frame of the buffer pool.  The page id and the dirty bit change
+//	only under the exclusive latch of the partition that maps the page;
+//	the pin count is atomic, so hits can pin under a shared latch.
+//	A frame with no page id belongs to no partition.  While a page is
+//	read into the frame, the frame is loading, and pinned by the read;
+//	while it is written out, it is writing, and pinned by the cleaner
+//	if the cleaner writes it.
+//	The page is the buffer manager's, which allocates the pages of all
+//	frames together, aligned for direct I/O.  While the log is on, the
+//	frame also keeps the page as it was last logged, which is what is
+//	written out, with where the log of it ends; see BufMgr::LogPages.
 class Frame 
 {
 	private :
 	
-		PageID pid;
+		volatile PageID pid;
 		Page   *data;
-		int    pinCount;
-		bool    dirty;
+		volatile int pinCount;
+		volatile bool dirty;
+		volatile int loading;
+		volatile int writing;
+		volatile int swips[FRAME_SWIPS];
+		Page   *image;
+		bool    imageValid;
+		LSN     lsn;
 
 	public :
 		
-		Frame();
+		Frame(Page *data);
 		~Frame();
 		void Pin();
-		void Unpin();
+		bool Unpin();
+		bool Claim();
 		void EmptyIt();
 		void DirtyIt();
+		bool TakeDirty();
+		void SetLoading(bool loading);
+		bool IsLoading();
+		void SetWriting(bool writing);
+		bool IsWriting();
 		void SetPageID(PageID pid);
 		bool IsDirty();
 		bool IsValid();
 		Status Write();
-		Status Read(PageID pid);
-		Status Free();
 		bool NotPinned();
+		int GetPinCount();
 		bool HasPageID(PageID pid);
 		PageID GetPageID();
 		Page *GetPage();
+		volatile int *GetSwips();
+		Page *GetImage();
+		void SetImage(bool valid);
+		Page *GetLoggedPage();
+		LSN GetLSN();
+		void SetLSN(LSN lsn);
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -4,70 +4,47 @@
 #include "minirel.h"
 #include "frame.h"
 
-#define NUM_OF_BUCKETS 21
-#define HASH(k)  k % NUM_OF_BUCKETS
+//	The smallest table, in slots.  Tables are always a power of two and
+//	at most half full, so a probe sequence is short and always ends at
+//	an empty slot.
+#define HASH_MIN_SLOTS 16
 
-	
-class Map
-{
-	friend class MapIterator;
-
-private :
-
-	int pid;
-	int frameNo;
-	class Map *next;
-	class Map *prev;
-
-public :
-	
-	Map(PageID p, int f);
-	~Map();
-	void AddBehind(Map *m);
-	void DeleteMe();
-	bool HasPageID(PageID p);
-	int FrameNo();
-
-};
 
-
-class MapIterator
-{
-	Map *head;
-	Map *current;
-
-public :
-
-	MapIterator(Map *maps);
-	Map* operator() ();
-
-};
-
-
-class Bucket
+//	Maps page ids to frames with open addressing and linear probing.
+//	Entries are kept inline, so a lookup touches only the slots it
+//	probes and nothing is allocated per entry.  Deleting shifts later
+//	entries of the probe sequence back instead of leaving tombstones.
+//	Not synchronized; the partition that owns the table latches it.
+class HashTable
 {
 private:
 
-	Map *maps;
+	struct Slot {
+		PageID pid;
+		int frameNo;
+	};
 
-public :
+	Slot *slots;
+	unsigned mask;
+	int shift;
+	int count;
 
-	Bucket();
-	~Bucket();
-	void Insert(PageID pid, int frameNo);
-	Status Delete(PageID pid);
-	int Find(PageID pid);
-	void EmptyIt();
-};
+	// Fibonacci hashing: the top bits of the product depend on every
+	// bit of the page id, and a partition's page ids share their low
+	// bits.
+	unsigned Home(PageID pid) { return ((unsigned)pid * 2654435769u) >> shift; }
+	void Resize(unsigned numSlots);
 
+	HashTable(const HashTable &);
+	HashTable &operator=(const HashTable &);
 
-class HashTable
-{
-private:
+public :
 
-	Bucket buckets[NUM_OF_BUCKETS];
+	HashTable();
+	~HashTable();
 
-public :
+	// Sizes the table for entries entries without growing.
+	void Reserve(int entries);
 
 	void Insert(PageID pid, int frameNo);
 	Status Delete(PageID pid);
@@ -76,4 +53,4 @@ public :
 };
 
 
-#endif
\ No newline at end of file
+#endif
@@ -76,6 +76,8 @@ public:
 						cerr << "Unable to pin page " << a << endl; return FAIL;}
 #define UNPIN(a, b) if (MINIBASE_BM->UnpinPage((a), (b)) != OK) {\
 						cerr << "Unable to unpin page " << a << endl; return FAIL;}
+#define UNPIN_HATED(a, b) if (MINIBASE_BM->UnpinPage((a), (b), true) != OK) {\
+						cerr << "Unable to unpin page " << a << endl; return FAIL;}
 #define FREEPAGE(a) if (MINIBASE_BM->FreePage((a)) != OK) {\
 						cerr << "Unable to free page " << a << endl; return FAIL;}
 #define NEWPAGE(a, b)  if (MINIBASE_BM->NewPage((a), (Page *&)(b)) != OK) {\
@@ -0,0 +1,177 @@
+#ifndef _LATCH_H
+#define _LATCH_H
+
+#include "minirel.h"
+#include "page.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+//	Short term synchronization for the index.  The Windows versions are
+//	slim reader/writer locks kept as an opaque pointer, so that this
+//	header does not drag in windows.h; see latch.cpp.
+
+enum LatchMode {
+	LATCH_SHARED,
+	LATCH_EXCLUSIVE
+};
+
+//	A reader/writer latch.  Not recursive: a thread must not take a
+//	latch it already holds, in either mode.
+class Latch {
+public:
+	Latch();
+	~Latch();
+
+	void LockShared();
+	void UnlockShared();
+	void LockExclusive();
+	bool TryLockExclusive();
+	void UnlockExclusive();
+
+	void Lock(LatchMode mode) { if (mode == LATCH_SHARED) LockShared(); else LockExclusive(); }
+	void Unlock(LatchMode mode) { if (mode == LATCH_SHARED) UnlockShared(); else UnlockExclusive(); }
+
+private:
+#ifdef _WIN32
+	void *srwLock;
+#else
+	pthread_rwlock_t rwLock;
+#endif
+
+	Latch(const Latch &);
+	Latch &operator=(const Latch &);
+};
+
+class Mutex {
+public:
+	Mutex();
+	~Mutex();
+
+	void Lock();
+	void Unlock();
+
+private:
+#ifdef _WIN32
+	void *srwLock;
+#else
+	pthread_mutex_t mutex;
+#endif
+
+	Mutex(const Mutex &);
+	Mutex &operator=(const Mutex &);
+};
+
+//	Holds a mutex for the lifetime of a scope.
+class MutexGuard {
+public:
+	MutexGuard(Mutex &m) : m(m) { m.Lock(); }
+	~MutexGuard() { m.Unlock(); }
+private:
+	Mutex &m;
+};
+
+
+//	One latch per page, looked up by page id.  The latches live in
+//	chunks of LATCH_CHUNK_SIZE that are allocated on first use and
+//	never freed, so a lookup takes no lock once its chunk exists.  A
+//	directory of LATCH_DIR_SIZE chunks is allocated the same way, and
+//	the top level has one for every 32-bit page id, so no two pages
+//	ever share a latch.
+//
+//	Each page also has a version.  Taking the exclusive latch makes it
+//	odd, and letting go makes it even again: one higher if the page was
+//	changed, back where it was if not.  A reader can therefore look at a
+//	page without latching it, as long as the version was even before
+//	and is the same after (ReadVersion, Validate); and one that comes
+//	back to a page after letting go of it can tell whether anything
+//	moved.
+const int LATCH_CHUNK_BITS = 10;
+const int LATCH_CHUNK_SIZE = 1 << LATCH_CHUNK_BITS;
+const int LATCH_DIR_BITS = 11;
+const int LATCH_DIR_SIZE = 1 << LATCH_DIR_BITS;
+const int LATCH_TOP_SIZE = 1 << (32 - LATCH_CHUNK_BITS - LATCH_DIR_BITS);
+
+//	Page ids are 32 bits, as the prebuilt libraries have them; the
+//	table, the page table and the partitions all hash them as unsigned.
+typedef char PageIDIs32Bits[(sizeof(PageID) == 4) ? 1 : -1];
+
+class PageLatchTable {
+public:
+	PageLatchTable();
+	~PageLatchTable();
+
+	void Lock(PageID pid, LatchMode mode);
+	bool TryLockExclusive(PageID pid);
+	// changed keeps the new version; only meaningful for exclusive latches.
+	void Unlock(PageID pid, LatchMode mode, bool changed = false);
+
+	// The caller must hold the page's latch.
+	unsigned Version(PageID pid) { return Get(pid).version; }
+
+	// For readers without a latch.  ReadVersion waits for any writer to
+	// finish and returns the version; Validate tells whether the page
+	// is still at that version, so everything read from it in between
+	// is consistent.
+	unsigned ReadVersion(PageID pid);
+	bool Validate(PageID pid, unsigned version);
+
+	// Latches the page, unless it is no longer at version; then it
+	// returns false without holding anything.
+	bool LockAtVersion(PageID pid, LatchMode mode, unsigned version);
+
+private:
+	struct PageLatch {
+		Latch latch;
+		volatile unsigned version;
+		PageLatch() : version(0) {}
+	};
+
+	typedef PageLatch * volatile Chunk;
+	Chunk * volatile *top;
+	Mutex growMutex;
+
+	PageLatch &Get(PageID pid) {
+		unsigned n = (unsigned)pid;
+		Chunk *dir = top[n >> (LATCH_CHUNK_BITS + LATCH_DIR_BITS)];
+		PageLatch *chunk = (dir != NULL) ? dir[(n >> LATCH_CHUNK_BITS) & (LATCH_DIR_SIZE - 1)] : NULL;
+		if (chunk == NULL)
+			chunk = AddChunk(n);
+		return chunk[n & (LATCH_CHUNK_SIZE - 1)];
+	}
+	PageLatch *AddChunk(unsigned n);
+};
+
+//	Page ids are unique in the database, so every index shares one table.
+extern PageLatchTable pageLatches;
+
+
+//	A count of events that page versions don't show.  A reader without
+//	latches reads it before it starts and again after each step; if it
+//	is unchanged, none of the events happened in between.  Advance is
+//	atomic, so that two events never count as one.
+class EventCounter {
+public:
+	EventCounter() : count(0) {}
+
+	unsigned Read();
+	void Advance();
+
+private:
+	volatile unsigned count;
+};
+
+//	Lets other threads run before trying something again.
+void YieldThread();
+void SleepMicros(int micros);
+
+//	Atomic operations on shared counters.  AtomicAdd returns the new
+//	value; AtomicCompareAndSwap stores newValue only if *p is oldValue,
+//	and tells whether it did.  Both are full fences.
+int AtomicAdd(volatile int *p, int delta);
+bool AtomicCompareAndSwap(volatile int *p, int oldValue, int newValue);
+//	Orders the loads and stores before it against those after it.
+void MemoryFence();
+
+#endif
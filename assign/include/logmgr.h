@@ -0,0 +1,147 @@
+#ifndef _LOGMGR_H
+#define _LOGMGR_H
+
+#include <vector>
+
+#include "minirel.h"
+#include "page.h"
+#include "latch.h"
+
+//	A place in the log: how many bytes were logged before it since the
+//	log was started.  It only grows, across checkpoints too.
+typedef unsigned long long LSN;
+
+const int LOG_GROUP_PAGES = 8;					// most pages one group of changes holds
+const int LOG_BUFFER_BYTES = 256 * 1024;		// appended bytes that an append writes out itself
+const int LOG_CHECKPOINT_BYTES = 8 * 1024 * 1024;	// log that makes an update take a checkpoint
+const int LOG_WAIT_MICROS = 100;				// how often an update looks whether a checkpoint is over
+
+//	The most one page's changes take in a group: its id, flags and count
+//	of ranges, and the whole page as one range.
+const int LOG_PAGE_BYTES = (int)sizeof(PageID) + 8 + MINIBASE_PAGESIZE;
+
+enum LogMode {
+	LOG_OFF,		// nothing is logged; pages are only safe once written
+	LOG_LAZY,		// updates are logged but don't wait for the log
+	LOG_SYNC		// an update returns once its changes are on disk
+};
+
+//	A redo log of the changes made to pages, so that an update survives
+//	a crash without its pages being written.  A change is logged as the
+//	bytes of the page that differ from what the page held when it was
+//	last logged or read; see BufMgr::LogPages, which unpinning a page
+//	dirty calls.  Changes to several pages that only make sense
+//	together, such as a merge of two leaves, are logged as one group,
+//	and after a crash a group is replayed whole or not at all.
+//	Replaying only sets bytes, so it can start from pages written at any
+//	time since the last checkpoint.
+//
+//	Groups go to a buffer, and are written out and synced by whoever
+//	first needs them on disk: no page is written before the log of its
+//	changes (Force).  In LOG_SYNC mode an update waits for its groups,
+//	and updates that end while the log is being synced all share the
+//	next sync.  In LOG_LAZY mode a crash may lose the last updates, but
+//	the indexes stay whole.
+//
+//	A checkpoint writes every dirty page, syncs the database file and
+//	empties the log.  It waits for running updates to end and holds new
+//	ones off meanwhile.  One is taken once the log outgrows
+//	LOG_CHECKPOINT_BYTES, and when the buffer manager goes away.  Pages
+//	freed while logging are only reused, given back to DB or punched
+//	out of the file after the next checkpoint; see SpaceMap::Settle.
+//
+//	The log is the file of SystemDefs' log name, attached to the
+//	database when the first index is opened; a log left by a crash is
+//	replayed into the database then, even with logging off.  A page
+//	named in the database's directory holds a stamp that the log
+//	carries too, so that the log of an earlier database of the same
+//	name is never replayed into a new one.
+class LogMgr
+{
+	public :
+
+		LogMgr();
+		~LogMgr();
+
+		// Logging starts when an index is next opened.  Turning it off
+		// takes a checkpoint first.  No update may be running.
+		void SetMode(LogMode mode);
+		LogMode GetMode() { return mode; }
+		// Whether changes to pages are being logged.
+		bool IsLogging() { return logging; }
+
+		// Attaches the log to MINIBASE_DB on first use, or when the
+		// database has changed, replaying it first if it was left by a
+		// crash.  Callers hold dbMutex.
+		Status Attach();
+		// Takes a checkpoint and closes the file, for the buffer
+		// manager going away.
+		void Close();
+		// Closes the file without writing what is left, as a crash
+		// would, for tests of recovery.
+		void Discard();
+
+		// Writes the changes of page since image, or all of it against
+		// zeros if image is NULL, to out, which has room for
+		// LOG_PAGE_BYTES.  Returns their length, 0 if there are none.
+		static int Encode(PageID pid, const Page *page, const Page *image, char *out);
+		// Appends length bytes of changes from Encode as one group, and
+		// returns where the log ends after it.
+		LSN Append(const char *changes, int length);
+		// Waits until the log up to lsn is on disk.
+		Status Force(LSN lsn);
+
+		// Bracket every update of an index.  EndUpdate commits it: in
+		// LOG_SYNC mode it waits for the log.  It also takes a
+		// checkpoint if the log has grown too long.
+		void BeginUpdate();
+		Status EndUpdate();
+		// Waits for the log, in LOG_SYNC mode, for an update made
+		// outside BeginUpdate and EndUpdate.
+		Status Commit();
+		Status Checkpoint();
+
+	private :
+
+#ifdef _WIN32
+		void *file;
+#else
+		int file;
+#endif
+		LogMode mode;
+		volatile bool logging;
+		const void *attachedTo;		// the DB the log was attached to
+		unsigned stamp;				// what the stamp page holds
+		PageID stampPage;
+
+		// Bytes appended since written, which Force writes out, and the
+		// buffer it writes them from meanwhile.
+		std::vector<char> buffer;
+		std::vector<char> writing;
+		LSN base;					// where the first group in the file starts
+		LSN written;				// where buffer starts
+		LSN appended;				// where buffer ends
+		LSN flushed;				// the log is on disk up to here
+		bool failed;				// a write or a sync of the log failed
+		Mutex appendMutex;			// over the members from buffer on
+		Mutex flushMutex;			// held by the thread writing the log out
+
+		volatile int updates;		// running updates
+		volatile int checkpointing;	// holds new updates off
+		Mutex checkpointMutex;
+
+		Status ReadStamp();
+		Status NewStamp();
+		Status Replay(const std::vector<char> &log, LSN from, LSN &end);
+		Status ApplyGroup(const char *changes, int length);
+		Status Restart(LSN from);
+		Status Checkpoint(LSN minLength);
+		void Detach();
+
+		LogMgr(const LogMgr &);
+		LogMgr &operator=(const LogMgr &);
+};
+
+extern LogMgr logMgr;
+
+#endif
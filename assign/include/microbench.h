@@ -0,0 +1,75 @@
+
+#ifndef _MICRO_BENCH_H_
+#define _MICRO_BENCH_H_
+
+#include "btreebench.h"
+#include "sortedpage.h"
+#include <vector>
+
+//	The page and key primitives that are timed.  Each runs on pages in
+//	local memory, so no buffer manager or database is involved.
+enum MicroPrimitive {
+	MICRO_KEY_CMP,			// KeyCmp on keys sharing all but the last byte
+	MICRO_MAKE_ENTRY,		// MakeEntry followed by GetKeyData
+	MICRO_INSERT_RECORD,	// SortedPage::InsertRecord (insertion sort)
+	MICRO_COMPACT_SLOTS,	// HeapPage::CompactSlotDir after a delete
+	MICRO_GET_PAGE_ID,		// BTIndexPage::GetPageID
+	MICRO_LEAF_SEARCH,		// BTLeafPage::_Search
+	MICRO_NUM_PRIMITIVES
+};
+
+struct MicroBenchConfig {
+	std::vector<int> keyLens;		// key lengths in bytes, without the terminator
+	std::vector<int> fillPercents;	// how full the pages are
+	double minSeconds;				// minimum measured time per result
+	bool useCounters;				// read hardware counters where supported
+	BenchFormat format;
+	const char *outFile;			// NULL for stdout
+
+	MicroBenchConfig();
+	Status Parse(int argc, char *argv[]);
+	static void PrintUsage(ostream &os);
+};
+
+struct MicroResult {
+	MicroPrimitive primitive;
+	int keyLen;
+	int fillPercent;
+	int entries;		// entries on the page, 0 where no page is used
+	long iterations;
+	double nsPerOp;
+	bool haveCounters;
+	double cyclesPerOp, instructionsPerOp, cacheMissesPerOp, branchMissesPerOp;
+};
+
+//	Gives the benchmark access to the protected slot directory.
+class MicroBenchPage : public SortedPage {
+public:
+	Status DeleteSlot(int slot);
+	void Compact() { CompactSlotDir(); }
+	int NumSlots() { return numOfSlots; }
+};
+
+class MicroBench {
+
+public:
+
+	MicroBench(const MicroBenchConfig &config) : config(config) {}
+
+	Status RunBenchmarks();
+
+	static const char *PrimitiveName(int primitive);
+
+private:
+
+	const MicroBenchConfig &config;
+
+	Status RunOne(MicroPrimitive primitive, int keyLen, int fillPercent, MicroResult &result);
+
+	static void WriteHeader(ostream &os, BenchFormat format);
+	static void WriteResult(ostream &os, BenchFormat format,
+							const MicroResult &result, bool first);
+	static void WriteFooter(ostream &os, BenchFormat format);
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _PAGEIO_H
+#define _PAGEIO_H
+
+#include "minirel.h"
+#include "page.h"
+#include "latch.h"
+
+#define PAGEIO_THREADS 8	// most submitted requests in flight at once, and the default
+#define PAGEIO_ALIGN   4096	// alignment of AllocPages, enough for any device's direct I/O
+
+//	A read or write of one page, or of a run of count pages from pid on
+//	that lie next to each other in the file.  Complete is called by the thread that did
+//	it, once status is set; by default it marks the request done for
+//	PageIO::Wait.  A request may delete itself in Complete if nobody
+//	waits for it.
+class IORequest
+{
+	public :
+
+		PageID pid;
+		Page *page;			// if count is 1
+		Page **pages;		// if count is more, one for each page
+		int count;
+		bool write;
+		Status status;
+
+		IORequest();
+		virtual ~IORequest();
+		virtual void Complete();
+		bool IsDone() { return done != 0; }
+
+	private :
+
+		friend class PageIO;
+		volatile int done;
+		IORequest *next;
+};
+
+//	Reads and writes pages of the database file many at a time.  DB
+//	reads and writes through one file descriptor that it seeks first,
+//	so calls to it have to wait for each other under dbIOMutex.  PageIO
+//	opens the file again and reads and writes at a position given with
+//	each call, which doesn't move anything shared: callers do their own
+//	requests on their own threads at once, and Submit hands requests to
+//	a pool of PAGEIO_THREADS threads, so a caller can have many in
+//	flight.  Page n is at n times the page size, where DB keeps it.
+//
+//	The file is opened on first use once MINIBASE_DB exists, and again
+//	if MINIBASE_DB changes; Close is for the buffer manager going away.
+//	If it can't be opened, requests go through DB under dbIOMutex.
+//	Closing or reopening the file unmaps it.
+//
+//	With direct I/O on, the file is opened to bypass the OS cache
+//	(O_DIRECT, or FILE_FLAG_NO_BUFFERING on Windows), so that a page
+//	held by the buffer manager isn't held a second time by the OS and
+//	a write goes to the device when it is done, not when the kernel
+//	gets round to it.  Pages read or written then have to lie in memory
+//	from AllocPages.  Where the file system or device won't take direct
+//	I/O of single pages, the file is opened as usual.
+class PageIO
+{
+	public :
+
+		PageIO();
+		~PageIO();
+		bool Open();
+		void Close();
+
+		Status Read(PageID pid, Page *page);
+		Status Write(PageID pid, Page *page);
+		// Read or write count pages at the places of first, first + 1,
+		// and so on, in one call where the platform has vectored I/O.
+		Status ReadRun(PageID first, Page **pages, int count);
+		Status WriteRun(PageID first, Page **pages, int count);
+		// Read or write pages in any order, each run of them that lie
+		// next to each other in the file in one call.
+		Status ReadPages(const PageID *pids, Page **pages, int count);
+		Status WritePages(const PageID *pids, Page **pages, int count);
+
+		// Does the request on the calling thread.
+		void Run(IORequest *req);
+		// Queues the request for the pool.  It is done on this thread
+		// if the file isn't open.
+		void Submit(IORequest *req);
+		void Wait(IORequest *req);
+
+		// Sets the size of the pool, up to PAGEIO_THREADS.  With no
+		// threads, Submit does requests on the calling thread.  Where
+		// reads are cheaper than handing them to another thread, as
+		// from the OS cache on few cores, that is faster.  No request
+		// may be out.
+		void SetThreads(int n);
+		int GetThreads() { return numThreads; }
+
+		// Whether the file is to be opened for direct I/O.  The file is
+		// reopened at its next use.  No request may be out, and the file
+		// not mapped.  IsDirect is whether the open file bypasses the
+		// OS cache.
+		void SetDirect(bool on);
+		bool IsDirect() { return directOpen; }
+
+		// Page storage for direct I/O, aligned to PAGEIO_ALIGN.
+		static Page *AllocPages(int count);
+		static void FreePages(Page *pages);
+
+		// Maps the file read only, as it is now, for MappedPage; the
+		// pages then come from the OS cache, shared with any other
+		// process mapping the file, without being copied.  Nothing may
+		// write the file while it is mapped.
+		bool Map();
+		void Unmap();
+		bool IsMapped() { return mapped != NULL; }
+		// The page in the mapping, or NULL if it is beyond the file.
+		Page *MappedPage(PageID pid)
+		{
+			return (mapped != NULL && pid >= 0 && pid < mappedPages)
+				? (Page *)(mapped + (size_t)pid * MINIBASE_PAGESIZE) : NULL;
+		}
+		// Tells the OS that count mapped pages from pid on will be read
+		// soon.
+		void WillNeed(PageID pid, int count);
+
+		// The file is as long as the database from the start, but only
+		// has blocks where pages have been written.  Preallocate gives
+		// pages their blocks ahead of the writes, so that a database
+		// growing into them gets them next to each other; PunchHole
+		// takes the blocks of free pages back.  Both are only advice.
+		Status Preallocate(PageID first, int count);
+		Status PunchHole(PageID first, int count);
+
+		// Waits for the pages written to reach the device, for a
+		// checkpoint of the log; see LogMgr.
+		Status Sync();
+
+		// What each thread of the pool runs.
+		static void *Worker(void *pageIO);
+
+	private :
+
+#ifdef _WIN32
+		void *file;
+		void *queueLock;		// an SRWLOCK
+		void *queueReady;		// a CONDITION_VARIABLE
+		void *threads[PAGEIO_THREADS];
+#else
+		int file;
+		pthread_mutex_t queueLock;
+		pthread_cond_t queueReady;
+		pthread_t threads[PAGEIO_THREADS];
+#endif
+		void *mapping;			// on Windows, the file mapping object
+		char * volatile mapped;	// the file mapped read only, or NULL
+		size_t mappedBytes;
+		int mappedPages;
+		const void * volatile openFor;	// the DB the file was opened for
+		bool direct;			// what SetDirect asked for
+		bool directOpen;		// whether the file is open for direct I/O
+		Mutex openMutex;
+		IORequest *head, *tail;
+		int numThreads;
+		volatile bool started;
+		bool stopping;
+
+		Status Transfer(PageID pid, Page *page, bool write);
+		Status TransferRun(PageID first, Page **pages, int count, bool write);
+		Status TransferList(const PageID *pids, Page **pages, int count, bool write);
+		void UnmapLocked();
+		bool ProbeDirect();
+		void StartThreads();
+		void StopThreads();
+		IORequest *Next();
+
+		PageIO(const PageIO &);
+		PageIO &operator=(const PageIO &);
+};
+
+extern PageIO pageIO;
+
+#endif
@@ -1,28 +1,204 @@
+#ifndef _REPLACER_H
+#define _REPLACER_H
+
 #include "clockframe.h"
 #include "hash.h"
+#include "latch.h"
 
-class Replacer 
+//	Decides which frame gives up its page on a miss.  The buffer manager
+//	tells it about every pin and about pages coming and going; a policy
+//	keeps whatever it needs per frame in its own arrays, by frame number.
+//
+//	Referenced is called on every hit, under a shared partition latch, so
+//	it must not block.  Loaded, Evicted and Freed are called under the
+//	exclusive latch of the page's partition, for different partitions at
+//	once; a policy that locks in them must never wait for a partition.
+class Replacer
 {
 	public :
 
 		Replacer();
-		~Replacer();
+		virtual ~Replacer();
 
+		// Returns a frame that looks unpinned, or INVALID_FRAME if none
+		// turned up.  The caller still has to claim it.
 		virtual int PickVictim() = 0;
+
+		virtual void Referenced(int /* frameNo */) {}
+		virtual void Loaded(int /* frameNo */, PageID /* pid */) {}
+		// The page was replaced, and may come back.
+		virtual void Evicted(int /* frameNo */, PageID /* pid */) {}
+		// The page was deallocated.
+		virtual void Freed(int /* frameNo */) {}
+		// The page was unpinned by a caller that won't use it again
+		// soon, like a scan moving past it.  Called like Referenced.
+		virtual void Hated(int /* frameNo */) {}
 };
 
+//	Makes the replacer named by policy: "Clock", "LRU2", "2Q" or "ARC".
+//	Returns NULL for any other name.
+Replacer *NewReplacer(const char *policy, int bufSize, ClockFrame **frames);
+
+
+//	The clock hand is shared by all partitions and moved atomically, so
+//	threads looking for victims at the same time look at different frames.
 class Clock : public Replacer
 {
 	private :
-		
-		int current;
+
+		volatile int current;
 		int numOfBuf;
 		ClockFrame **frames;
-		HashTable *hashTable;
 
 	public :
-		
-		Clock( int bufSize, ClockFrame **frames, HashTable *hashTable );
+
+		Clock( int bufSize, ClockFrame **frames );
 		~Clock();
 		int PickVictim();
-};
\ No newline at end of file
+		void Freed(int frameNo);
+		void Hated(int frameNo);
+};
+
+
+//	Page ids of pages recently replaced, oldest first, for the policies
+//	that remember them.  Holds at most capacity ids; Push drops the
+//	oldest to make room.  Not synchronized.
+class GhostList
+{
+	private :
+
+		PageID *ring;		// INVALID_PAGE where an id was removed
+		int capacity;
+		int head;			// oldest
+		int used;			// slots from head, including removed ids
+		int count;			// ids in the list
+		HashTable positions;
+
+		void PopOldest();
+
+	public :
+
+		GhostList( int capacity );
+		~GhostList();
+		void Push( PageID pid );
+		bool Remove( PageID pid );
+		int Size() { return count; }
+};
+
+
+//	Base of the policies that order frames by when they were used.  An
+//	exact order would need a shared list updated on every pin; instead
+//	each frame keeps the times of its last two references, and a victim
+//	is the oldest of a sample of REPLACER_SAMPLE frames taken at a hand
+//	that moves like the clock's.  Time is the number of victims picked,
+//	so a hit only writes its own frame's history, and only the first
+//	time it is used in a tick.
+const int REPLACER_SAMPLE = 16;
+
+//	The queue a frame's page is on, for the policies that keep several.
+enum ReplacerQueue {
+	QUEUE_NONE,			// no page
+	QUEUE_COLD,			// 2Q's A1in, ARC's T1: referenced once
+	QUEUE_HOT			// 2Q's Am, ARC's T2: referenced again
+};
+
+class SampledReplacer : public Replacer
+{
+	protected :
+
+		struct History {
+			volatile unsigned last;
+			volatile unsigned previous;
+			volatile int queue;
+		};
+
+		int numOfBuf;
+		ClockFrame **frames;
+		History *history;
+		volatile int hand;
+		volatile int now;
+		volatile int coldCount;
+		volatile int hotCount;
+
+		unsigned Now() { return (unsigned)now; }
+		void Touch(int frameNo);
+		void SetQueue(int frameNo, int queue);
+
+		// The oldest unpinned frame of the sample on queue if there is
+		// one, else the oldest unpinned one on any queue.  A frame
+		// without a page is taken at once.
+		int Sample(int queue);
+
+		// Whether frame a should be replaced before frame b.
+		virtual bool Older(int a, int b);
+
+	public :
+
+		SampledReplacer( int bufSize, ClockFrame **frames );
+		~SampledReplacer();
+		void Referenced(int frameNo);
+		void Loaded(int frameNo, PageID pid);
+		void Evicted(int frameNo, PageID pid);
+		void Freed(int frameNo);
+		void Hated(int frameNo);
+};
+
+//	LRU-2: replaces the page whose second to last reference is oldest.
+//	Pages referenced only once since they came in go first, oldest
+//	first, so a scan doesn't push out pages used over and over.
+class LRUK : public SampledReplacer
+{
+	protected :
+
+		bool Older(int a, int b);
+
+	public :
+
+		LRUK( int bufSize, ClockFrame **frames );
+		int PickVictim();
+};
+
+//	2Q: new pages go on the cold queue, which is replaced FIFO once it
+//	holds more than a quarter of the pool.  A page that comes back while
+//	its id is still on the ghost list of recent cold victims goes on the
+//	hot queue, which is replaced LRU.
+class TwoQ : public SampledReplacer
+{
+	private :
+
+		int maxCold;
+		GhostList coldGhosts;
+		Mutex ghostMutex;
+
+	public :
+
+		TwoQ( int bufSize, ClockFrame **frames );
+		int PickVictim();
+		void Referenced(int frameNo);
+		void Loaded(int frameNo, PageID pid);
+		void Evicted(int frameNo, PageID pid);
+};
+
+//	ARC: a page referenced again moves from the cold to the hot queue.
+//	Ghost lists remember victims of each queue, and a miss on one of
+//	them moves the cold queue's target size towards the queue that
+//	would have kept the page.
+class ARC : public SampledReplacer
+{
+	private :
+
+		volatile int target;	// cold frames to keep
+		GhostList coldGhosts;
+		GhostList hotGhosts;
+		Mutex ghostMutex;
+
+	public :
+
+		ARC( int bufSize, ClockFrame **frames );
+		int PickVictim();
+		void Referenced(int frameNo);
+		void Loaded(int frameNo, PageID pid);
+		void Evicted(int frameNo, PageID pid);
+};
+
+#endif
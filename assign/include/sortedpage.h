@@ -8,6 +8,15 @@
 #include "bt.h"
 
 
+//	Every page but the last on its level links to its right sibling
+//	through nextPage and keeps a high key: the smallest key that belongs
+//	to the sibling.  The high key is an extra record after the entries,
+//	which GetNumOfRecords doesn't count, and this bit of type says that
+//	it is there.  A reader that finds its key at or past the high key
+//	has come to the page after a split, and moves right.
+#define SORTED_HIGH_KEY		0x100
+
+
 class SortedPage : public HeapPage {
 	
 private:
@@ -19,10 +28,28 @@ public:
 	Status InsertRecord(char * recPtr, int recLen, RecordID& rid);	
 	Status DeleteRecord(const RecordID& rid);
 	
+	// Only for a newly initialized page; it has no high key.
 	void  SetType(NodeType t)  { type = (short)t; }
+	// Only for a page copied to another place.
+	void  SetPageNo(PageID pageNo) { pid = pageNo; }
+
+	NodeType GetType()         { return (NodeType)(type & ~SORTED_HIGH_KEY); }
+	int   GetNumOfRecords() { return numOfSlots - (HasHighKey() ? 1 : 0); }
+
+	bool  HasHighKey()      { return (type & SORTED_HIGH_KEY) != 0; }
+	const char *HighKey()   { return data + slots[numOfSlots - 1].offset; }
+	// Replaces the high key; NULL removes it.  FAIL if it doesn't fit.
+	Status SetHighKey(const char *key);
+	// Whether key belongs to a page further right.
+	bool  PastHighKey(const char *key);
+
+	// Bytes taken by the entries and their slots, the high key left out.
+	int   UsedSpace();
+	// Bytes taken by the high key and its slot.
+	int   HighKeySpace();
 
-	NodeType GetType()         { return (NodeType)type; }
-	int   GetNumOfRecords() { return numOfSlots; }
+	// Bytes a record of length recLen takes, its slot included.
+	static int RecordSpace(int recLen) { return recLen + (int)sizeof(Slot); }
 };
 
 #endif
@@ -0,0 +1,103 @@
+#ifndef _SPACEMAP_H
+#define _SPACEMAP_H
+
+#include "minirel.h"
+#include "page.h"
+#include <map>
+#include <vector>
+
+const int SPACE_EXTENT = 64;	// pages taken from DB at a time
+const int SPACE_GROW = 1024;	// pages of the file preallocated at a time
+const int SPACE_HOLD = 4096;	// most free pages held past a Free
+const int SPACE_NO_OWNER = -1;
+
+//	Hands out the pages of BufMgr::NewPage from extents it takes from
+//	DB SPACE_EXTENT pages at a time, and takes back the pages freed by
+//	BufMgr::FreePage.  DB looks for free pages a bit at a time through
+//	its space map, pinning each page of it on the way; here the free
+//	pages held are a bitmap in memory with a word per 32 pages, and a
+//	second bitmap of the words with any page free.  A page is found
+//	from a cursor with a count-trailing-zeros in each, and a run by
+//	going over the words that have pages free.
+//
+//	Pages can be asked for near another page, for an owner: each owner
+//	gets extents of its own, and a page comes from the extent of the
+//	page it is near if that has one free after it, from the extent the
+//	owner's last page came from if not, and from a new extent only if
+//	neither has.  Pages taken for nobody come from extents of nobody,
+//	new ones while the database has room, so owners' extents are kept
+//	for them.
+//	An owner is any number the caller likes other than SPACE_NO_OWNER.
+//
+//	The file gets blocks for the extents SPACE_GROW pages at a time, so
+//	that it grows in large pieces.
+//
+//	The pages held are allocated as far as DB's space map goes, and
+//	only this map knows which of them are free, so the free ones are
+//	kept few: once all 32 pages of a word are free, they go back to DB,
+//	their blocks with a hole in the file, and past SPACE_HOLD free
+//	pages, runs of them go back until half that are left.  A word given back gets blocks again
+//	when DB hands a page of it out.  The pages left go back with
+//	Release, which the buffer manager calls as it goes away; if the
+//	process dies first, they stay allocated for good, which is at most
+//	SPACE_HOLD pages and the rest of the extent last taken.  A new
+//	database starts a new map.  Callers hold dbMutex.
+//
+//	While the log is on, a page freed is only taken back at the next
+//	checkpoint, once the update that freed it is on disk; see Settle.
+//	A crash loses the pages freed since the last checkpoint too.
+class SpaceMap
+{
+	public :
+
+		SpaceMap();
+
+		// count pages next to each other, from those held or from a
+		// new extent.  A single page for an owner is looked for after
+		// near first, if near is a page.
+		Status Allocate(PageID &first, int count, PageID near = INVALID_PAGE,
+						int owner = SPACE_NO_OWNER);
+		// Takes the pages back.  FAIL if one of them is free already.
+		// Words left all free go back to DB.
+		Status Free(PageID first, int count);
+		// Takes back the pages freed while the log was on, for a
+		// checkpoint.
+		Status Settle();
+		// Gives every page held back to DB.
+		Status Release();
+		// Forgets every page held, for tests of recovery.
+		void Discard();
+		int GetNumOfFreePages() { return numFree; }
+
+	private :
+
+		const void *db;					// the DB the pages are from
+		std::vector<unsigned> freeBits;	// bit p % 32 of word p / 32 for page p
+		std::vector<unsigned> wordBits;	// bit w % 32 of word w / 32 if freeBits[w] != 0
+		std::vector<int> owners;		// owner of the extent of each word
+		std::vector<bool> punched;		// whether a word's blocks were given back
+		std::vector<PageID> pending;	// freed since the last checkpoint
+		PageID grownTo;					// the file has blocks below this page
+		std::map<int, PageID> lastPage;	// each owner's last page
+		int numFree;
+		int cursor;						// the word the last page came from
+
+		void Attach();
+		void Mark(PageID first, int count, bool free);
+		int NextWord(int word);
+		PageID FindRun(int count);
+		PageID FindFree(PageID from, PageID to, int owner);
+		Status Extend(int count, PageID &first, int owner);
+		void Grow(PageID first, PageID end);
+		void Refill(PageID first, int count);
+		Status Trim(int from, int to);
+		int FreeRun(PageID start);
+		Status GiveBack(PageID start, int count);
+
+		SpaceMap(const SpaceMap &);
+		SpaceMap &operator=(const SpaceMap &);
+};
+
+extern SpaceMap spaceMap;
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef _WORKLOAD_H
+#define _WORKLOAD_H
+
+#include <cstdio>
+#include "btfile.h"
+#include "index.h"
+
+//	Deterministic xorshift64* generator.  The same seed produces the same
+//	sequence on every platform, unlike rand().
+class WorkloadRandom {
+	unsigned long long state;
+public:
+	WorkloadRandom(unsigned long long seed) : state(seed ? seed : 88172645463325252ULL) {}
+
+	unsigned long long Next() {
+		state ^= state >> 12;
+		state ^= state << 25;
+		state ^= state >> 27;
+		return state * 2685821657736338717ULL;
+	}
+
+	// Uniform in [0, n).
+	long Uniform(long n) { return (long)(Next() % (unsigned long long)n); }
+
+	// Uniform in [0, 1).
+	double NextDouble() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+};
+
+//	Zipfian generator over [0, n), following Gray et al., "Quickly Generating
+//	Billion-Record Synthetic Databases".  Item 0 is the most popular.  The
+//	range may grow between calls; zeta(n) is extended incrementally.
+class ZipfianGenerator {
+	long n;
+	double theta, alpha, zeta2, zetan, eta;
+	void Grow(long newN);
+public:
+	ZipfianGenerator(long n, double theta);
+	long Next(WorkloadRandom &rnd, long numItems);
+};
+
+enum KeyDistribution {
+	DIST_UNIFORM,
+	DIST_ZIPFIAN,		// popular keys scattered over the key space
+	DIST_LATEST			// the most recently inserted keys are the most popular
+};
+
+//	Picks existing record numbers in [0, numKeys) under a distribution.
+class KeyChooser {
+	KeyDistribution dist;
+	ZipfianGenerator zipf;
+public:
+	KeyChooser(KeyDistribution dist, long numKeys, double theta = 0.99)
+		: dist(dist), zipf(numKeys, theta) {}
+	long Next(WorkloadRandom &rnd, long numKeys);
+};
+
+//	The primitive B+ tree operations that workloads are made of, and the
+//	unit of a trace.  A scan reads at most limit entries (-1 for no limit);
+//	an exact match lookup is a scan with lowKey == highKey.
+enum TraceOpType {
+	TRACE_INSERT = 1,
+	TRACE_DELETE = 2,
+	TRACE_SCAN = 3
+};
+
+struct TraceOp {
+	TraceOpType type;
+	bool hasLow, hasHigh;		// scans only; false means unbounded
+	char lowKey[MAX_KEY_SIZE];	// the key for inserts and deletes
+	char highKey[MAX_KEY_SIZE];
+	RecordID rid;				// inserts and deletes only
+	int limit;					// scans only
+};
+
+//	Operation mix of the YCSB core workloads:
+//	  A  50% read, 50% update, zipfian
+//	  B  95% read,  5% update, zipfian
+//	  C 100% read, zipfian
+//	  D  95% read,  5% insert, latest
+//	  E  95% short scan, 5% insert, zipfian
+//	  F  50% read, 50% read-modify-write, zipfian
+struct YcsbMix {
+	int readPercent;
+	int updatePercent;
+	int insertPercent;
+	int scanPercent;
+	int rmwPercent;
+	KeyDistribution dist;
+	int maxScanLen;
+
+	static Status Get(char workload, YcsbMix &mix);
+};
+
+const int WORKLOAD_MAX_OPS = 3;		// primitive ops per YCSB operation
+
+class WorkloadGenerator {
+
+public:
+
+	WorkloadGenerator(const YcsbMix &mix, long recordCount, unsigned long seed,
+					  double theta = 0.99);
+
+	// Inserts the initial records 0..recordCount-1.
+	Status Load(BTreeFile *btf);
+
+	// Produces the primitive ops of the next YCSB operation.
+	int Next(TraceOp ops[WORKLOAD_MAX_OPS]);
+
+	// For one of numParts generators running side by side: only insert
+	// every numParts-th new record, starting at part.
+	void Partition(int part, int numParts);
+
+	static void MakeKey(long n, char *key);
+	static void MakeRid(long n, RecordID &rid);
+
+	static void MakeInsert(long n, TraceOp &op);
+	static void MakeDelete(long n, TraceOp &op);
+	static void MakeScan(long n, int limit, bool exact, TraceOp &op);
+
+	// Runs one op; found is the number of entries a scan returned.
+	static Status Execute(BTreeFile *btf, const TraceOp &op, int &found);
+
+private:
+
+	YcsbMix mix;
+	long numKeys;
+	long nextInsert;
+	int insertStride;
+	WorkloadRandom rnd;
+	KeyChooser chooser;
+};
+
+
+//	Binary trace files.  A trace starts with the magic "BTTR" and a version
+//	byte, followed by one record per op:
+//	  type:1 flags:1 [lowLen:1 low] [highLen:1 high] then
+//	  pageNo:4 slotNo:4 for inserts and deletes, limit:4 for scans.
+//	Integers are little endian; flags bit 0/1 mark a present low/high key.
+class TraceWriter {
+
+public:
+
+	TraceWriter() : fp(NULL), numOps(0) {}
+	~TraceWriter() { Close(); }
+
+	Status Open(const char *filename);
+	Status Write(const TraceOp &op);
+	Status Close();
+
+	long NumOps() const { return numOps; }
+
+private:
+
+	FILE *fp;
+	long numOps;
+};
+
+class TraceReader {
+
+public:
+
+	TraceReader() : fp(NULL) {}
+	~TraceReader() { Close(); }
+
+	Status Open(const char *filename);
+	Status Read(TraceOp &op);		// DONE at the end of the trace
+	void Close();
+
+private:
+
+	FILE *fp;
+};
+
+//	Replays every op of a trace in order.
+Status ReplayTrace(BTreeFile *btf, const char *filename, long &numOps);
+
+#endif